@@ -0,0 +1,156 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraBufferCtrlObj.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRABUFFERCTRLOBJ_H_
+#define ULTRABUFFERCTRLOBJ_H_
+
+#include <cstddef>
+#include "lima/HwBufferMgr.h"
+#include "lima/Debug.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class PoolAllocMgr
+ * \brief the Lima buffers in one mapping, on huge pages and a NUMA node
+ *
+ * The buffers follow each other in a single anonymous mapping, backed
+ * by 2 MB huge pages when the system has them reserved, transparent
+ * huge pages otherwise, and bound to a NUMA node before the pages are
+ * first touched. The largest pool Lima may ask for is set by a memory
+ * budget or a number of frames instead of the whole memory.
+ *******************************************************************/
+class PoolAllocMgr : public BufferAllocMgr {
+DEB_CLASS_NAMESPC(DebModCamera, "PoolAllocMgr", "Ultra");
+
+public:
+	enum PageMode { NormalPages, TransparentHugePages, HugePages };
+	static const size_t hugePageSize = 2 * 1024 * 1024;
+
+	PoolAllocMgr();
+	virtual ~PoolAllocMgr();
+
+	virtual int getMaxNbBuffers(const FrameDim& frame_dim);
+	virtual void allocBuffers(int nb_buffers, const FrameDim& frame_dim);
+	virtual const FrameDim& getFrameDim();
+	virtual void getNbBuffers(int& nb_buffers);
+	virtual void releaseBuffers();
+	virtual void* getBufferPtr(int buffer_nb);
+	virtual void clearAllBuffers();
+
+	// applied by the next allocation, 0 for no limit
+	void setMemoryBudget(long long size);
+	long long getMemoryBudget() const { return m_max_size; }
+	void setFrameBudget(int nb_frames);
+	int getFrameBudget() const { return m_max_frames; }
+	void setHugePages(bool enabled);
+	bool getHugePages() const { return m_huge_pages; }
+	void setNumaNode(int node);			// -1: no binding
+	int getNumaNode() const { return m_numa_node; }
+
+	void prefault();
+	PageMode getPageMode() const { return m_page_mode; }
+	size_t getSize() const { return m_size; }
+	char* getBase() const { return m_base; }
+	size_t getBufferSize() const { return m_buffer_size; }
+
+	// from /sys/devices/system/cpu/cpu<n>/node<m>, -1 when unknown
+	static int getCpuNumaNode(int cpu);
+
+private:
+	FrameDim m_frame_dim;
+	int m_nb_buffers;
+	size_t m_buffer_size;
+	char* m_base;
+	size_t m_size;
+	PageMode m_page_mode;
+
+	long long m_max_size;
+	int m_max_frames;
+	bool m_huge_pages;
+	int m_numa_node;
+};
+
+/*******************************************************************
+ * \class BufferCtrlObj
+ * \brief Lima buffer control on a PoolAllocMgr
+ *
+ * The receive path writes the frames straight into their slot of the
+ * slab: frame n is slot n % (nb_buffers * nb_concat_frames), at an
+ * offset computed from the layout cached whenever the buffers change,
+ * concatenated frames following each other within a buffer. The Lima
+ * frame callbacks still go through getBuffer().newFrameReady().
+ *******************************************************************/
+class BufferCtrlObj : public HwBufferCtrlObj {
+DEB_CLASS_NAMESPC(DebModCamera, "BufferCtrlObj", "Ultra");
+
+public:
+	BufferCtrlObj();
+	virtual ~BufferCtrlObj();
+
+	virtual void setFrameDim(const FrameDim& frame_dim);
+	virtual void getFrameDim(FrameDim& frame_dim);
+	virtual void setNbBuffers(int nb_buffers);
+	virtual void getNbBuffers(int& nb_buffers);
+	virtual void setNbConcatFrames(int nb_concat_frames);
+	virtual void getNbConcatFrames(int& nb_concat_frames);
+	virtual void getMaxNbBuffers(int& max_nb_buffers);
+	virtual void* getBufferPtr(int buffer_nb, int concat_frame_nb = 0);
+	virtual void* getFramePtr(int acq_frame_nb);
+	virtual void getStartTimestamp(Timestamp& start_ts);
+	virtual void getFrameInfo(int acq_frame_nb, HwFrameInfoType& info);
+	virtual void registerFrameCallback(HwFrameCallback& frame_cb);
+	virtual void unregisterFrameCallback(HwFrameCallback& frame_cb);
+
+	StdBufferCbMgr& getBuffer() { return m_cb_mgr; }
+	PoolAllocMgr& getAllocMgr() { return m_alloc_mgr; }
+
+	int getNbSlots() const { return m_nb_slots; }
+	void* getSlot(long long acq_frame_nb) const {
+		int slot = acq_frame_nb % m_nb_slots;
+		return m_base + (slot / m_nb_concat) * m_buffer_size + (slot % m_nb_concat) * m_frame_size;
+	}
+	// number of frames from acq_frame_nb on (max_frames at most) following each other in the slab
+	int getSlotRun(long long acq_frame_nb, int max_frames) const;
+
+private:
+	void updateLayout();
+
+	PoolAllocMgr m_alloc_mgr;
+	StdBufferCbMgr m_cb_mgr;
+	BufferCtrlMgr m_mgr;
+
+	char* m_base;
+	size_t m_buffer_size;
+	size_t m_frame_size;
+	int m_nb_concat;
+	int m_nb_slots;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRABUFFERCTRLOBJ_H_ */
@@ -0,0 +1,91 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraCalibration.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRACALIBRATION_H_
+#define ULTRACALIBRATION_H_
+
+#include <vector>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class Calibration
+ * \brief running per pixel gain and offset estimated in-stream
+ *
+ * The pedestal lines update the mean (offset) and variance (noise) of
+ * each pixel, the calibration lines the mean of the injected pulse,
+ * both with Welford's incremental update. With a window the weight of
+ * a new line stops decreasing after nb_lines lines, turning the mean
+ * into an exponential average that follows the drifts. The gain of a
+ * pixel is its pulse amplitude above the offset over the reference
+ * amplitude (the mean amplitude of the pixels when 0), correct() maps
+ * a data line to (raw - offset) / gain.
+ *******************************************************************/
+class Calibration {
+DEB_CLASS_NAMESPC(DebModCamera, "Calibration", "Ultra");
+
+public:
+	Calibration(int npixels);
+
+	void setNbPixels(int npixels);
+	void setWindow(int nb_lines);
+	void getWindow(int& nb_lines) const;
+	void setReference(double amplitude);
+	void getReference(double& amplitude) const;
+	void reset();
+
+	void addCalibrationLine(const unsigned short* line);
+	void addPedestalLine(const unsigned short* line);
+	void correct(unsigned short* line);
+
+	void getEstimates(std::vector<double>& gains, std::vector<double>& offsets, std::vector<double>& noise);
+	void getNbLines(unsigned long long& calibration, unsigned long long& pedestal);
+
+private:
+	struct Welford {
+		std::vector<double> mean;
+		std::vector<double> var;
+		unsigned long long nb_lines;
+	};
+	void update(Welford& w, const unsigned short* line);
+	void updateCorrection();
+
+	mutable Mutex m_lock;
+	int m_npixels;
+	int m_window;
+	double m_reference;
+	Welford m_pulse;
+	Welford m_pedestal;
+	std::vector<float> m_offset;		// applied by correct()
+	std::vector<float> m_factor;		// 1 / gain
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRACALIBRATION_H_ */
@@ -32,8 +32,18 @@
 #include "lima/HwInterface.h"
 #include "UltraInterface.h"
 #include <ostream>
+#include <map>
+#include <atomic>
 #include "lima/Debug.h"
 #include "UltraNet.h"
+#include "UltraCommandCodec.h"
+#include "UltraXchipTiming.h"
+#include "UltraSparse.h"
+#include "UltraHistogram.h"
+#include "UltraCalibration.h"
+#include "UltraMultiHead.h"
+#include "UltraEvents.h"
+#include "UltraBufferCtrlObj.h"
 
 using namespace std;
 
@@ -44,6 +54,8 @@ const int TECPOWERMASK = 0x01l;
 const int HEADPOWERMASK = 0x02l;
 #define BIASENABLEMASK 0x04l
 #define SYNCENABLEMASK 0x80000000l
+#define SYNCGATEMASK 0x40000000l
+#define SYNCSTARTSTOPMASK 0x20000000l
 #define CALENABLEMASK 0x01l
 #define EN8PCMASK 0x06l
 #define TECOVERTEMPMASK 0x80000000l
@@ -59,13 +71,13 @@ const int maxNumChannels = 16;
 const int xPixelSize = 1;
 const int yPixelSize = 1;
 
-class BufferCtrlObj;
+class Hdf5Writer;
 
 /*******************************************************************
  * \class Camera
  * \brief object controlling the Ultra camera
  *******************************************************************/
-class Camera {
+class Camera : public HwMaxImageSizeCallbackGen {
 DEB_CLASS_NAMESPC(DebModCamera, "Camera", "Ultra");
 
 public:
@@ -81,6 +93,7 @@ public:
 	void stopAcq();
 //	void getStatus(Status& status);
 	int getNbHwAcquiredFrames();
+	void getAcquiredFrames(long long& nb_frames);
 
 	// -- detector info object
 	void getImageType(ImageType& type);
@@ -94,6 +107,17 @@ public:
 	// -- Buffer control object
 	HwBufferCtrlObj* getBufferCtrlObj();
 
+	// -- buffer pool, the most Lima may allocate is a memory budget or a time window of lines (0: all the memory),
+	// on huge pages when available, on the NUMA node of the receive cpu or NIC (node -1), pre-faulted by prepareAcq()
+	void setBufferPoolMemory(int size_mb);
+	void getBufferPoolMemory(int& size_mb);
+	void setBufferPoolTime(double line_rate, double time);
+	void getBufferPoolMaxFrames(int& nb_frames);
+	void setBufferHugePages(bool enabled);
+	void getBufferHugePages(bool& enabled);
+	void setBufferNumaNode(int node);
+	void getBufferPool(int& nb_buffers, long long& size, int& page_mode, int& numa_node);
+
 	//-- Synch control object
 	void setTrigMode(TrigMode mode);
 	void getTrigMode(TrigMode& mode);
@@ -110,7 +134,10 @@ public:
 	void setNbFrames(int nb_frames);
 	void getNbFrames(int& nb_frames);
 
+	// acquisition state, Idle -> Armed (startAcq) -> Running -> Stopping (stopAcq) -> Idle, or Fault on an error
+	enum AcqState { Idle, Armed, Running, Stopping, Fault };
 	bool isAcqRunning() const;
+	void getAcqState(AcqState& state) const;
 
 	///////////////////////////
 	// -- ultra specific functions
@@ -170,6 +197,12 @@ public:
 	void setAdcOffset(int channel, float value);
 	void getAdcGain(int channel, float &value);
 	void setAdcGain(int channel, float value);
+	void getAdcOffsets(std::vector<float>& values);
+	void setAdcOffsets(const std::vector<float>& values);
+	void getAdcGains(std::vector<float>& values);
+	void setAdcGains(const std::vector<float>& values);
+	void getDarkChannelMeans(int nb_lines, std::vector<double>& means);
+	void calibrateAdcOffsets(float target, float tolerance, int max_iterations, int nb_lines, bool& converged);
 	void getAux1(unsigned int& delay, unsigned int& width);
 	void setAux1(unsigned int delay, unsigned int width);
 	void getAux2(unsigned int& delay, unsigned int& width);
@@ -181,6 +214,166 @@ public:
 			unsigned int sampleWidth, unsigned int resetWidth, unsigned int settlingTime, unsigned int xClkHalfPeriod,
 			unsigned int readoutMode);
 
+	// -- XCHIP timing model, checked without the head, clock period in seconds
+	void setXchipClockPeriod(double period);
+	void getXchipClockPeriod(double& period);
+	void checkXchipTiming(unsigned int delay, unsigned int width, unsigned int zeroWidth,
+			unsigned int sampleWidth, unsigned int resetWidth, unsigned int settlingTime, unsigned int xClkHalfPeriod,
+			unsigned int readoutMode, bool& valid, std::string& report, double& max_rate);
+	void getXchipLineRate(double& line_period, double& max_rate);
+	void getFastestXchipTiming(unsigned int width, unsigned int& delay, unsigned int& zeroWidth,
+			unsigned int& sampleWidth, unsigned int& resetWidth, unsigned int& settlingTime, unsigned int& xClkHalfPeriod,
+			unsigned int& readoutMode, double& max_rate);
+
+	// -- zero suppression, frames become SparseCodec packed lines of at most capacity pixels, the lines
+	// with more pixels above threshold are truncated in the frames (counted) but saved whole in HDF5
+	void setSparseEnabled(bool state);
+	void getSparseEnabled(bool& state);
+	void setSparseCapacity(int nb_pixels);
+	void getSparseCapacity(int& nb_pixels);
+	void getSparseOverflow(unsigned long long& nb_lines);
+	void setSparseThreshold(unsigned short threshold);
+	void getSparseThreshold(unsigned short& threshold);
+	void setPixelSparseThreshold(int pixel, unsigned short threshold);
+	void getPixelSparseThreshold(int pixel, unsigned short& threshold);
+
+	// -- raw datagram capture and replay, an empty filename disables
+	void setRawCapture(const std::string& filename, int size_mb);
+	void getRawCapture(std::string& filename);
+	void setReplay(const std::string& filename, bool realtime);
+	void getReplay(std::string& filename);
+
+	// -- chunked HDF5 saving, one file per acquisition (one "%d" is replaced by the acquisition number)
+	void setHdf5Saving(const std::string& filename, int chunk_lines, int compression_level, int nb_threads);
+	void getHdf5Saving(std::string& filename);
+
+	// -- online pulse-height histograms
+	void setHistogramEnabled(bool state);
+	void getHistogramEnabled(bool& state);
+	void setHistogramBinning(int nb_bins, int min_value, int bin_width);
+	void getHistogramBinning(int& nb_bins, int& min_value, int& bin_width);
+	void setHistogramPerChannel(bool state);
+	void getHistogramPerChannel(bool& state);
+	void setHistogramThreads(int nb_threads);
+	void getHistogramThreads(int& nb_threads);
+	void getHistogramSize(int& nb_rows, int& nb_bins);
+	void getHistogramNbLines(long long& nb_lines);
+	void getHistogram(int row, std::vector<unsigned int>& counts);
+	void getHistograms(std::vector<unsigned int>& counts);
+	void resetHistogram();
+
+	// -- extra heads received with the first one into a single line (or one row per head when tiled)
+	void addHead(std::string headname, std::string hostname, int tcpPort, int udpPort);
+	void getNbHeads(int& nb_heads);
+	void setHeadsTiled(bool state);
+	void getHeadsTiled(bool& state);
+	void getUnmatchedFrames(int head, unsigned long long& count);
+	void getHeadOrigin(int head, int& x, int& y);
+	// head the set and read commands go to (-1: sets to every head, reads from the first one),
+	// the channel values are per head in line order when sent to every head
+	void setCommandHead(int head);
+	void getCommandHead(int& head);
+
+	// -- receive each head on several SO_REUSEPORT sockets, one pinned thread each (first_cpu < 0: no pinning)
+	void setReceiveShards(int nb_shards, int first_cpu);
+	void getReceiveShards(int& nb_shards);
+
+	// -- data socket receive buffer, granted is the size read back from the kernel
+	void setReceiveBufferSize(int size);
+	void setReceiveBufferStall(double line_rate, double stall_time);
+	void getReceiveBufferSize(int& requested, int& granted);
+	void getKernelDrops(unsigned long long& drops);
+
+	// -- control connection, commands fail after the timeout and a lost connection is reopened
+	void setCommandTimeout(double timeout);
+	void getCommandTimeout(double& timeout);
+	void setAutoReconnect(bool enabled);
+	void getAutoReconnect(bool& enabled);
+	void getOutages(int& count, double& total_time, double& last_time);
+
+	// -- data path metrics, see Metrics::Counter and Metrics::Stage for the order
+	void getMetricsCounters(std::vector<unsigned long long>& values);
+	void getMetricsLatency(int stage, std::vector<unsigned long long>& counts);
+	void resetMetrics();
+	void setMetricsDump(const std::string& filename, double period);
+	void getMetricsDump(std::string& filename);
+
+	// -- FPGA against host frame accounting, for the last acquisition or since the current one started
+	void getAcqSummary(std::string& summary);
+	void reconcile(std::string& summary);
+	void setAcqSummaryFile(const std::string& filename);
+	void getAcqSummaryFile(std::string& filename);
+
+	// -- batched reads, the getters use the prefetched replies until a value is set (0.5 s at most)
+	void prefetchValues(const std::vector<std::string>& names);
+
+	// -- zero-copy access to the acquired frames, a pinned range is not overwritten until unpinned,
+	// the acquisition waiting for it; chunks are the contiguous runs of the range in the Lima buffers
+	void pinFrames(long long first_frame, int nb_frames, int& pin);
+	void unpinFrames(int pin);
+	void getPinnedChunks(int pin, std::vector<void*>& ptrs, std::vector<int>& sizes);
+
+	// -- ring policy when the slot of the next line is still pinned, or not yet released by Lima with the release
+	// tracking on, e.g. in continuous acquisition (0 frames): wait for the unpin or the release, overwrite the frames
+	// (invalidating the pin) or drop the new line; the window is the frames still in the buffers. The frame numbers
+	// are 64 bit, those handed to Lima wrap on a multiple of the buffers before reaching 2^31.
+	enum RingPolicy { RingBlock, RingOverwriteOldest, RingDropNewest };
+	void setRingPolicy(RingPolicy policy);
+	void getRingPolicy(RingPolicy& policy);
+	void getRingWindow(long long& first_frame, int& nb_frames);
+	void getRingCounters(unsigned long long& overwritten, unsigned long long& dropped);
+	void setReleaseTracking(bool enabled);
+	void getReleaseTracking(bool& enabled);
+	void releaseFrames(int last_frame);
+
+	// -- gated trigger modes (ExtGate, ExtStartStop): each line is tagged with the index of its gate,
+	// modulo 256, read from the frame type field; the tags of the frames in the ring window are kept
+	void getFrameGates(long long first_frame, int nb_frames, std::vector<int>& gates);
+	void getNbGates(unsigned long long& nb_gates);
+
+	// -- line types, the low byte of the frame type field (unknown types are handled as data): the lines of a
+	// type not kept are counted and saved, but take no buffer; the last non data line of each type is kept aside
+	enum LineType { DataLine, CalibrationLine, PedestalLine, MarkerLine };
+	static const int nbLineTypes = 4;
+	void setLineTypeKept(LineType type, bool kept);
+	void getLineTypeKept(LineType type, bool& kept);
+	void getLineTypeCounts(std::vector<unsigned long long>& counts);
+	void getLastLine(LineType type, std::vector<unsigned short>& line);
+
+	// -- in-stream calibration: the calibration and pedestal lines update running per pixel gain and offset
+	// estimates over the last nb_lines lines of their type (0 for all), the correction stage then maps the
+	// data lines to (raw - offset) / gain
+	void setCalibCorrection(bool enabled);
+	void getCalibCorrection(bool& enabled);
+	void setCalibWindow(int nb_lines);
+	void getCalibWindow(int& nb_lines);
+	void setCalibReference(double amplitude);
+	void getCalibReference(double& amplitude);
+	void resetCalibEstimates();
+	void getCalibEstimates(std::vector<double>& gains, std::vector<double>& offsets, std::vector<double>& noise);
+	void getCalibLines(unsigned long long& calibration, unsigned long long& pedestal);
+
+	// -- scan table, each point sets its settings (e.g. "headvref 1.2", "fpgaaux1 10 20") then takes nb_lines lines
+	void clearScanTable();
+	void addScanPoint(int nb_lines, const std::vector<std::string>& settings);
+	void getNbScanPoints(int& nb_points);
+	void getScanFirstFrames(std::vector<int>& first_frames);
+	void setScanSettleLines(int nb_lines);
+	void getScanSettleLines(int& nb_lines);
+	void getScanStatus(int& point, unsigned long long& dropped_lines);
+
+	// -- events pushed to one registered callback: the telemetry monitors are read every period (s) and
+	// pushed past their deadband or after the heartbeat, data ready every nb_frames lines (0 disables)
+	void registerEventCallback(EventCallback& cb);
+	void unregisterEventCallback(EventCallback& cb);
+	void setTelemetryEvents(const std::vector<std::string>& names, const std::vector<double>& deadbands,
+			double period, double heartbeat);
+	void getTelemetryEvents(std::vector<std::string>& names, std::vector<double>& deadbands,
+			double& period, double& heartbeat);
+	void setDataReadyFrames(int nb_frames);
+	void getDataReadyFrames(int& nb_frames);
+	void getEventCounts(unsigned long long& telemetry, unsigned long long& data_ready, unsigned long long& errors);
+
 private:
 	// ultra specific
 	UltraNet *m_ultra;
@@ -199,23 +392,172 @@ private:
 	double m_exp_time;
 	ImageType m_image_type;
 	int m_nb_frames; // nos of frames to acquire
-	bool m_thread_running;
-	bool m_wait_flag;
+	std::atomic<AcqState> m_state;	// changed under m_cond.mutex(), read without it
 	bool m_quit;
-	int m_acq_frame_nb; // nos of frames acquired
+	std::atomic<long long> m_acq_frame_nb; // nos of frames acquired
+	int m_lima_wrap;				// Lima frame numbers wrap there, a multiple of the buffers
+	int limaFrame(long long frame_nb) const { return int(frame_nb % m_lima_wrap); }
 	mutable Cond m_cond;
 
 
 	// Buffer control object
-	SoftBufferCtrlObj m_bufferCtrlObj;
-
-	void readFrame(void *bptr, int frame_nb);
+	BufferCtrlObj m_bufferCtrlObj;
+	int m_buffer_numa_node;		// requested, -1 for the receive cpu or NIC one
+	int m_receive_first_cpu;
+	void updateBufferNumaNode();
+
+	// zero suppression
+	SparseCodec m_sparse;
+	bool m_sparse_enabled;
+	vector<unsigned short> m_line_buffer;
+	vector<unsigned short> m_sparse_pairs;		// pairs of the last line, not truncated
+	int m_sparse_count;
+	std::atomic<unsigned long long> m_sparse_overflow;
+
+	// raw capture and replay
+	RawCapture m_raw_capture;
+	RawReplay m_replay;
+
+	// HDF5 saving
+	Hdf5Writer* m_hdf5_writer;
+	string m_hdf5_filename;
+	int m_hdf5_chunk_lines;
+	int m_hdf5_level;
+	int m_hdf5_threads;
+	int m_hdf5_file_nb;
+
+	// histograms
+	Histogram m_histogram;
+	bool m_histogram_enabled;
+
+	// data path metrics
+	Metrics m_metrics;
+
+	// frame accounting, snapshot taken at startAcq()
+	struct Snapshot {
+		bool fpga_valid;
+		unsigned int fpga_frames;
+		unsigned int fpga_errors;
+		unsigned long long received;
+		unsigned long long kernel_drops;
+		unsigned long long gaps;
+		unsigned long long frames_ready;
+		unsigned long long lines;
+		unsigned long long discarded;
+		unsigned long long filtered;
+		double time;
+	};
+	Snapshot m_acq_start;
+	int m_acq_nb;
+	string m_acq_summary;
+	string m_acq_summary_file;
+
+	// extra heads
+	vector<UltraNet*> m_heads;
+	MultiHead m_multi;
+	bool m_heads_tiled;
+	int m_cmd_head;
+	UltraNet* getHead(int head);
+
+	// prefetched replies
+	Mutex m_prefetch_lock;
+	std::map<string, string> m_prefetch;
+	long long m_prefetch_time;
+	void clearPrefetch();
+	void readReply(const char* command, std::string& reply);
+
+	// pinned frames
+	struct PinnedRange {
+		long long first_frame;
+		int nb_frames;
+		bool overwritten;
+	};
+	enum SlotWait { SlotFree, SlotBusy, SlotStopped };
+	std::map<int, PinnedRange> m_pins;
+	std::atomic<int> m_nb_pins;
+	int m_next_pin;
+	SlotWait waitPinnedBuffer(long long frame_nb, int nb_slots);
+
+	// ring policy
+	RingPolicy m_ring_policy;
+	std::atomic<unsigned long long> m_ring_overwritten;
+	std::atomic<unsigned long long> m_ring_dropped;
+	bool m_release_tracking;
+	long long m_released_frame;					// last frame released by Lima
+	vector<unsigned short> m_scratch_line;		// lines read and dropped
+	void checkNoPins();
+
+	// gated trigger modes
+	int m_line_type;							// frame type field of the last line read
+	vector<unsigned char> m_frame_gates;		// gate index of each slot
+	Mutex m_gate_lock;
+	int m_last_gate;
+	std::atomic<unsigned long long> m_nb_gates;
+	bool m_sync_forced;							// sync enabled by a gated mode
+	bool m_sync_enabled;						// setSyncEnabled() state while forced
+	void applyTrigMode();
+	void tagGate(long long frame_nb, int nb_slots);
+
+	// line types
+	bool m_line_kept[nbLineTypes];
+	std::atomic<unsigned long long> m_line_counts[nbLineTypes + 1];	// the last one for the unknown types
+	vector<unsigned short> m_last_lines[nbLineTypes];
+	Mutex m_line_lock;
+	LineType lineType() const;
+	void routeLine(const unsigned short* line);
+
+	// in-stream calibration
+	Calibration m_calibration;
+	bool m_calib_correction;
+
+	// scan table
+	enum ScanState { ScanApplied, ScanSetting, ScanSettling, ScanFailed };
+	struct ScanPoint {
+		int nb_lines;
+		vector<string> settings;
+		vector<string> commands;		// encoded by prepareAcq()
+	};
+	vector<ScanPoint> m_scan_table;
+	int m_scan_settle_lines;
+	bool m_scan_active;
+	ScanState m_scan_state;
+	int m_scan_point;
+	long long m_scan_next_frame;
+	int m_scan_settle_left;
+	unsigned long long m_scan_dropped;
+	vector<std::future<string> > m_scan_replies;
+	void encodeScanTable();
+	void startScan();
+	void startScanTransition();
+	bool updateScan();
+
+	// events
+	EventPublisher m_events;
+
+	// xchip timing
+	double m_xchip_clock_period;
+	void getXchipTiming(XchipTiming& timing);
+	XchipTimingModel getXchipModel();
+
+	bool readFrame(void *bptr, long long frame_nb);
+	void updateMetrics(long long t0, long long t1, long long t2, long long t3);
+	void takeSnapshot(Snapshot& snap);
+	void readFpgaCounters(Snapshot& snap);
+	void formatSummary(int acq_nb, const Snapshot& start, const Snapshot& end, std::string& summary);
+	void endAcqSummary(int acq_nb, const Snapshot& start, Snapshot& end);
 	void getHeadType(unsigned int& headType);
-	void getValue(string cmd, unsigned int& value);
-	void getValue(string cmd, float& value);
-	void getValue(string cmd, unsigned int& value1, unsigned int& value2);
-	void setValue(string cmd);
+	void getValue(CommandCodec::Id id, unsigned int& value);
+	void getValue(CommandCodec::Id id, float& value, int board = 0, int channel = 0);
+	void getValue(CommandCodec::Id id, unsigned int& value1, unsigned int& value2);
+	void setValue(CommandCodec::Id id, unsigned int value);
+	void setValue(CommandCodec::Id id, float value, int board = 0, int channel = 0);
+	void setValue(CommandCodec::Id id, unsigned int value1, unsigned int value2);
+	void setValue(CommandCodec::Id id);
+	void sendSet(CommandCodec::Id id, const char* command, int length);
+	void getChannelValues(CommandCodec::Id id, vector<float>& values);
+	void setChannelValues(CommandCodec::Id id, const vector<float>& values);
 	void adcChanLookup(int headType, int channel, int &adcBoard, int &adcChannel);
+	int getChannelPixel(int channel);
 };
 
 } // namespace Ultra
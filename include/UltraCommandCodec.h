@@ -0,0 +1,89 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraCommandCodec.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRACOMMANDCODEC_H_
+#define ULTRACOMMANDCODEC_H_
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class CommandCodec
+ * \brief formatting and parsing of the head control commands
+ *
+ * Every command the camera sends is described once in a table: its
+ * name, the format of its value and whether it can be set. The
+ * commands are formatted into a caller buffer of maxLength chars and
+ * the replies parsed in place, without streams or allocations. The
+ * ADC commands are indexed by board and channel, e.g. adc1off3.
+ * The format functions return the length, or -1 when the value does
+ * not match the command. formatSetting() takes a setting as text,
+ * e.g. "headvref 1.2", "fpgaaux1 10 20" or "adc1off3 0.1".
+ *******************************************************************/
+class CommandCodec {
+public:
+	enum Id {
+		ColdTemp, HotTemp, TecTemp, TecSupply, AdcPosSupply, AdcNegSupply, VinPosSupply, VinNegSupply,
+		HeadAdcVdd, HeadVdd, HeadVref, HeadVrefc, HeadVpupref, HeadVclamp, HeadVres1, HeadVres2, HeadVTrip,
+		FpgaXchip, FpgaPwr, FpgaSync, FpgaAdc, FpgaFrame, FpgaError,
+		FpgaAux1, FpgaAux2, FpgaRst, FpgaS1, FpgaS2, FpgaXclk, FpgaShift,
+		AdcOffset, AdcGain, HeadType, State,
+		NbCommands
+	};
+	enum Format {
+		NoValue,		// set only
+		Volts,			// float, set with a V suffix, read as <value
+		Hex,			// one hexadecimal register
+		Pair			// two decimal values, delay and width
+	};
+	struct Descriptor {
+		const char* name;
+		const char* suffix;		// indexed commands: name<board>suffix<channel>
+		Format format;
+		bool writable;
+	};
+
+	static const int maxLength = 64;
+
+	static const Descriptor& describe(Id id);
+
+	static int formatRead(char* buf, Id id, int board = 0, int channel = 0);
+	static int formatSet(char* buf, Id id);
+	static int formatSetVolts(char* buf, Id id, float value, int board = 0, int channel = 0);
+	static int formatSetHex(char* buf, Id id, unsigned int value);
+	static int formatSetPair(char* buf, Id id, unsigned int value1, unsigned int value2);
+	static int formatSetting(char* buf, const char* setting);
+	static bool lookup(const char* name, Id& id, int& board, int& channel);
+
+	static bool parseVolts(const char* reply, float& value);
+	static bool parseHex(const char* reply, unsigned int& value);
+	static bool parsePair(const char* reply, unsigned int& value1, unsigned int& value2);
+	static bool isAck(const char* reply);
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRACOMMANDCODEC_H_ */
@@ -0,0 +1,139 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraEvents.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRAEVENTS_H_
+#define ULTRAEVENTS_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima {
+namespace Ultra {
+
+class UltraNet;
+
+/*******************************************************************
+ * \class EventCallback
+ * \brief receives the events pushed by the camera
+ *
+ * Called from the camera threads, not the one that registered the
+ * callback: keep the methods short and do not call back into the
+ * camera acquisition control from them.
+ *******************************************************************/
+class EventCallback {
+public:
+	EventCallback() {}
+	virtual ~EventCallback() {}
+
+	// a telemetry monitor (e.g. "coldtemp") moved past its deadband or was not sent for a heartbeat
+	virtual void telemetryChanged(const std::string& /*name*/, double /*value*/) {}
+	// nb_frames lines acquired so far, every data ready period and at the end of the acquisition
+	virtual void dataReady(long long /*nb_frames*/) {}
+	// the acquisition stopped on an error and the camera is now in Fault
+	virtual void acqFailed(const std::string& /*message*/) {}
+};
+
+/*******************************************************************
+ * \class EventPublisher
+ * \brief telemetry and data ready events for one registered callback
+ *
+ * The telemetry monitors are read from the head in one batched
+ * exchange every period, whoever listens, and an event is pushed
+ * when a value moved by at least its deadband since the last one
+ * pushed, or when the heartbeat elapsed. Data ready events are
+ * pushed by the acquisition thread every nb_frames lines, and a failure
+ * event when it stops on an error.
+ *******************************************************************/
+class EventPublisher {
+DEB_CLASS_NAMESPC(DebModCamera, "EventPublisher", "Ultra");
+
+public:
+	EventPublisher();
+	~EventPublisher();
+
+	void registerCallback(EventCallback& cb);
+	void unregisterCallback(EventCallback& cb);
+
+	// period and heartbeat in seconds, an empty names list or a null period stops the telemetry
+	void setTelemetry(UltraNet* net, const std::vector<std::string>& names,
+			const std::vector<double>& deadbands, double period, double heartbeat);
+	void getTelemetry(std::vector<std::string>& names, std::vector<double>& deadbands,
+			double& period, double& heartbeat) const;
+	void stopTelemetry();
+
+	void setDataReadyPeriod(int nb_frames);
+	int getDataReadyPeriod() const { return m_data_period; }
+	void frameReady(long long nb_frames) {
+		int period = m_data_period.load(std::memory_order_relaxed);
+		if (period && nb_frames % period == 0)
+			pushDataReady(nb_frames);
+	}
+	void endAcq(long long nb_frames);
+	void acqFailed(const std::string& message);
+
+	void getCounts(unsigned long long& telemetry, unsigned long long& data_ready,
+			unsigned long long& errors) const;
+
+private:
+	class TelemetryThread;
+	friend class TelemetryThread;
+
+	struct Monitor {
+		std::string name;
+		std::string command;
+		bool hex;
+		double deadband;
+		bool sent;
+		double value;
+		long long time;
+	};
+
+	void sample();
+	void pushDataReady(long long nb_frames);
+
+	Mutex m_cb_lock;
+	EventCallback* m_cb;
+
+	UltraNet* m_net;
+	std::vector<Monitor> m_monitors;
+	double m_period;
+	double m_heartbeat;
+	TelemetryThread* m_thread;
+	mutable Cond m_cond;
+	bool m_quit;
+
+	std::atomic<int> m_data_period;
+	std::atomic<unsigned long long> m_telemetry_events;
+	std::atomic<unsigned long long> m_data_events;
+	std::atomic<unsigned long long> m_errors;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRAEVENTS_H_ */
@@ -0,0 +1,132 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraHdf5Writer.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRAHDF5WRITER_H_
+#define ULTRAHDF5WRITER_H_
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <hdf5.h>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class Hdf5Writer
+ * \brief appends Ultra lines to a chunked HDF5 file
+ *
+ * Lines are gathered into chunks of chunk_lines lines of the 2D
+ * "data" dataset. When a compression level is given the chunks are
+ * shuffled and deflated by a pool of worker threads and stored with
+ * H5Dwrite_chunk(), so the file is readable with the standard HDF5
+ * shuffle and deflate filters. The frame number, frame type and
+ * timestamp of each line go into the "frame_number", "frame_type" and
+ * "timestamp" datasets.
+ *
+ * Opened sparse, the zero suppressed lines are stored with a variable
+ * length instead: their SparseCodec pairs are appended to the 2 column
+ * "sparse_pairs" dataset and the number of pairs of each line goes into
+ * "sparse_count". A chunk is then flushed when it could not hold one
+ * more full line, and HDF5 deflates the pairs in the writing thread.
+ *******************************************************************/
+class Hdf5Writer {
+DEB_CLASS_NAMESPC(DebModCamera, "Hdf5Writer", "Ultra");
+
+public:
+	Hdf5Writer();
+	~Hdf5Writer();
+
+	void open(const std::string& filename, int npixels, int chunk_lines, int compression_level, int nb_threads,
+			bool sparse = false);
+	void close();
+	bool isOpen() const;
+
+	void addLine(const void* line, int frame_nb, int frame_type, double timestamp);
+	void addSparseLine(const unsigned short* pairs, int count, int frame_nb, int frame_type, double timestamp);
+	void getNbLines(long long& nb_lines) const;
+
+private:
+	struct Chunk {
+		long long seq;
+		long long first_line;
+		long long first_pair;
+		int nb_lines;
+		size_t used;						// words of data, sparse
+		std::vector<unsigned short> data;
+		std::vector<unsigned short> count;	// pairs of each line, sparse
+		std::vector<int> frame_nb;
+		std::vector<unsigned char> frame_type;
+		std::vector<double> timestamp;
+		std::vector<unsigned char> shuffled;
+		std::vector<unsigned char> compressed;
+		size_t size;
+	};
+	class WorkerThread;
+	friend class WorkerThread;
+
+	void getChunk();
+	void queueChunk(Chunk* chunk);
+	void compressChunk(Chunk* chunk);
+	void writeChunks(AutoMutex& aLock);
+	void writeChunk(Chunk* chunk);
+	void writePairs(Chunk* chunk);
+	void checkError();
+
+	mutable Cond m_cond;
+	std::vector<WorkerThread*> m_workers;
+	std::vector<Chunk*> m_chunks;
+	std::list<Chunk*> m_free;
+	std::list<Chunk*> m_todo;
+	std::map<long long, Chunk*> m_done;
+	Chunk* m_current;
+	long long m_next_seq;
+	long long m_write_seq;
+	long long m_nb_lines;
+	long long m_queued_lines;
+	long long m_queued_pairs;
+	bool m_writing;
+	bool m_quit;
+	std::string m_error;
+
+	int m_npixels;
+	int m_chunk_lines;
+	int m_level;
+	bool m_sparse;
+	hid_t m_file;
+	hid_t m_data;
+	hid_t m_frame_nb;
+	hid_t m_frame_type;
+	hid_t m_timestamp;
+	hid_t m_count;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRAHDF5WRITER_H_ */
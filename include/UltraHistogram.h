@@ -0,0 +1,120 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraHistogram.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRAHISTOGRAM_H_
+#define ULTRAHISTOGRAM_H_
+
+#include <vector>
+#include <list>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class Histogram
+ * \brief fixed-bin pulse-height histograms built from the lines
+ *
+ * One histogram row per pixel, or per ADC channel, stored contiguously
+ * as counts[row * nb_bins + bin]. The pixel block of each channel row is
+ * given by setChannelPixels(), by default the blocks in line order. The bin width is a power of two so a
+ * value is binned with a subtract and a shift. With nb_threads > 0 the
+ * lines are queued in batches and each thread updates its own slice of
+ * pixels, without any locking on the counts. The counts are allocated
+ * when the binning changes, never while adding lines, and getRow() and
+ * getAll() wait for the updates in progress before copying them.
+ *******************************************************************/
+class Histogram {
+DEB_CLASS_NAMESPC(DebModCamera, "Histogram", "Ultra");
+
+public:
+	Histogram(int npixels, int nb_channels);
+	~Histogram();
+
+	void setBinning(int nb_bins, int min_value, int bin_width);
+	void getBinning(int& nb_bins, int& min_value, int& bin_width) const;
+	void setPerChannel(bool state);
+	void getPerChannel(bool& state) const;
+	void setChannelPixels(const std::vector<int>& first_pixels);
+	void setNbThreads(int nb_threads);
+	void getNbThreads(int& nb_threads) const;
+
+	void addLine(const unsigned short* line);
+	void flush();
+	void reset();
+
+	int getNbRows() const;
+	void getRow(int row, std::vector<unsigned int>& counts);
+	void getAll(std::vector<unsigned int>& counts);
+	void getNbLines(long long& nb_lines);
+
+private:
+	struct Batch {
+		long long seq;
+		std::vector<unsigned short> lines;
+		int nb_lines;
+		int pending;
+	};
+	class ShardThread;
+	friend class ShardThread;
+
+	void allocate();
+	void startThreads();
+	void stopThreads();
+	int getShardPixel(int shard) const;
+	void update(const unsigned short* lines, int nb_lines, int first_pixel, int last_pixel);
+	void queueBatch();
+	void beginUpdate();
+	void endUpdate();
+
+	int m_npixels;
+	int m_nb_channels;
+	int m_nb_bins;
+	int m_min_value;
+	int m_shift;
+	bool m_per_channel;
+	std::vector<int> m_channel_pixels;	// first pixel of each channel
+	std::vector<int> m_row;
+	std::vector<unsigned int> m_counts;
+	long long m_nb_lines;
+
+	mutable Cond m_cond;
+	int m_nb_threads;
+	std::vector<ShardThread*> m_threads;
+	std::vector<Batch*> m_batches;
+	std::list<Batch*> m_free;
+	std::list<Batch*> m_todo;
+	Batch* m_current;
+	long long m_next_seq;
+	bool m_quit;
+	int m_updating;
+	int m_reading;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRAHISTOGRAM_H_ */
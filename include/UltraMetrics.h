@@ -0,0 +1,112 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraMetrics.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRAMETRICS_H_
+#define ULTRAMETRICS_H_
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class Metrics
+ * \brief data path counters and latency histograms
+ *
+ * Counters, gauges and log2 latency histograms (bucket i counts the
+ * durations in [2^i, 2^(i+1)) ns) are plain atomics, updated and read
+ * without any lock. An optional thread appends a summary line to a
+ * file every period.
+ *******************************************************************/
+class Metrics {
+DEB_CLASS_NAMESPC(DebModCamera, "Metrics", "Ultra");
+
+public:
+	enum Counter {
+		PacketsReceived, BytesReceived, SequenceGaps, KernelDrops, RingOccupancy, FramesReady,
+		LinesRead,			// lines assembled from the heads
+		LinesDiscarded,		// read on purpose without a frame: scan settling, ring drop newest
+		LinesFiltered,		// of a type not kept, see Camera::setLineTypeKept()
+		NbCounters
+	};
+	enum Stage {
+		Receive,			// readFrame(): waiting for and copying the line
+		Process,			// saving the line outside Lima
+		FrameReady,			// newFrameReady()
+		CommandRtt,			// control command round trip
+		NbStages
+	};
+	static const int nbBuckets = 32;
+
+	Metrics();
+	~Metrics();
+
+	void add(Counter counter, unsigned long long value = 1) {
+		m_counters[counter].fetch_add(value, std::memory_order_relaxed);
+	}
+	void set(Counter counter, unsigned long long value) {
+		m_counters[counter].store(value, std::memory_order_relaxed);
+	}
+	unsigned long long get(Counter counter) const {
+		return m_counters[counter].load(std::memory_order_relaxed);
+	}
+	void addLatency(Stage stage, long long ns);
+	void getLatency(Stage stage, std::vector<unsigned long long>& counts) const;
+	long long getPercentile(Stage stage, double fraction) const;
+	void reset();
+
+	static long long now();
+	static const char* getCounterName(int counter);
+	static const char* getStageName(int stage);
+
+	void startDump(const std::string& filename, double period);
+	void stopDump();
+	void getDump(std::string& filename) const;
+
+private:
+	class DumpThread;
+	friend class DumpThread;
+
+	void dump(FILE* fp);
+
+	std::atomic<unsigned long long> m_counters[NbCounters];
+	std::atomic<unsigned long long> m_latency[NbStages][nbBuckets];
+
+	DumpThread* m_dump_thread;
+	std::string m_dump_filename;
+	double m_dump_period;
+	mutable Cond m_cond;
+	bool m_quit;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRAMETRICS_H_ */
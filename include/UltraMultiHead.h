@@ -0,0 +1,98 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraMultiHead.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRAMULTIHEAD_H_
+#define ULTRAMULTIHEAD_H_
+
+#include <string>
+#include <vector>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+#include "UltraNet.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class MultiHead
+ * \brief receives several heads and aligns their lines
+ *
+ * Each head is received by its own thread into a ring of lines tagged
+ * with the hardware frame number. getLine() waits for every head to
+ * have the same frame number at the front of its ring, dropping the
+ * older lines of the heads that are ahead (counted as unmatched), and
+ * copies the head lines one after the other into the caller buffer.
+ * The frame type returned is the one of the first head. A receive
+ * error stops the head and is thrown by the next getLine().
+ *******************************************************************/
+class MultiHead {
+DEB_CLASS_NAMESPC(DebModCamera, "MultiHead", "Ultra");
+
+public:
+	MultiHead(int npixels);
+	~MultiHead();
+
+	void addHead(UltraNet* net);
+	int getNbHeads() const;
+
+	void start();
+	void stop();
+	bool waitLine(int timeout_ms);
+	bool getLine(unsigned short* bptr, int& frame_type);
+
+	int getPending();
+	void getUnmatched(int head, unsigned long long& count);
+	void resetCounters();
+
+private:
+	struct Ring {
+		UltraNet* net;
+		std::vector<unsigned short> lines;
+		std::vector<int> frame_nb;
+		std::vector<int> frame_type;
+		int first;
+		int count;
+		bool ended;
+		bool failed;				// the receive thread stopped on error
+		std::string error;
+		unsigned long long unmatched;
+	};
+	class RecvThread;
+	friend class RecvThread;
+
+	bool isLineReady() const;
+
+	int m_npixels;
+	std::vector<Ring> m_rings;
+	std::vector<RecvThread*> m_threads;
+	Mutex m_thread_lock;				// start() and stop() from different threads
+	mutable Cond m_cond;
+	bool m_quit;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRAMULTIHEAD_H_ */
@@ -29,7 +29,15 @@
 #define ULTRANET_CPP_
 
 #include <netinet/in.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <future>
 #include "lima/Debug.h"
+#include "UltraRawCapture.h"
+#include "UltraShardedReceiver.h"
+#include "UltraMetrics.h"
 
 using namespace std;
 
@@ -38,6 +46,11 @@ namespace Ultra {
 
 const int RD_BUFF = 1000;	// Read buffer for more efficient recv
 
+// frame type field of the datagram header: the line type in the low byte and,
+// in the gated trigger modes, the gate index (modulo 256) in the high byte
+#define FRAMETYPEMASK 0x00ff
+#define FRAMEGATESHIFT 8
+
 class UltraNet {
 DEB_CLASS_NAMESPC(DebModCamera, "UltraNet", "Ultra");
 
@@ -46,22 +59,94 @@ public:
 	~UltraNet();
 
 
+	std::future<string> sendAsync(const string& cmd);
 	void sendWait(string cmd, string& value);
+	void sendWaitBatch(const vector<string>& cmds, vector<string>& values);
+	void setCommandTimeout(double timeout);
+	void setReconnect(bool enabled, double backoff_min, double backoff_max);
+	double getCommandTimeout() const;
+	bool getReconnect() const;
+	void getOutages(int& count, double& total, double& last) const;
 
 	void connectToServer (const string hostname, int port);
 	void disconnectFromServer();
 	void initServerDataPort(const string hostname, int udpPort);
-	void getData(void* bptr, int num);
+	bool getData(void* bptr, int num);
+	int tryGetData(void* bptr, int num);
+	int recvFrame(void* bptr, int num, int& frameNo, int& frameType, bool wait = true);
+	int getFrameType() const;
+	bool waitData(int timeout_ms);
+	void resetFrameSequence();
+	void flushData();
+
+	void setRawCapture(RawCapture* capture);
+	void setReplay(RawReplay* replay);
+	void setMetrics(Metrics* metrics);
+	int getPending();
+	void setReceiveShards(int nb_shards, int first_cpu, int datagram_size);
+	int getReceiveShards() const;
+	void setRcvBuf(int size);
+	void getRcvBuf(int& requested, int& granted) const;
+	unsigned long long getKernelDrops() const;
 
 private:
+	struct Command {
+		string text;
+		std::promise<string> reply;
+		long long submitted;
+		long long deadline;
+	};
+	class IoThread;
+	friend class IoThread;
+
 	mutable Cond m_cond;
 	bool m_valid;						// true if connected
 	int m_skt;							// socket for commands */
 	struct sockaddr_in m_remote_addr;	// address of remote server */
 	int m_data_port;					// our data port
+	string m_data_host;					// our data address
 	int m_data_listen_skt;				// data socket we listen on
+	ShardedReceiver m_shards;			// replaces m_data_listen_skt when open
+	int m_rcvbuf_size;					// requested receive buffer
+	int m_rcvbuf_granted;				// as read back from the kernel
+	unsigned int m_kernel_drops;		// SO_RXQ_OVFL counter of m_data_listen_skt
 	bool firstFrame;
 	int lastFrameNo;
+	int m_frame_type;					// frame type field of the last line
+	RawCapture* m_capture;				// optional copy of every datagram
+	RawReplay* m_replay;				// optional source replacing the socket
+	Metrics* m_metrics;					// optional data path metrics
+
+	// command engine
+	IoThread* m_io_thread;
+	std::deque<Command*> m_queue;		// submitted, not written yet
+	std::deque<Command*> m_inflight;	// written, waiting for their reply
+	int m_wake[2];						// pipe waking up the I/O thread
+	bool m_io_quit;
+	string m_ctrl_host;
+	int m_ctrl_port;
+	double m_cmd_timeout;				// seconds
+	bool m_reconnect;
+	double m_backoff_min;
+	double m_backoff_max;
+	std::vector<string> m_config;		// last acknowledged set commands
+	std::map<string, size_t> m_config_index;
+	int m_outage_count;
+	double m_outage_total;
+	double m_outage_last;
+	long long m_outage_start;
+
+	void checkRcvBuf();
+	int receiveLine(void* bptr, int numBytes, bool wait);
+	void openControl();
+	void writeControl(const string& data);
+	void wakeIoThread();
+	Command* newCommand(const string& cmd, long long now);
+	void failCommands(const string& msg);
+	void expireCommands(long long now);
+	void startOutage(const string& reason);
+	void endOutage();
+	void cacheCommand(const string& cmd);
 };
 
 } // namespace Ultra
@@ -0,0 +1,128 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraRawCapture.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRARAWCAPTURE_H_
+#define ULTRARAWCAPTURE_H_
+
+#include <string>
+#include <stdint.h>
+#include "lima/Debug.h"
+
+namespace lima {
+namespace Ultra {
+
+/*
+ * Layout of a raw capture file. The file is preallocated and used as a
+ * ring: the header is followed by records, each one a RawRecordHeader
+ * and the datagram (frame header included) padded to 8 bytes. When the
+ * end of the file is reached writing restarts after the file header and
+ * the oldest records are dropped.
+ */
+struct RawFileHeader {
+	char magic[8];				// "ULTRARAW"
+	uint32_t version;
+	uint32_t headerSize;		// offset of the first record
+	uint64_t fileSize;
+	uint64_t head;				// offset where the next record is written
+	uint64_t tail;				// offset of the oldest record
+	uint64_t nbRecords;			// records written since creation
+	uint64_t nbDropped;			// records overwritten by the ring
+};
+
+struct RawRecordHeader {
+	uint32_t length;			// datagram length, rawWrapMarker at the ring end
+	uint32_t reserved;
+	uint64_t timestamp;			// monotonic ns
+};
+
+const uint32_t rawWrapMarker = 0xffffffff;
+
+/*******************************************************************
+ * \class RawCapture
+ * \brief appends every received datagram to a memory-mapped ring file
+ *******************************************************************/
+class RawCapture {
+DEB_CLASS_NAMESPC(DebModCamera, "RawCapture", "Ultra");
+
+public:
+	RawCapture();
+	~RawCapture();
+
+	void open(const std::string& filename, long long size);
+	void close();
+	bool isOpen() const;
+	void getFilename(std::string& filename) const;
+
+	void append(const void* datagram, int len);
+	void getNbRecords(long long& nb_records) const;
+	void getNbDropped(long long& nb_dropped) const;
+
+private:
+	void dropOldest(uint64_t end);
+	void flush(bool sync);
+
+	std::string m_filename;
+	int m_fd;
+	char* m_map;
+	RawFileHeader* m_header;
+	uint64_t m_flushed;			// start of the region not yet handed to writeback
+};
+
+/*******************************************************************
+ * \class RawReplay
+ * \brief reads back a raw capture file as a source of datagrams
+ *******************************************************************/
+class RawReplay {
+DEB_CLASS_NAMESPC(DebModCamera, "RawReplay", "Ultra");
+
+public:
+	RawReplay();
+	~RawReplay();
+
+	void open(const std::string& filename, bool realtime);
+	void close();
+	bool isOpen() const;
+	void getFilename(std::string& filename) const;
+	void rewind();
+
+	int next(void* buffer, int len);
+
+private:
+	std::string m_filename;
+	bool m_realtime;
+	int m_fd;
+	char* m_map;
+	uint64_t m_size;
+	const RawFileHeader* m_header;
+	uint64_t m_offset;
+	bool m_wrapped;
+	uint64_t m_first_timestamp;
+	uint64_t m_start_time;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRARAWCAPTURE_H_ */
@@ -0,0 +1,101 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraShardedReceiver.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRASHARDEDRECEIVER_H_
+#define ULTRASHARDEDRECEIVER_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class ShardedReceiver
+ * \brief several SO_REUSEPORT sockets on the data port, one thread each
+ *
+ * The threads store the datagrams in a slot array indexed by the header
+ * frame number, next() hands them back in frame order. A slot is claimed,
+ * filled and published through its own state flag, without any lock, and
+ * the reader is only woken up when it waits for the frame just stored or
+ * for a frame to give up. A frame still missing when a frame reorderWindow
+ * ahead has arrived is skipped, the caller counts it as a sequence gap and
+ * goes on. The kernel spreads the datagrams over the sockets
+ * by hashing the source address and port, so a single head sending from a
+ * single port lands on one socket: the sharding pays off with several
+ * heads or senders on the same port.
+ *******************************************************************/
+class ShardedReceiver {
+DEB_CLASS_NAMESPC(DebModCamera, "ShardedReceiver", "Ultra");
+
+public:
+	ShardedReceiver();
+	~ShardedReceiver();
+
+	void open(const std::string& hostname, int port, int nb_shards, int first_cpu, int datagram_size);
+	void close();
+	int getNbShards() const;
+	int setRcvBuf(int size);
+	unsigned long long getKernelDrops() const;
+	int getPending() const;
+
+	int next(void* buffer, int size);
+	bool waitNext(int timeout_ms);
+	void reset();
+
+private:
+	class RecvThread;
+	friend class RecvThread;
+
+	enum SlotState { SlotFree, SlotWriting, SlotReady };
+
+	void store(const unsigned char* datagram, int len, int shard, unsigned int drops);
+	void sync(int frame_nb);
+	bool isNextReady();
+
+	std::vector<int> m_skts;
+	std::vector<std::atomic<unsigned int> > m_drops;	// SO_RXQ_OVFL counter of each socket
+	std::vector<RecvThread*> m_threads;
+	int m_datagram_size;
+	std::vector<unsigned char> m_slots;
+	std::vector<std::atomic<int> > m_slot_state;
+	std::vector<std::atomic<int> > m_slot_frame;
+	std::vector<int> m_slot_len;
+	std::atomic<bool> m_synced;
+	std::atomic<bool> m_consumed;
+	std::atomic<int> m_next;				// written by the reader only, once synced
+	std::atomic<int> m_highest;
+	std::atomic<bool> m_waiting;			// the reader waits on m_cond
+	mutable Cond m_cond;
+	std::atomic<bool> m_quit;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRASHARDEDRECEIVER_H_ */
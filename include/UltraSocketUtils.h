@@ -0,0 +1,51 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraSocketUtils.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRASOCKETUTILS_H_
+#define ULTRASOCKETUTILS_H_
+
+namespace lima {
+namespace Ultra {
+
+// Set the receive buffer, with SO_RCVBUFFORCE when allowed so that
+// net.core.rmem_max does not apply. Returns the size the kernel granted
+// as read back by getsockopt (the kernel reports twice the usable size).
+int setSocketRcvBuf(int skt, int size);
+
+// Ask the kernel for the socket drop counter with every datagram
+void enableSocketDropCounter(int skt);
+
+// recv() returning the socket drop counter (SO_RXQ_OVFL) in drops when the
+// kernel attached it, drops is left unchanged otherwise
+int recvCounted(int skt, void* buffer, int size, int flags, unsigned int& drops);
+
+// NUMA node of the network interface holding the IPv4 address, from
+// /sys/class/net/<interface>/device/numa_node, -1 when unknown
+int getInterfaceNumaNode(const char* address);
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRASOCKETUTILS_H_ */
@@ -0,0 +1,81 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraSparse.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRASPARSE_H_
+#define ULTRASPARSE_H_
+
+#include <vector>
+#include "lima/Debug.h"
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \class SparseCodec
+ * \brief zero-suppression of Ultra lines
+ *
+ * encode() lists the pixels strictly above their threshold as pairs of
+ * [pixel index][pixel value], as many as there are. pack() copies them
+ * into a fixed size frame of getPackedSize(capacity) 16 bit words:
+ * [count][overflow] followed by count pairs and a zero filled tail, the
+ * pairs past the capacity being dropped and counted in overflow. The
+ * capacity bounds the Lima frames well below a full line, the HDF5
+ * saving keeps every pair with a variable length per line.
+ *******************************************************************/
+class SparseCodec {
+DEB_CLASS_NAMESPC(DebModCamera, "SparseCodec", "Ultra");
+
+public:
+	SparseCodec(int npixels);
+	~SparseCodec();
+
+	void setThreshold(unsigned short threshold);
+	void getThreshold(unsigned short& threshold);
+	void setPixelThreshold(int pixel, unsigned short threshold);
+	void getPixelThreshold(int pixel, unsigned short& threshold);
+
+	void setCapacity(int nb_pixels);
+	int getCapacity() const;
+
+	int encode(const unsigned short* line, unsigned short* pairs) const;
+	int pack(const unsigned short* pairs, int count, unsigned short* packed) const;
+
+	// -- reader side
+	static int getPackedSize(int capacity);
+	static int getCount(const unsigned short* packed);
+	static int getOverflow(const unsigned short* packed);
+	static void decode(const unsigned short* packed, unsigned short* line, int npixels);
+
+private:
+	int m_npixels;
+	int m_capacity;
+	unsigned short m_threshold;
+	std::vector<unsigned short> m_pixel_threshold;
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRASPARSE_H_ */
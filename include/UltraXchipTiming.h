@@ -0,0 +1,104 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraXchipTiming.h
+// Created on: Oct 19, 2026
+
+#ifndef ULTRAXCHIPTIMING_H_
+#define ULTRAXCHIPTIMING_H_
+
+#include <string>
+#include <vector>
+
+namespace lima {
+namespace Ultra {
+
+/*******************************************************************
+ * \struct XchipTiming
+ * \brief XCHIP timing as set by the user, in FPGA clock ticks
+ *******************************************************************/
+struct XchipTiming {
+	unsigned int delay;
+	unsigned int width;				// integration width
+	unsigned int zeroWidth;
+	unsigned int sampleWidth;
+	unsigned int resetWidth;
+	unsigned int settlingTime;
+	unsigned int xClkHalfPeriod;
+	unsigned int readoutMode;		// 0: readout during the next integration, 1: after the integration
+	unsigned int shiftDelay;		// derived, returned by fromRegisters()
+};
+
+/*******************************************************************
+ * \struct XchipRegisters
+ * \brief the five FPGA register pairs holding an XchipTiming
+ *******************************************************************/
+struct XchipRegisters {
+	unsigned int rstDelay, rstWidth;
+	unsigned int s1Delay, s1Width;
+	unsigned int s2Delay, s2Width;
+	unsigned int xclkHalfPeriod, xclkSettling;
+	unsigned int shiftDelay, shiftWidth;
+};
+
+/*******************************************************************
+ * \class XchipTimingModel
+ * \brief host-side model of the XCHIP line timing
+ *
+ * Converts a timing to and from the FPGA registers, the INGAAS heads
+ * swapping the S1 and S2 windows, and checks it without the hardware.
+ * validate() returns the errors (timing rejected) and the adjustments
+ * toRegisters() makes (delay not above zeroWidth, settlingTime above
+ * xClkHalfPeriod - 2).
+ *
+ * The line period assumes each ADC channel shifts its pixels out one
+ * per XCLK cycle from shiftDelay, and that a line starts once both its
+ * reset and its sample window ended and the previous readout finished.
+ * It is a lower bound: the FPGA overheads are not modelled.
+ *******************************************************************/
+class XchipTimingModel {
+public:
+	XchipTimingModel(int headType, int npixels, int nb_channels, double clock_period);
+
+	void setClockPeriod(double clock_period);
+	double getClockPeriod() const;
+
+	bool validate(const XchipTiming& timing, std::vector<std::string>& errors,
+			std::vector<std::string>& adjustments) const;
+	void toRegisters(const XchipTiming& timing, XchipRegisters& regs) const;
+	void fromRegisters(const XchipRegisters& regs, XchipTiming& timing) const;
+
+	unsigned int getLineTicks(const XchipTiming& timing) const;
+	double getLinePeriod(const XchipTiming& timing) const;
+	double getMaxLineRate(const XchipTiming& timing) const;
+	void getFastest(unsigned int width, const XchipTiming& base, XchipTiming& fastest) const;
+
+private:
+	int m_head_type;
+	int m_pixels_per_channel;
+	double m_clock_period;			// seconds
+};
+
+} // namespace Ultra
+} // namespace lima
+
+#endif /* ULTRAXCHIPTIMING_H_ */
@@ -0,0 +1,100 @@
+############################################################################
+# This file is part of LImA, a Library for Image Acquisition
+#
+# Copyright (C) : 2009-2013
+# European Synchrotron Radiation Facility
+# BP 220, Grenoble 38043
+# FRANCE
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, see <http://www.gnu.org/licenses/>.
+############################################################################
+#
+# NumPy views on the acquired lines and the histograms, see
+# Camera.pinFrames() and Camera.getHistograms(), and the release of the
+# frames consumed by Lima, see Camera.setReleaseTracking()
+#
+import numpy
+from Lima import Core
+
+class FrameView(object):
+    """lines first..first + nb_frames - 1 as a 2D uint16 array, one line per row
+
+    The array uses the Lima buffers directly unless the range wraps around
+    them, it is then copied (zero_copy is False). The frames stay pinned,
+    the acquisition waiting rather than overwriting them, until release()
+    or the end of the with block; the array must not be used afterwards.
+    """
+    def __init__(self, camera, first, nb_frames):
+        self.camera = camera
+        self.pin = None
+        self.pin = camera.pinFrames(first, nb_frames)
+        try:
+            chunks = camera.getPinnedChunks(self.pin)
+            line_size = sum(len(c) for c in chunks) // nb_frames // 2
+            arrays = [numpy.frombuffer(c, dtype=numpy.uint16).reshape(-1, line_size) for c in chunks]
+        except Exception:
+            self.release()
+            raise
+        self.zero_copy = len(arrays) == 1
+        self.array = arrays[0] if self.zero_copy else numpy.vstack(arrays)
+
+    def release(self):
+        if self.pin is not None:
+            self.array = None
+            self.camera.unpinFrames(self.pin)
+            self.pin = None
+
+    def __enter__(self):
+        return self.array
+
+    def __exit__(self, *exc):
+        self.release()
+
+    def __del__(self):
+        self.release()
+
+def latest(camera, nb_frames):
+    """a FrameView of the last nb_frames lines acquired, fewer when the buffers hold less
+
+    With a continuous acquisition the oldest lines of the window are being
+    overwritten, keep nb_frames well below the number of buffers.
+    """
+    first, nb = camera.getRingWindow()
+    count = min(nb, nb_frames)
+    return FrameView(camera, first + nb - count, count)
+
+def histograms(camera):
+    """the histograms as a (rows, bins) uint32 array, without converting the counts"""
+    nb_rows, nb_bins = camera.getHistogramSize()
+    return numpy.frombuffer(camera.getHistograms(), dtype=numpy.uint32).reshape(nb_rows, nb_bins)
+
+class LimaRelease(Core.CtControl.ImageStatusCallback):
+    """releases the frames to the camera once Lima processed them, and saved them when saving is on
+
+    Registered on the control for its lifetime; the camera only waits for the
+    releases with Camera.setReleaseTracking(True), the ring policy then
+    applying to the frames Lima is still using.
+    """
+    def __init__(self, control, camera):
+        Core.CtControl.ImageStatusCallback.__init__(self)
+        self.control = control
+        self.camera = camera
+        control.registerImageStatusCallback(self)
+
+    def imageStatusChanged(self, status):
+        last = status.LastImageReady
+        if self.control.saving().getSavingMode() != Core.CtSaving.Manual:
+            last = min(last, status.LastImageSaved)
+        if last >= 0:
+            self.camera.releaseFrames(last)
@@ -0,0 +1,65 @@
+############################################################################
+# This file is part of LImA, a Library for Image Acquisition
+#
+# Copyright (C) : 2009-2013
+# European Synchrotron Radiation Facility
+# BP 220, Grenoble 38043
+# FRANCE
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This software is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, see <http://www.gnu.org/licenses/>.
+############################################################################
+#
+# Reader for the zero suppressed lines produced with
+# Camera.setSparseEnabled(True), see SparseCodec in UltraSparse.h
+#
+import numpy
+
+HEADER_SIZE = 2
+
+def count(packed):
+    return int(packed[0])
+
+def overflow(packed):
+    """number of pixels above threshold dropped past the capacity"""
+    return int(packed[1])
+
+def pairs(packed):
+    """return the (pixel index, value) arrays of a packed line"""
+    packed = numpy.asarray(packed, dtype=numpy.uint16).ravel()
+    n = count(packed)
+    body = packed[HEADER_SIZE:HEADER_SIZE + 2 * n]
+    return body[0::2], body[1::2]
+
+def decode(packed, npixels):
+    """expand a packed line into a full line of npixels pixels"""
+    packed = numpy.asarray(packed, dtype=numpy.uint16).ravel()
+    line = numpy.zeros(npixels, dtype=numpy.uint16)
+    index, value = pairs(packed)
+    line[index] = value
+    return line
+
+def decode_frames(frames, npixels):
+    """expand a 2D array of packed lines, one line per row"""
+    frames = numpy.asarray(frames, dtype=numpy.uint16)
+    frames = frames.reshape(-1, frames.shape[-1])
+    return numpy.vstack([decode(f, npixels) for f in frames])
+
+def decode_hdf5(pairs, counts, npixels):
+    """expand the sparse_pairs and sparse_count datasets of an HDF5 file"""
+    pairs = numpy.asarray(pairs, dtype=numpy.uint16).reshape(-1, 2)
+    counts = numpy.asarray(counts, dtype=numpy.int64).ravel()
+    lines = numpy.zeros((counts.size, npixels), dtype=numpy.uint16)
+    rows = numpy.repeat(numpy.arange(counts.size), counts)
+    lines[rows, pairs[:rows.size, 0]] = pairs[:rows.size, 1]
+    return lines
@@ -0,0 +1,320 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraBufferCtrlObj.cpp
+// Created on: Oct 19, 2026
+
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "UltraBufferCtrlObj.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#define MPOL_PREFERRED 1
+
+const size_t bufferAlignment = 64;		// buffers start on a cache line
+const int maxNumaNodes = 1024;
+
+/*
+ * mbind() without libnuma, the pages prefer the node but may still come
+ * from another one when it is full
+ */
+static bool bindToNode(void* addr, size_t len, int node) {
+	unsigned long mask[maxNumaNodes / (8 * sizeof(unsigned long))];
+	int bits = 8 * sizeof(unsigned long);
+
+	if (node < 0 || node >= maxNumaNodes)
+		return false;
+	memset(mask, 0, sizeof(mask));
+	mask[node / bits] |= 1UL << (node % bits);
+	return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, maxNumaNodes, 0) == 0;
+}
+
+//---------------------------
+//- PoolAllocMgr
+//---------------------------
+PoolAllocMgr::PoolAllocMgr() : m_nb_buffers(0), m_buffer_size(0), m_base(0), m_size(0), m_page_mode(NormalPages),
+		m_max_size(0), m_max_frames(0), m_huge_pages(true), m_numa_node(-1) {
+	DEB_CONSTRUCTOR();
+}
+
+PoolAllocMgr::~PoolAllocMgr() {
+	DEB_DESTRUCTOR();
+	releaseBuffers();
+}
+
+int PoolAllocMgr::getMaxNbBuffers(const FrameDim& frame_dim) {
+	DEB_MEMBER_FUNCT();
+	long long buffer_size = (frame_dim.getMemSize() + bufferAlignment - 1) / bufferAlignment * bufferAlignment;
+	long long size = m_max_size;
+	if (!size)
+		size = (long long) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+	long long nb_buffers = size / buffer_size;
+	if (m_max_frames && m_max_frames < nb_buffers)
+		nb_buffers = m_max_frames;
+	if (nb_buffers > INT_MAX)
+		nb_buffers = INT_MAX;
+	DEB_RETURN() << DEB_VAR1(nb_buffers);
+	return nb_buffers;
+}
+
+void PoolAllocMgr::allocBuffers(int nb_buffers, const FrameDim& frame_dim) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(nb_buffers, frame_dim);
+
+	if (nb_buffers <= 0 || !frame_dim.isValid()) {
+		THROW_HW_ERROR(InvalidValue) << "PoolAllocMgr::allocBuffers(): invalid buffers";
+	}
+	size_t buffer_size = (frame_dim.getMemSize() + bufferAlignment - 1) / bufferAlignment * bufferAlignment;
+	if (m_base && nb_buffers == m_nb_buffers && buffer_size == m_buffer_size)
+		return;
+	releaseBuffers();
+
+	size_t size = buffer_size * nb_buffers;
+	void* base = MAP_FAILED;
+	if (m_huge_pages) {
+		m_size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+		base = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		m_page_mode = HugePages;
+	}
+	if (base == MAP_FAILED) {
+		if (m_huge_pages)
+			DEB_TRACE() << "no huge pages reserved, using transparent huge pages";
+		size_t page_size = sysconf(_SC_PAGESIZE);
+		m_size = (size + page_size - 1) / page_size * page_size;
+		base = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
+			m_size = 0;
+			THROW_HW_ERROR(Error) << "PoolAllocMgr::allocBuffers(): cannot map " << size << " bytes";
+		}
+		m_page_mode = NormalPages;
+		if (m_huge_pages && madvise(base, m_size, MADV_HUGEPAGE) == 0)
+			m_page_mode = TransparentHugePages;
+	}
+	if (m_numa_node >= 0 && !bindToNode(base, m_size, m_numa_node))
+		DEB_WARNING() << "buffers not bound to NUMA node " << m_numa_node << ": " << strerror(errno);
+
+	m_base = (char*) base;
+	m_buffer_size = buffer_size;
+	m_nb_buffers = nb_buffers;
+	m_frame_dim = frame_dim;
+	DEB_TRACE() << "mapped " << m_size << " bytes, page mode " << m_page_mode;
+}
+
+const FrameDim& PoolAllocMgr::getFrameDim() {
+	return m_frame_dim;
+}
+
+void PoolAllocMgr::getNbBuffers(int& nb_buffers) {
+	nb_buffers = m_nb_buffers;
+}
+
+void PoolAllocMgr::releaseBuffers() {
+	DEB_MEMBER_FUNCT();
+	if (m_base)
+		munmap(m_base, m_size);
+	m_base = 0;
+	m_size = 0;
+	m_nb_buffers = 0;
+	m_buffer_size = 0;
+}
+
+void* PoolAllocMgr::getBufferPtr(int buffer_nb) {
+	return m_base + buffer_nb * m_buffer_size;
+}
+
+void PoolAllocMgr::clearAllBuffers() {
+	memset(m_base, 0, m_nb_buffers * m_buffer_size);
+}
+
+void PoolAllocMgr::setMemoryBudget(long long size) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(size);
+	if (size < 0) {
+		THROW_HW_ERROR(InvalidValue) << "PoolAllocMgr::setMemoryBudget(): invalid size";
+	}
+	m_max_size = size;
+}
+
+void PoolAllocMgr::setFrameBudget(int nb_frames) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_frames);
+	if (nb_frames < 0) {
+		THROW_HW_ERROR(InvalidValue) << "PoolAllocMgr::setFrameBudget(): invalid number of frames";
+	}
+	m_max_frames = nb_frames;
+}
+
+void PoolAllocMgr::setHugePages(bool enabled) {
+	m_huge_pages = enabled;
+}
+
+void PoolAllocMgr::setNumaNode(int node) {
+	m_numa_node = node;
+}
+
+/*
+ * Map every page now rather than on the first lines received, keeping
+ * the buffer contents
+ */
+void PoolAllocMgr::prefault() {
+	DEB_MEMBER_FUNCT();
+	if (!m_base)
+		return;
+	if (madvise(m_base, m_size, MADV_POPULATE_WRITE) == 0)
+		return;
+	size_t step = (m_page_mode == HugePages) ? hugePageSize : sysconf(_SC_PAGESIZE);
+	volatile char* p = m_base;
+	for (size_t offset = 0; offset < m_size; offset += step)
+		p[offset] = p[offset];
+}
+
+int PoolAllocMgr::getCpuNumaNode(int cpu) {
+	char path[64];
+	int node = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	DIR* dir = opendir(path);
+	if (!dir)
+		return -1;
+	while (struct dirent* entry = readdir(dir)) {
+		if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+			node = atoi(entry->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+//---------------------------
+//- BufferCtrlObj
+//---------------------------
+BufferCtrlObj::BufferCtrlObj() : m_cb_mgr(m_alloc_mgr), m_mgr(m_cb_mgr),
+		m_base(0), m_buffer_size(0), m_frame_size(0), m_nb_concat(1), m_nb_slots(0) {
+	DEB_CONSTRUCTOR();
+}
+
+BufferCtrlObj::~BufferCtrlObj() {
+	DEB_DESTRUCTOR();
+}
+
+void BufferCtrlObj::setFrameDim(const FrameDim& frame_dim) {
+	m_mgr.setFrameDim(frame_dim);
+	updateLayout();
+}
+
+void BufferCtrlObj::getFrameDim(FrameDim& frame_dim) {
+	m_mgr.getFrameDim(frame_dim);
+}
+
+void BufferCtrlObj::setNbBuffers(int nb_buffers) {
+	m_mgr.setNbBuffers(nb_buffers);
+	updateLayout();
+}
+
+void BufferCtrlObj::getNbBuffers(int& nb_buffers) {
+	m_mgr.getNbBuffers(nb_buffers);
+}
+
+void BufferCtrlObj::setNbConcatFrames(int nb_concat_frames) {
+	m_mgr.setNbConcatFrames(nb_concat_frames);
+	updateLayout();
+}
+
+void BufferCtrlObj::getNbConcatFrames(int& nb_concat_frames) {
+	m_mgr.getNbConcatFrames(nb_concat_frames);
+}
+
+void BufferCtrlObj::getMaxNbBuffers(int& max_nb_buffers) {
+	m_mgr.getMaxNbBuffers(max_nb_buffers);
+}
+
+void* BufferCtrlObj::getBufferPtr(int buffer_nb, int concat_frame_nb) {
+	return m_mgr.getBufferPtr(buffer_nb, concat_frame_nb);
+}
+
+void* BufferCtrlObj::getFramePtr(int acq_frame_nb) {
+	return m_mgr.getFramePtr(acq_frame_nb);
+}
+
+void BufferCtrlObj::getStartTimestamp(Timestamp& start_ts) {
+	m_mgr.getStartTimestamp(start_ts);
+}
+
+void BufferCtrlObj::getFrameInfo(int acq_frame_nb, HwFrameInfoType& info) {
+	m_mgr.getFrameInfo(acq_frame_nb, info);
+}
+
+void BufferCtrlObj::registerFrameCallback(HwFrameCallback& frame_cb) {
+	m_mgr.registerFrameCallback(frame_cb);
+}
+
+void BufferCtrlObj::unregisterFrameCallback(HwFrameCallback& frame_cb) {
+	m_mgr.unregisterFrameCallback(frame_cb);
+}
+
+/*
+ * Concatenated frames of a buffer are contiguous, and so are the
+ * buffers when the frames need no alignment padding
+ */
+int BufferCtrlObj::getSlotRun(long long acq_frame_nb, int max_frames) const {
+	int slot = acq_frame_nb % m_nb_slots;
+	int run = (m_buffer_size == m_nb_concat * m_frame_size) ? m_nb_slots - slot : m_nb_concat - slot % m_nb_concat;
+	return (run < max_frames) ? run : max_frames;
+}
+
+void BufferCtrlObj::updateLayout() {
+	DEB_MEMBER_FUNCT();
+	FrameDim frame_dim;
+	int nb_buffers;
+
+	m_mgr.getFrameDim(frame_dim);
+	m_mgr.getNbConcatFrames(m_nb_concat);
+	m_alloc_mgr.getNbBuffers(nb_buffers);
+	m_base = m_alloc_mgr.getBase();
+	m_buffer_size = m_alloc_mgr.getBufferSize();
+	m_frame_size = frame_dim.getMemSize();
+	if (m_nb_concat < 1)
+		m_nb_concat = 1;
+	m_nb_slots = m_base ? nb_buffers * m_nb_concat : 0;
+	DEB_TRACE() << DEB_VAR3(m_nb_slots, m_buffer_size, m_frame_size);
+}
@@ -0,0 +1,183 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraCalibration.cpp
+// Created on: Oct 19, 2026
+
+#include <math.h>
+#include "UltraCalibration.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+Calibration::Calibration(int npixels) : m_npixels(0), m_window(0), m_reference(0.) {
+	DEB_CONSTRUCTOR();
+	setNbPixels(npixels);
+}
+
+/*
+ * A new number of pixels, e.g. after adding a head, resets the estimates
+ */
+void Calibration::setNbPixels(int npixels) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_lock);
+	if (npixels == m_npixels)
+		return;
+	m_npixels = npixels;
+	aLock.unlock();
+	reset();
+}
+
+/*
+ * Lines of each type averaged, 0 to average all the lines since the reset
+ */
+void Calibration::setWindow(int nb_lines) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_lines);
+	if (nb_lines < 0) {
+		THROW_HW_ERROR(InvalidValue) << "Calibration::setWindow(): nb_lines must be positive or 0";
+	}
+	AutoMutex aLock(m_lock);
+	m_window = nb_lines;
+}
+
+void Calibration::getWindow(int& nb_lines) const {
+	AutoMutex aLock(m_lock);
+	nb_lines = m_window;
+}
+
+/*
+ * Pulse amplitude of a pixel of gain 1, 0 for the mean amplitude of the pixels
+ */
+void Calibration::setReference(double amplitude) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(amplitude);
+	if (amplitude < 0.) {
+		THROW_HW_ERROR(InvalidValue) << "Calibration::setReference(): amplitude must be positive or 0";
+	}
+	AutoMutex aLock(m_lock);
+	m_reference = amplitude;
+	updateCorrection();
+}
+
+void Calibration::getReference(double& amplitude) const {
+	AutoMutex aLock(m_lock);
+	amplitude = m_reference;
+}
+
+void Calibration::reset() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_lock);
+	m_pulse.mean.assign(m_npixels, 0.);
+	m_pulse.var.assign(m_npixels, 0.);
+	m_pulse.nb_lines = 0;
+	m_pedestal.mean.assign(m_npixels, 0.);
+	m_pedestal.var.assign(m_npixels, 0.);
+	m_pedestal.nb_lines = 0;
+	m_offset.assign(m_npixels, 0.f);
+	m_factor.assign(m_npixels, 1.f);
+}
+
+void Calibration::addCalibrationLine(const unsigned short* line) {
+	AutoMutex aLock(m_lock);
+	update(m_pulse, line);
+	updateCorrection();
+}
+
+void Calibration::addPedestalLine(const unsigned short* line) {
+	AutoMutex aLock(m_lock);
+	update(m_pedestal, line);
+	updateCorrection();
+}
+
+/*
+ * Welford's update, the weight of the new line being 1/n up to the window
+ */
+void Calibration::update(Welford& w, const unsigned short* line) {
+	w.nb_lines++;
+	unsigned long long n = (m_window && w.nb_lines > (unsigned long long) m_window) ? m_window : w.nb_lines;
+	double weight = 1. / n;
+	double* mean = &w.mean[0];
+	double* var = &w.var[0];
+	for (int p=0; p<m_npixels; p++) {
+		double delta = line[p] - mean[p];
+		mean[p] += weight * delta;
+		var[p] += weight * (delta * (line[p] - mean[p]) - var[p]);
+	}
+}
+
+/*
+ * Offsets and gain factors applied by correct(), a pixel without pulse
+ * above its offset keeps a gain of 1
+ */
+void Calibration::updateCorrection() {
+	for (int p=0; p<m_npixels; p++)
+		m_offset[p] = m_pedestal.mean[p];
+	if (!m_pulse.nb_lines)
+		return;
+	double reference = m_reference;
+	if (reference == 0.) {
+		int nb = 0;
+		for (int p=0; p<m_npixels; p++) {
+			double amplitude = m_pulse.mean[p] - m_pedestal.mean[p];
+			if (amplitude > 0.) {
+				reference += amplitude;
+				nb++;
+			}
+		}
+		reference = (nb) ? reference / nb : 0.;
+	}
+	for (int p=0; p<m_npixels; p++) {
+		double amplitude = m_pulse.mean[p] - m_pedestal.mean[p];
+		m_factor[p] = (amplitude > 0. && reference > 0.) ? reference / amplitude : 1.f;
+	}
+}
+
+void Calibration::correct(unsigned short* line) {
+	AutoMutex aLock(m_lock);
+	const float* offset = &m_offset[0];
+	const float* factor = &m_factor[0];
+	for (int p=0; p<m_npixels; p++) {
+		float value = (line[p] - offset[p]) * factor[p] + 0.5f;
+		line[p] = (value <= 0.f) ? 0 : (value >= 65535.f) ? 65535 : (unsigned short) value;
+	}
+}
+
+void Calibration::getEstimates(std::vector<double>& gains, std::vector<double>& offsets, std::vector<double>& noise) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_lock);
+	gains.resize(m_npixels);
+	for (int p=0; p<m_npixels; p++)
+		gains[p] = 1. / m_factor[p];
+	offsets = m_pedestal.mean;
+	noise.resize(m_npixels);
+	for (int p=0; p<m_npixels; p++)
+		noise[p] = sqrt(m_pedestal.var[p]);
+}
+
+void Calibration::getNbLines(unsigned long long& calibration, unsigned long long& pedestal) {
+	AutoMutex aLock(m_lock);
+	calibration = m_pulse.nb_lines;
+	pedestal = m_pedestal.nb_lines;
+}
@@ -27,10 +27,17 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <string.h>
+#include <ctype.h>
 #include <math.h>
 #include <climits>
 #include <iomanip>
+#include <chrono>
 #include "UltraCamera.h"
+#include "UltraSocketUtils.h"
+#ifdef WITH_HDF5
+#include "UltraHdf5Writer.h"
+#endif
 #include "lima/Exceptions.h"
 #include "lima/Debug.h"
 
@@ -38,6 +45,36 @@ using namespace lima;
 using namespace lima::Ultra;
 using namespace std;
 
+const int calibSettleLines = 16;		// lines dropped after an offset change
+const int adcChannelsPerBoard = 4;
+const int recvPollMs = 100;				// stop latency of a receive waiting for lines
+const float calibProbeStep = 0.01f;		// first offset step, V
+const float calibMaxStep = 0.5f;		// largest offset step, V
+const int skbOverhead = 2;				// kernel memory charged per datagram byte, roughly
+const double reconnectBackoffMin = 0.1;		// first reconnect delay, s
+const double reconnectBackoffMax = 10.0;	// longest reconnect delay, s
+const double xchipClockPeriod = 10e-9;		// FPGA timing clock, s (nominal)
+const long long prefetchLifetime = 500000000;	// prefetched replies, ns
+
+// a file name pattern taking the acquisition number: one %d, with optional flags and width, and %% only
+static bool isFilePattern(const string& pattern) {
+	int nb_conversions = 0;
+	for (size_t i=0; i<pattern.size(); i++) {
+		if (pattern[i] != '%')
+			continue;
+		if (++i < pattern.size() && pattern[i] == '%')
+			continue;
+		while (i < pattern.size() && pattern[i] && strchr("0-+ ", pattern[i]))
+			i++;
+		while (i < pattern.size() && isdigit(pattern[i]))
+			i++;
+		if (i == pattern.size() || pattern[i] != 'd')
+			return false;
+		nb_conversions++;
+	}
+	return nb_conversions == 1;
+}
+
 //---------------------------
 //- utility thread
 //---------------------------
@@ -60,29 +97,65 @@ private:
 
 Camera::Camera(std::string headname, std::string hostname, int tcpPort, int udpPort, int npixels) : m_headname(headname),
 		m_hostname(hostname), m_tcpPort(tcpPort), m_udpPort(udpPort), m_npixels(npixels), m_image_type(Bpp16),
-		m_nb_frames(0), m_acq_frame_nb(-1), m_bufferCtrlObj() {
+		m_nb_frames(0), m_state(Idle), m_acq_frame_nb(-1), m_lima_wrap(INT_MAX), m_bufferCtrlObj(), m_buffer_numa_node(-1),
+		m_receive_first_cpu(-1), m_sparse(npixels), m_sparse_enabled(false),
+		m_line_buffer(npixels), m_sparse_pairs(2 * npixels), m_sparse_count(0), m_sparse_overflow(0), m_hdf5_writer(0), m_hdf5_chunk_lines(0), m_hdf5_level(0), m_hdf5_threads(0),
+		m_hdf5_file_nb(0), m_histogram(npixels, maxNumChannels), m_histogram_enabled(false),
+		m_acq_nb(0), m_multi(npixels), m_heads_tiled(false), m_cmd_head(-1),
+		m_prefetch_time(0), m_nb_pins(0), m_next_pin(0), m_ring_policy(RingBlock),
+		m_ring_overwritten(0), m_ring_dropped(0), m_release_tracking(false), m_released_frame(-1), m_line_type(0), m_last_gate(-1), m_nb_gates(0), m_sync_forced(false), m_sync_enabled(false),
+		m_calibration(npixels), m_calib_correction(false),
+		m_scan_settle_lines(0), m_scan_active(false),
+		m_scan_state(ScanApplied), m_scan_point(0),
+		m_scan_next_frame(0), m_scan_settle_left(0), m_scan_dropped(0), m_xchip_clock_period(xchipClockPeriod) {
 	DEB_CONSTRUCTOR();
 
 	DebParams::setModuleFlags(DebParams::AllFlags);
 	DebParams::setTypeFlags(DebParams::AllFlags);
 	DebParams::setFormatFlags(DebParams::AllFlags);
+	for (int t=0; t<nbLineTypes; t++) {
+		m_line_kept[t] = true;
+		m_last_lines[t].assign(npixels, 0);
+	}
+	for (int t=0; t<=nbLineTypes; t++)
+		m_line_counts[t] = 0;
 	m_acq_thread = new AcqThread(*this);
 	m_acq_thread->start();
 	m_ultra = new UltraNet();
+	m_ultra->setMetrics(&m_metrics);
+	updateBufferNumaNode();
 	init();
+	m_acq_start.fpga_valid = false;
+	m_acq_start.received = m_acq_start.kernel_drops = m_acq_start.gaps = m_acq_start.frames_ready = 0;
+	m_acq_start.lines = m_acq_start.discarded = m_acq_start.filtered = 0;
+	m_acq_start.time = Timestamp::now();
 }
 
 Camera::~Camera() {
 	DEB_DESTRUCTOR();
+	delete m_acq_thread;
+	m_events.stopTelemetry();
+	m_multi.stop();
+	for (size_t i=0; i<m_heads.size(); i++) {
+		m_heads[i]->disconnectFromServer();
+		delete m_heads[i];
+	}
 	m_ultra->disconnectFromServer();
 	delete m_ultra;
-	delete m_acq_thread;
+#ifdef WITH_HDF5
+	delete m_hdf5_writer;
+#endif
 }
 
 void Camera::init() {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd1, cmd2, cmd3;
 
+	if (m_headname.empty()) {
+		// offline, e.g. replaying a raw capture file
+		DEB_TRACE() << "Ultra running without a head";
+		m_headType = lima::Ultra::SILICON;
+		return;
+	}
 	DEB_TRACE() << "Ultra initialising the data port " << DEB_VAR2(m_hostname,m_udpPort);
 	m_ultra->initServerDataPort(m_hostname, m_udpPort);
 	DEB_TRACE() << "Ultra connecting to " << DEB_VAR2(m_headname, m_tcpPort);
@@ -104,34 +177,113 @@ void Camera::reset() {
 
 void Camera::prepareAcq() {
 	DEB_MEMBER_FUNCT();
+	checkNoPins();
+	m_bufferCtrlObj.getAllocMgr().prefault();
+	Size size;
+	getDetectorImageSize(size);
+	m_scratch_line.resize(size.getWidth() * size.getHeight());
+	AutoMutex aLock(m_line_lock);
+	for (int t=0; t<nbLineTypes; t++)
+		m_last_lines[t].assign(m_npixels * (m_heads.size() + 1), 0);
+	aLock.unlock();
+	m_calibration.setNbPixels(m_npixels * (m_heads.size() + 1));
+	if (m_histogram_enabled) {
+		// the channel rows in the order of getDarkChannelMeans()
+		vector<int> first_pixels(maxNumChannels);
+		for (int c=0; c<maxNumChannels; c++)
+			first_pixels[c] = getChannelPixel(c);
+		m_histogram.setChannelPixels(first_pixels);
+	}
+	applyTrigMode();
+	if (!m_scan_table.empty())
+		encodeScanTable();
+#ifdef WITH_HDF5
+	if (!m_hdf5_filename.empty()) {
+		char filename[PATH_MAX];
+		int len = snprintf(filename, sizeof(filename), m_hdf5_filename.c_str(), m_hdf5_file_nb++);
+		if (len < 0 || len >= (int) sizeof(filename)) {
+			THROW_HW_ERROR(InvalidValue) << "Camera::prepareAcq(): HDF5 file name too long";
+		}
+		Size size;
+		getDetectorImageSize(size);
+		if (!m_hdf5_writer)
+			m_hdf5_writer = new Hdf5Writer();
+		m_hdf5_writer->close();
+		if (m_sparse_enabled)
+			m_hdf5_writer->open(filename, m_npixels, m_hdf5_chunk_lines, m_hdf5_level, m_hdf5_threads, true);
+		else
+			m_hdf5_writer->open(filename, size.getWidth() * size.getHeight(), m_hdf5_chunk_lines, m_hdf5_level,
+					m_hdf5_threads);
+	}
+#endif
 }
 
 void Camera::startAcq() {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::startAcq(): acquisition running";
+	}
+	checkNoPins();
+	if (!m_bufferCtrlObj.getNbSlots()) {
+		THROW_HW_ERROR(Error) << "Camera::startAcq(): no buffers allocated";
+	}
 	m_acq_frame_nb = 0;
+	m_lima_wrap = INT_MAX / m_bufferCtrlObj.getNbSlots() * m_bufferCtrlObj.getNbSlots();
+	m_released_frame = -1;
+	m_ring_overwritten = 0;
+	m_ring_dropped = 0;
+	m_sparse_overflow = 0;
+	{
+		AutoMutex gLock(m_gate_lock);
+		m_frame_gates.assign(m_bufferCtrlObj.getNbSlots(), 0);
+	}
+	for (int t=0; t<=nbLineTypes; t++)
+		m_line_counts[t] = 0;
+	m_last_gate = -1;
+	m_nb_gates = 0;
 	StdBufferCbMgr& buffer_mgr = m_bufferCtrlObj.getBuffer();
 	buffer_mgr.setStartTimestamp(Timestamp::now());
+	if (m_replay.isOpen())
+		m_replay.rewind();
+	m_ultra->resetFrameSequence();
+	readFpgaCounters(m_acq_start);
+	takeSnapshot(m_acq_start);
+	m_acq_nb++;
+	m_scan_active = !m_scan_table.empty();
+	if (m_scan_active)
+		startScan();
+	if (!m_heads.empty()) {
+		m_multi.resetCounters();
+		m_multi.start();
+	}
 	AutoMutex aLock(m_cond.mutex());
-	m_wait_flag = false;
+	m_state.store(Armed, std::memory_order_release);
 	m_quit = false;
 	m_cond.broadcast();
 	// Wait that Acq thread start if it's an external trigger
-	while (m_trigger_mode == ExtTrigMult && !m_thread_running)
+	while (m_trigger_mode != IntTrig && m_trigger_mode != IntTrigMult && m_state == Armed)
 		m_cond.wait();
 }
 
 void Camera::stopAcq() {
 	DEB_MEMBER_FUNCT();
 	AutoMutex aLock(m_cond.mutex());
-	m_wait_flag = true;
-	while (m_thread_running)
+	AcqState state = m_state;
+	if (state == Armed || state == Running)
+		m_state.store(Stopping, std::memory_order_release);
+	m_cond.broadcast();
+	// the acquisition thread may be waiting in getLine() for a head
+	if (!m_heads.empty() && (state == Armed || state == Running)) {
+		aLock.unlock();
+		m_multi.stop();
+		aLock.lock();
+	}
+	while (m_state == Stopping)
 		m_cond.wait();
 }
 
-void Camera::readFrame(void *bptr, int frame_nb) {
+bool Camera::readFrame(void *bptr, long long frame_nb) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
 	int num;
 	DEB_TRACE() << "Camera::readFrame() " << DEB_VAR1(frame_nb);
 	if (m_image_type == Bpp16) {
@@ -139,12 +291,111 @@ void Camera::readFrame(void *bptr, int frame_nb) {
 	} else {
 		THROW_HW_ERROR(Error) << "Camera::readFrame(): Unsupported image type";
 	}
-	m_ultra->getData(bptr, num);
+	unsigned short* line = (unsigned short*) bptr;
+	// no line may come for long in the gated modes, check for a stop meanwhile
+	if (!m_heads.empty()) {
+		while (!m_multi.waitLine(recvPollMs)) {
+			if (m_state.load(std::memory_order_relaxed) != Running)
+				return false;
+		}
+		if (!m_multi.getLine(line, m_line_type))
+			return false;
+		m_metrics.add(Metrics::LinesRead);
+		routeLine(line);
+		if (m_calib_correction && lineType() == DataLine)
+			m_calibration.correct(line);
+		return true;
+	}
+	if (m_sparse_enabled)
+		line = &m_line_buffer[0];
+	// poll only once the lines pending are read
+	int got;
+	while ((got = m_ultra->tryGetData(line, num)) == 0) {
+		if (!m_ultra->waitData(recvPollMs) && m_state.load(std::memory_order_relaxed) != Running)
+			return false;
+	}
+	if (got < 0)
+		return false;
+	m_metrics.add(Metrics::LinesRead);
+	m_line_type = m_ultra->getFrameType();
+	routeLine(line);
+	if (lineType() == DataLine) {
+		if (m_calib_correction)
+			m_calibration.correct(line);
+		if (m_histogram_enabled)
+			m_histogram.addLine(line);
+	}
+	if (m_sparse_enabled) {
+		m_sparse_count = m_sparse.encode(line, &m_sparse_pairs[0]);
+		if (m_sparse.pack(&m_sparse_pairs[0], m_sparse_count, (unsigned short*) bptr))
+			m_sparse_overflow++;
+	}
+	return true;
+}
+
+Camera::LineType Camera::lineType() const {
+	int type = m_line_type & FRAMETYPEMASK;
+	return (type < nbLineTypes) ? LineType(type) : DataLine;
+}
+
+/*
+ * Count the line by type, keep the last non data line of each type aside
+ * and update the calibration estimates
+ */
+void Camera::routeLine(const unsigned short* line) {
+	int type = m_line_type & FRAMETYPEMASK;
+	if (type >= nbLineTypes) {
+		m_line_counts[nbLineTypes].fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	m_line_counts[type].fetch_add(1, std::memory_order_relaxed);
+	if (type == DataLine)
+		return;
+	if (type == CalibrationLine)
+		m_calibration.addCalibrationLine(line);
+	else if (type == PedestalLine)
+		m_calibration.addPedestalLine(line);
+	AutoMutex aLock(m_line_lock);
+	vector<unsigned short>& last = m_last_lines[type];
+	memcpy(&last[0], line, last.size() * sizeof(unsigned short));
+}
+
+/*
+ * Tag the slot of a line with its gate index, a new gate starts when the
+ * index changes
+ */
+void Camera::tagGate(long long frame_nb, int nb_slots) {
+	int gate = (m_line_type >> FRAMEGATESHIFT) & 0xff;
+	{
+		AutoMutex aLock(m_gate_lock);
+		m_frame_gates[frame_nb % nb_slots] = gate;
+	}
+	if ((m_trigger_mode == ExtGate || m_trigger_mode == ExtStartStop) && gate != m_last_gate)
+		m_nb_gates++;
+	m_last_gate = gate;
+}
+
+void Camera::updateMetrics(long long t0, long long t1, long long t2, long long t3) {
+	unsigned long long drops;
+	m_metrics.addLatency(Metrics::Receive, t1 - t0);
+	m_metrics.addLatency(Metrics::Process, t2 - t1);
+	m_metrics.addLatency(Metrics::FrameReady, t3 - t2);
+	m_metrics.add(Metrics::FramesReady);
+	getKernelDrops(drops);
+	m_metrics.set(Metrics::KernelDrops, drops);
+	m_metrics.set(Metrics::RingOccupancy, (m_heads.empty()) ? m_ultra->getPending() : m_multi.getPending());
 }
 
+/*
+ * Lima counts the frames with an int, stuck at INT_MAX past it
+ */
 int Camera::getNbHwAcquiredFrames() {
-	DEB_MEMBER_FUNCT();
-	return m_acq_frame_nb;
+	long long acquired = m_acq_frame_nb.load(std::memory_order_acquire);
+	return (acquired < INT_MAX) ? int(acquired) : INT_MAX;
+}
+
+void Camera::getAcquiredFrames(long long& nb_frames) {
+	nb_frames = m_acq_frame_nb.load(std::memory_order_acquire);
 }
 
 void Camera::AcqThread::threadFunction() {
@@ -153,51 +404,144 @@ void Camera::AcqThread::threadFunction() {
 	StdBufferCbMgr& buffer_mgr = m_cam.m_bufferCtrlObj.getBuffer();
 
 	while (!m_cam.m_quit) {
-		while (m_cam.m_wait_flag && !m_cam.m_quit) {
-			DEB_TRACE() << "Wait";
-			m_cam.m_thread_running = false;
+		AcqState state = m_cam.m_state.load(std::memory_order_acquire);
+		if (state == Stopping) {
+			// stopped before it ran
+			m_cam.m_state.store(Idle, std::memory_order_release);
 			m_cam.m_cond.broadcast();
+			continue;
+		}
+		if (state != Armed) {
+			DEB_TRACE() << "Wait";
 			m_cam.m_cond.wait();
+			continue;
 		}
 		DEB_TRACE() << "AcqThread Running";
-		m_cam.m_thread_running = true;
-		if (m_cam.m_quit)
-			return;
-
+		m_cam.m_state.store(Running, std::memory_order_release);
 		m_cam.m_cond.broadcast();
 		aLock.unlock();
 
+		int nb_slots = m_cam.m_bufferCtrlObj.getNbSlots();
 		bool continueFlag = true;
-		while (continueFlag && (!m_cam.m_nb_frames || m_cam.m_acq_frame_nb < m_cam.m_nb_frames)) {
-				void* bptr = buffer_mgr.getFrameBufferPtr(m_cam.m_acq_frame_nb);
-				m_cam.readFrame(bptr, m_cam.m_acq_frame_nb);
+		bool fault = false;
+		string error;
+		try {
+			while (continueFlag && (!m_cam.m_nb_frames || m_cam.m_acq_frame_nb < m_cam.m_nb_frames) &&
+					m_cam.m_state.load(std::memory_order_relaxed) == Running) {
+				if (m_cam.m_nb_pins || m_cam.m_release_tracking) {
+					SlotWait wait = m_cam.waitPinnedBuffer(m_cam.m_acq_frame_nb, nb_slots);
+					if (wait == SlotStopped)
+						break;
+					if (wait == SlotBusy) {
+						// drop newest: the slot is still pinned, the line is read and discarded
+						if (!m_cam.readFrame(&m_cam.m_scratch_line[0], m_cam.m_acq_frame_nb))
+							break;
+						m_cam.m_ring_dropped++;
+						m_cam.m_metrics.add(Metrics::LinesDiscarded);
+						continue;
+					}
+				}
+				void* bptr = m_cam.m_bufferCtrlObj.getSlot(m_cam.m_acq_frame_nb);
+				if (m_cam.m_scan_active && !m_cam.updateScan()) {
+					// lines taken while the next scan point is being set are dropped
+					if (m_cam.m_scan_state == ScanFailed) {
+						ostringstream os;
+						os << "scan point " << m_cam.m_scan_point << " could not be set";
+						error = os.str();
+						DEB_ERROR() << "acquisition failed: " << error;
+						fault = true;
+						break;
+					}
+					if (!m_cam.readFrame(&m_cam.m_scratch_line[0], m_cam.m_acq_frame_nb))
+						break;
+					m_cam.m_scan_dropped++;
+					m_cam.m_metrics.add(Metrics::LinesDiscarded);
+					continue;
+				}
+				long long t0 = Metrics::now();
+				if (!m_cam.readFrame(bptr, m_cam.m_acq_frame_nb)) {
+					DEB_TRACE() << "acqThread::threadFunction() end of replay";
+					break;
+				}
+				long long t1 = Metrics::now();
+				bool kept = m_cam.m_line_kept[m_cam.lineType()];
+#ifdef WITH_HDF5
+				if (m_cam.m_hdf5_writer && m_cam.m_hdf5_writer->isOpen()) {
+					int frame_nb = kept ? m_cam.limaFrame(m_cam.m_acq_frame_nb) : -1;
+					int frame_type = m_cam.m_line_type & FRAMETYPEMASK;
+					if (m_cam.m_sparse_enabled)
+						m_cam.m_hdf5_writer->addSparseLine(&m_cam.m_sparse_pairs[0], m_cam.m_sparse_count,
+								frame_nb, frame_type, Timestamp::now());
+					else
+						m_cam.m_hdf5_writer->addLine(bptr, frame_nb, frame_type, Timestamp::now());
+				}
+#endif
+				// the slot is taken by the next line
+				if (!kept) {
+					m_cam.m_metrics.add(Metrics::LinesFiltered);
+					continue;
+				}
+				m_cam.tagGate(m_cam.m_acq_frame_nb, nb_slots);
+				long long t2 = Metrics::now();
+				long long frame_nb = m_cam.m_acq_frame_nb;
 				HwFrameInfoType frame_info;
-				frame_info.acq_frame_nb = m_cam.m_acq_frame_nb;
+				frame_info.acq_frame_nb = m_cam.limaFrame(frame_nb);
 				continueFlag = buffer_mgr.newFrameReady(frame_info);
 				DEB_TRACE() << "acqThread::threadFunction() newframe ready ";
-				++m_cam.m_acq_frame_nb;
-////			} else {
-//				AutoMutex aLock(m_cam.m_cond.mutex());
-//				continueFlag = !m_cam.m_wait_flag;
-//				if (m_cam.m_wait_flag) {
-//					stringstream cmd;
-////					cmd << "xstrip timing stop ";
-////					m_cam.m_ultra->sendWait(cmd.str());
-//				} else {
-//					usleep(1000);
-//				}
-//			}
-			DEB_TRACE() << "acquired " << m_cam.m_acq_frame_nb << " frames, required " << m_cam.m_nb_frames << " frames";
+				m_cam.updateMetrics(t0, t1, t2, Metrics::now());
+				m_cam.m_acq_frame_nb.store(frame_nb + 1, std::memory_order_release);
+				m_cam.m_events.frameReady(m_cam.m_acq_frame_nb);
+				if (m_cam.m_scan_active && m_cam.m_acq_frame_nb == m_cam.m_scan_next_frame)
+					m_cam.startScanTransition();
+				DEB_TRACE() << "acquired " << m_cam.m_acq_frame_nb << " frames, required " << m_cam.m_nb_frames << " frames";
+			}
+		} catch (Exception& e) {
+			DEB_ERROR() << "acquisition failed: " << e.getErrMsg();
+			error = e.getErrMsg();
+			fault = true;
+		}
+		m_cam.m_histogram.flush();
+		m_cam.m_events.endAcq(m_cam.m_acq_frame_nb);
+		// the start snapshot and number are replaced by the next startAcq()
+		int acq_nb = m_cam.m_acq_nb;
+		Snapshot start = m_cam.m_acq_start, end;
+		m_cam.takeSnapshot(end);
+		m_cam.m_scan_active = false;
+		m_cam.m_scan_replies.clear();
+		if (!m_cam.m_heads.empty()) {
+			m_cam.m_multi.stop();
+			for (int h=0; h<m_cam.m_multi.getNbHeads(); h++) {
+				unsigned long long unmatched;
+				m_cam.m_multi.getUnmatched(h, unmatched);
+				if (unmatched)
+					DEB_WARNING() << "head " << h << ": " << unmatched << " unmatched frames";
+			}
 		}
+#ifdef WITH_HDF5
+		if (m_cam.m_hdf5_writer) {
+			try {
+				m_cam.m_hdf5_writer->close();
+			} catch (Exception& e) {
+				DEB_ERROR() << "HDF5 saving failed: " << e.getErrMsg();
+			}
+		}
+#endif
+		aLock.lock();
+		m_cam.m_state.store(fault ? Fault : Idle, std::memory_order_release);
+		m_cam.m_cond.broadcast();
+		aLock.unlock();
+		if (fault)
+			m_cam.m_events.acqFailed(error);
+		// the head commands are not waited for on the way to Idle
+		m_cam.endAcqSummary(acq_nb, start, end);
 		aLock.lock();
-		m_cam.m_wait_flag = true;
 	}
 }
 
 Camera::AcqThread::AcqThread(Camera& cam) :
 		m_cam(cam) {
 	AutoMutex aLock(m_cam.m_cond.mutex());
-	m_cam.m_wait_flag = true;
+	m_cam.m_state = Idle;
 	m_cam.m_quit = false;
 	aLock.unlock();
 	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
@@ -237,7 +581,13 @@ void Camera::getDetectorModel(std::string& model) {
 
 void Camera::getDetectorImageSize(Size& size) {
 	DEB_MEMBER_FUNCT();
-	size = Size(m_npixels, 1);
+	int nb_heads = m_heads.size() + 1;
+	if (nb_heads > 1 && m_heads_tiled) {
+		size = Size(m_npixels, nb_heads);
+		return;
+	}
+	int width = (m_sparse_enabled) ? SparseCodec::getPackedSize(m_sparse.getCapacity()) : m_npixels * nb_heads;
+	size = Size(width, 1);
 }
 
 void Camera::getPixelSize(double& sizex, double& sizey) {
@@ -250,6 +600,87 @@ HwBufferCtrlObj* Camera::getBufferCtrlObj() {
 	return &m_bufferCtrlObj;
 }
 
+void Camera::setBufferPoolMemory(int size_mb) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(size_mb);
+	if (size_mb < 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setBufferPoolMemory(): invalid size";
+	}
+	m_bufferCtrlObj.getAllocMgr().setMemoryBudget((long long) size_mb * 1024 * 1024);
+}
+
+void Camera::getBufferPoolMemory(int& size_mb) {
+	DEB_MEMBER_FUNCT();
+	size_mb = m_bufferCtrlObj.getAllocMgr().getMemoryBudget() / (1024 * 1024);
+}
+
+void Camera::setBufferPoolTime(double line_rate, double time) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(line_rate, time);
+	if (line_rate < 0 || time < 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setBufferPoolTime(): invalid argument";
+	}
+	double nb_frames = ceil(line_rate * time);
+	if (nb_frames > INT_MAX) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setBufferPoolTime(): " << nb_frames << " frames is too many";
+	}
+	m_bufferCtrlObj.getAllocMgr().setFrameBudget((int) nb_frames);
+}
+
+void Camera::getBufferPoolMaxFrames(int& nb_frames) {
+	DEB_MEMBER_FUNCT();
+	m_bufferCtrlObj.getMaxNbBuffers(nb_frames);
+}
+
+void Camera::setBufferHugePages(bool enabled) {
+	DEB_MEMBER_FUNCT();
+	m_bufferCtrlObj.getAllocMgr().setHugePages(enabled);
+}
+
+void Camera::getBufferHugePages(bool& enabled) {
+	DEB_MEMBER_FUNCT();
+	enabled = m_bufferCtrlObj.getAllocMgr().getHugePages();
+}
+
+void Camera::setBufferNumaNode(int node) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(node);
+	if (node < -1) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setBufferNumaNode(): invalid node";
+	}
+	m_buffer_numa_node = node;
+	updateBufferNumaNode();
+}
+
+/*
+ * The pool as mapped by the last allocation, page_mode is a
+ * PoolAllocMgr::PageMode
+ */
+void Camera::getBufferPool(int& nb_buffers, long long& size, int& page_mode, int& numa_node) {
+	DEB_MEMBER_FUNCT();
+	PoolAllocMgr& alloc_mgr = m_bufferCtrlObj.getAllocMgr();
+	alloc_mgr.getNbBuffers(nb_buffers);
+	size = alloc_mgr.getSize();
+	page_mode = alloc_mgr.getPageMode();
+	numa_node = alloc_mgr.getNumaNode();
+}
+
+/*
+ * Automatic placement: the node of the first receive cpu when the
+ * receive threads are pinned, else the one of the NIC on the host
+ * address, applied by the next allocation
+ */
+void Camera::updateBufferNumaNode() {
+	DEB_MEMBER_FUNCT();
+	int node = m_buffer_numa_node;
+	if (node < 0 && m_receive_first_cpu >= 0)
+		node = PoolAllocMgr::getCpuNumaNode(m_receive_first_cpu);
+	if (node < 0 && !m_hostname.empty())
+		node = getInterfaceNumaNode(m_hostname.c_str());
+	DEB_TRACE() << "buffer pool on NUMA node " << node;
+	m_bufferCtrlObj.getAllocMgr().setNumaNode(node);
+}
+
 void Camera::setTrigMode(TrigMode mode) {
 	DEB_MEMBER_FUNCT();
 	DEB_TRACE() << "Camera::setTrigMode() " << DEB_VAR1(mode);
@@ -258,11 +689,11 @@ void Camera::setTrigMode(TrigMode mode) {
 	case IntTrig:
 	case IntTrigMult:
 	case ExtTrigMult:
+	case ExtGate:
+	case ExtStartStop:
 		m_trigger_mode = mode;
 		break;
 	case ExtTrigSingle:
-	case ExtGate:
-	case ExtStartStop:
 	case ExtTrigReadout:
 	default:
 		THROW_HW_ERROR(Error) << "Cannot change the Trigger Mode of the camera, this mode is not managed !";
@@ -335,9 +766,17 @@ void Camera::getNbFrames(int& nb_frames) {
 	nb_frames = m_nb_frames;
 }
 
+/*
+ * Lock free, the state only changes under m_cond.mutex() but is read
+ * without it so that status polling never waits for the data path
+ */
 bool Camera::isAcqRunning() const {
-	AutoMutex aLock(m_cond.mutex());
-	return m_thread_running;
+	AcqState state = m_state.load(std::memory_order_acquire);
+	return state == Armed || state == Running || state == Stopping;
+}
+
+void Camera::getAcqState(AcqState& state) const {
+	state = m_state.load(std::memory_order_acquire);
 }
 
 /////////////////////////
@@ -346,201 +785,177 @@ bool Camera::isAcqRunning() const {
 
 void Camera::getHeadColdTemp(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("coldtemp", value);
+	getValue(CommandCodec::ColdTemp, value);
 }
 
 void Camera::getHeadHotTemp(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("hottemp", value);
+	getValue(CommandCodec::HotTemp, value);
 }
 
 void Camera::getTecColdTemp(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("tectemp", value);
+	getValue(CommandCodec::TecTemp, value);
 }
 
 void Camera::getTecSupplyVolts(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("tecsup", value);
+	getValue(CommandCodec::TecSupply, value);
 }
 
 void Camera::getAdcPosSupplyVolts(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("psupvadc", value);
+	getValue(CommandCodec::AdcPosSupply, value);
 }
 
 void Camera::getAdcNegSupplyVolts(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("psunvadc", value);
+	getValue(CommandCodec::AdcNegSupply, value);
 }
 
 void Camera::getVinPosSupplyVolts(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("psupvin", value);
+	getValue(CommandCodec::VinPosSupply, value);
 }
 
 void Camera::getVinNegSupplyVolts(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("psunvin", value);
+	getValue(CommandCodec::VinNegSupply, value);
 }
 
 void Camera::getHeadADCVdd(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvccadc", value);
+	getValue(CommandCodec::HeadAdcVdd, value);
 }
 
 void Camera::getHeadVdd(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvcc", value);
+	getValue(CommandCodec::HeadVdd, value);
 }
 
 void Camera::setHeadVdd(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvcc " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVdd, voltage);
 }
 
 void Camera::getHeadVref(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvref", value);
+	getValue(CommandCodec::HeadVref, value);
 }
 
 void Camera::setHeadVref(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvref " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVref, voltage);
 }
 
 void Camera::getHeadVrefc(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvrefc", value);
+	getValue(CommandCodec::HeadVrefc, value);
 }
 
 void Camera::setHeadVrefc(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvrefc " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVrefc, voltage);
 }
 
 void Camera::getHeadVpupref(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvpupref", value);
+	getValue(CommandCodec::HeadVpupref, value);
 }
 
 void Camera::setHeadVpupref(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvpupref " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVpupref, voltage);
 }
 
 void Camera::getHeadVclamp(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvclamp", value);
+	getValue(CommandCodec::HeadVclamp, value);
 }
 
 void Camera::setHeadVclamp(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvclamp " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVclamp, voltage);
 }
 
 void Camera::getHeadVres1(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvres1", value);
+	getValue(CommandCodec::HeadVres1, value);
 }
 
 void Camera::setHeadVres1(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvres1 " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVres1, voltage);
 }
 
 void Camera::getHeadVres2(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headvres2", value);
+	getValue(CommandCodec::HeadVres2, value);
 }
 
 void Camera::setHeadVres2(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headvres2 " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVres2, voltage);
 }
 
 void Camera::getHeadVTrip(float &value) {
 	DEB_MEMBER_FUNCT();
-	getValue("headtrip", value);
+	getValue(CommandCodec::HeadVTrip, value);
 }
 
 void Camera::setHeadVTrip(float voltage) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "headtrip " << voltage << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::HeadVTrip, voltage);
 }
 
 void Camera::getFpgaXchipReg(unsigned int& reg) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgaxchip", reg);
+	getValue(CommandCodec::FpgaXchip, reg);
 }
 
 void Camera::setFpgaXchipReg(unsigned int reg) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "fpgaxchip " << hex << reg << "";
-	setValue(cmd.str());
+	setValue(CommandCodec::FpgaXchip, reg);
 }
 
 void Camera::getFpgaPwrReg(unsigned int &reg) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgapwr", reg);
+	getValue(CommandCodec::FpgaPwr, reg);
 }
 
 void Camera::setFpgaPwrReg(unsigned int reg) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "fpgapwr " << hex << reg;
-	setValue(cmd.str());
+	setValue(CommandCodec::FpgaPwr, reg);
 }
 
 void Camera::getFpgaSyncReg(unsigned int &reg) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgasync", reg);
+	getValue(CommandCodec::FpgaSync, reg);
 }
 
 void Camera::setFpgaSyncReg(unsigned int reg) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "fpgasync " << hex << reg;
-	setValue(cmd.str());
+	setValue(CommandCodec::FpgaSync, reg);
 }
 
 void Camera::getFpgaAdcReg(unsigned int &reg) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgaadc", reg);
+	getValue(CommandCodec::FpgaAdc, reg);
 }
 
 void Camera::setFpgaAdcReg(unsigned int reg) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "fpgaadc " << hex << reg << "";
-	setValue(cmd.str());
+	setValue(CommandCodec::FpgaAdc, reg);
 }
 
 void Camera::getFrameCount(unsigned int& reg) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgaframe", reg);
+	getValue(CommandCodec::FpgaFrame, reg);
 }
 
 void Camera::getFrameErrorCount(unsigned int& reg) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgaerror", reg);
+	getValue(CommandCodec::FpgaError, reg);
 }
 
 void Camera::getTecPowerEnabled(bool& state) {
@@ -553,6 +968,7 @@ void Camera::getTecPowerEnabled(bool& state) {
 void Camera::setTecPowerEnabled(bool state) {
 	DEB_MEMBER_FUNCT();
 	unsigned int reg;
+	clearPrefetch();
 	getFpgaPwrReg(reg);
 	reg = (state) ? (reg |  TECPOWERMASK) : (reg & ~TECPOWERMASK);
 	setFpgaPwrReg(reg);
@@ -568,6 +984,7 @@ void Camera::getHeadPowerEnabled(bool& state) {
 void Camera::setHeadPowerEnabled(bool state) {
 	DEB_MEMBER_FUNCT();
 	unsigned int reg;
+	clearPrefetch();
 	getFpgaPwrReg(reg);
 	reg = (state) ? (reg | HEADPOWERMASK) : (reg & ~HEADPOWERMASK);
 	setFpgaPwrReg(reg);
@@ -583,6 +1000,7 @@ void Camera::getBiasEnabled(bool& state) {
 void Camera::setBiasEnabled(bool state) {
 	DEB_MEMBER_FUNCT();
 	unsigned int reg;
+	clearPrefetch();
 	getFpgaPwrReg(reg);
 	reg =  (state) ? (reg | BIASENABLEMASK) : (reg & ~BIASENABLEMASK);
 	setFpgaPwrReg(reg);
@@ -595,9 +1013,18 @@ void Camera::getSyncEnabled(bool& state) {
 	state = (reg & SYNCENABLEMASK) ? true : false;
 }
 
+/*
+ * While a gated trigger mode forces the sync on, the state is kept and
+ * applied when going back to an internal mode
+ */
 void Camera::setSyncEnabled(bool state) {
 	DEB_MEMBER_FUNCT();
 	unsigned int reg;
+	if (m_sync_forced) {
+		m_sync_enabled = state;
+		return;
+	}
+	clearPrefetch();
 	getFpgaSyncReg(reg);
 	reg = (state) ? (reg | SYNCENABLEMASK) : (reg & ~SYNCENABLEMASK);
 	setFpgaSyncReg(reg);
@@ -613,6 +1040,7 @@ void Camera::getCalibEnabled(bool& state) {
 void Camera::setCalibEnabled(bool state) {
 	DEB_MEMBER_FUNCT();
 	unsigned int reg;
+	clearPrefetch();
 	getFpgaXchipReg(reg);
 	reg = (state) ? (reg | CALENABLEMASK) : (reg & ~CALENABLEMASK);
 	setFpgaXchipReg(reg);
@@ -628,6 +1056,7 @@ void Camera::get8pCEnabled(bool& state) {
 void Camera::set8pCEnabled(bool state) {
 	DEB_MEMBER_FUNCT();
 	unsigned int reg;
+	clearPrefetch();
 	getFpgaXchipReg(reg);
 	reg = (state) ? (reg | EN8PCMASK) : (reg & ~EN8PCMASK);
 }
@@ -642,227 +1071,487 @@ void Camera::getTecOverTemp(bool& state) {
 void Camera::getAdcOffset(int channel, float &value) {
 	DEB_MEMBER_FUNCT();
 	int adcBoard, adcChannel;
-	stringstream cmd;
 
 	if (channel >= maxNumChannels) {
 		THROW_HW_ERROR(Error) << "Invalid arguement channel value is outside of range";
 	}
 	adcChanLookup(m_headType, channel, adcBoard, adcChannel);
-	cmd << "adc" << adcBoard << "off" << adcChannel;
-	getValue(cmd.str(), value);
+	getValue(CommandCodec::AdcOffset, value, adcBoard, adcChannel);
 }
 
 void Camera::setAdcOffset(int channel, float value) {
 	DEB_MEMBER_FUNCT();
 	int adcBoard, adcChannel;
-	stringstream cmd;
 
 	if (channel >= maxNumChannels) {
 		THROW_HW_ERROR(Error) << "Invalid arguement channel value is outside of range";
 	}
 	adcChanLookup(m_headType, channel, adcBoard, adcChannel);
-	cmd << "adc" << adcBoard << "off" << adcChannel << " " << value << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::AdcOffset, value, adcBoard, adcChannel);
 }
 
 void Camera::getAdcGain(int channel, float &value) {
 	DEB_MEMBER_FUNCT();
 	int adcBoard, adcChannel;
-	stringstream cmd;
 
 	if (channel >= maxNumChannels) {
 		THROW_HW_ERROR(Error) << "Invalid arguement channel value is outside of range";
 	}
 	adcChanLookup(m_headType, channel, adcBoard, adcChannel);
-	cmd << "adc" << adcBoard << "ref" << adcChannel;
-	getValue(cmd.str(), value);
+	getValue(CommandCodec::AdcGain, value, adcBoard, adcChannel);
 }
 
 void Camera::setAdcGain(int channel, float value) {
 	DEB_MEMBER_FUNCT();
 	int adcBoard, adcChannel;
-	stringstream cmd;
 
 	if (channel >= maxNumChannels) {
 		THROW_HW_ERROR(Error) << "Invalid arguement channel value is outside of range";
 	}
 	adcChanLookup(m_headType, channel, adcBoard, adcChannel);
-	cmd << "adc" << adcBoard << "ref" << adcChannel << " " << value << "V";
-	setValue(cmd.str());
+	setValue(CommandCodec::AdcGain, value, adcBoard, adcChannel);
+}
+
+void Camera::getAdcGains(std::vector<float>& values) {
+	DEB_MEMBER_FUNCT();
+	getChannelValues(CommandCodec::AdcGain, values);
+}
+
+void Camera::setAdcGains(const std::vector<float>& values) {
+	DEB_MEMBER_FUNCT();
+	if (values.size() != (size_t) maxNumChannels && values.size() != maxNumChannels * (m_heads.size() + 1)) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setAdcGains(): expected " << maxNumChannels << " values per head";
+	}
+	setChannelValues(CommandCodec::AdcGain, values);
+}
+
+void Camera::getAdcOffsets(std::vector<float>& values) {
+	DEB_MEMBER_FUNCT();
+	getChannelValues(CommandCodec::AdcOffset, values);
+}
+
+void Camera::setAdcOffsets(const std::vector<float>& values) {
+	DEB_MEMBER_FUNCT();
+	if (values.size() != (size_t) maxNumChannels && values.size() != maxNumChannels * (m_heads.size() + 1)) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setAdcOffsets(): expected " << maxNumChannels << " values per head";
+	}
+	setChannelValues(CommandCodec::AdcOffset, values);
+}
+
+/*
+ * Mean of the dark lines for each channel. The channels are numbered as
+ * in setAdcOffset(), see getChannelPixel() for their pixels.
+ */
+void Camera::getDarkChannelMeans(int nb_lines, std::vector<double>& means) {
+	DEB_MEMBER_FUNCT();
+	int num = m_npixels * sizeof(short);
+	int block = m_npixels / maxNumChannels;
+	vector<unsigned short> line(m_npixels);
+	vector<unsigned int> sums(m_npixels, 0);
+
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::getDarkChannelMeans(): acquisition is running";
+	}
+	if (!m_heads.empty()) {
+		THROW_HW_ERROR(NotSupported) << "Camera::getDarkChannelMeans(): not available with several heads";
+	}
+	if (nb_lines <= 0 || nb_lines > 65536) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getDarkChannelMeans(): nb_lines must be in [1, 65536]";
+	}
+	m_ultra->flushData();
+	for (int l=0; l<nb_lines+calibSettleLines; l++) {
+		if (!m_ultra->getData(&line[0], num)) {
+			THROW_HW_ERROR(Error) << "Camera::getDarkChannelMeans(): no more data";
+		}
+		if (l < calibSettleLines)
+			continue;
+		const unsigned short* src = &line[0];
+		unsigned int* dst = &sums[0];
+		for (int p=0; p<m_npixels; p++)
+			dst[p] += src[p];
+	}
+	means.assign(maxNumChannels, 0.);
+	for (int c=0; c<maxNumChannels; c++) {
+		unsigned long long sum = 0;
+		int first = getChannelPixel(c);
+		for (int p=first; p<first+block; p++)
+			sum += sums[p];
+		means[c] = (double) sum / ((double) nb_lines * block);
+	}
+	DEB_TRACE() << "Camera::getDarkChannelMeans() " << DEB_VAR1(means[0]);
+}
+
+/*
+ * Secant iteration on each channel offset until the dark mean of every
+ * channel is within tolerance of target (ADC counts). All the offsets
+ * are read and written with one batched exchange per iteration.
+ */
+void Camera::calibrateAdcOffsets(float target, float tolerance, int max_iterations, int nb_lines, bool& converged) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(target, tolerance, max_iterations, nb_lines);
+	vector<float> offset, prev_offset;
+	vector<double> mean, prev_mean;
+	vector<double> slope(maxNumChannels, 0.);
+
+	if (tolerance <= 0 || max_iterations <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::calibrateAdcOffsets(): invalid argument";
+	}
+	if (!m_heads.empty()) {
+		THROW_HW_ERROR(NotSupported) << "Camera::calibrateAdcOffsets(): not available with several heads";
+	}
+	getAdcOffsets(offset);
+	getDarkChannelMeans(nb_lines, mean);
+	converged = false;
+	for (int iter=0; iter<max_iterations; iter++) {
+		bool done = true;
+		prev_offset = offset;
+		prev_mean = mean;
+		for (int c=0; c<maxNumChannels; c++) {
+			if (fabs(mean[c] - target) <= tolerance)
+				continue;
+			done = false;
+			double step = (slope[c] != 0.) ? (target - mean[c]) / slope[c] : calibProbeStep;
+			if (step > calibMaxStep)
+				step = calibMaxStep;
+			else if (step < -calibMaxStep)
+				step = -calibMaxStep;
+			offset[c] += step;
+		}
+		if (done) {
+			converged = true;
+			break;
+		}
+		setAdcOffsets(offset);
+		getDarkChannelMeans(nb_lines, mean);
+		for (int c=0; c<maxNumChannels; c++) {
+			double d = offset[c] - prev_offset[c];
+			if (d != 0. && mean[c] != prev_mean[c])
+				slope[c] = (mean[c] - prev_mean[c]) / d;
+		}
+		DEB_TRACE() << "Camera::calibrateAdcOffsets() " << DEB_VAR3(iter, offset[0], mean[0]);
+	}
+	if (!converged) {
+		converged = true;
+		for (int c=0; c<maxNumChannels; c++)
+			converged = converged && (fabs(mean[c] - target) <= tolerance);
+	}
+	DEB_RETURN() << DEB_VAR1(converged);
 }
 
 void Camera::getAux1(unsigned int& delay, unsigned int& width) {
 	DEB_MEMBER_FUNCT();
-	getValue("fpgaaux1", delay, width);
+	getValue(CommandCodec::FpgaAux1, delay, width);
 }
 
 void Camera::setAux1(unsigned int delay, unsigned int width) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "fpgaaux1 " << delay << " " << width;
-	setValue(cmd.str());
+	setValue(CommandCodec::FpgaAux1, delay, width);
 }
 
 void Camera::getAux2(unsigned int& delay, unsigned int& width) {
 	DEB_MEMBER_FUNCT();
-	return getValue("fpgaaux2", delay, width);
+	return getValue(CommandCodec::FpgaAux2, delay, width);
 }
 
 void Camera::setAux2(unsigned int delay, unsigned int width) {
 	DEB_MEMBER_FUNCT();
-	stringstream cmd;
-	cmd << "fpgaaux2 " << delay << " " << width;
-	setValue(cmd.str());
+	setValue(CommandCodec::FpgaAux2, delay, width);
 }
 
 void Camera::getXchipTiming(unsigned int& delay, unsigned int& width, unsigned int& zeroWidth,
 		unsigned int& sampleWidth, unsigned int& resetWidth, unsigned int& settlingTime, unsigned int& xClkHalfPeriod,
 		unsigned int& readoutMode, unsigned int& shiftDelay) {
 	DEB_MEMBER_FUNCT();
-	unsigned int intS1Delay, intS2Delay, intDelay;
-	unsigned int intS1Width, intS2Width;
-	unsigned int intShiftWidth;
-
-	getValue("fpgarst", intDelay, resetWidth);
-	getValue("fpgas1", intS1Delay, intS1Width);
-	getValue("fpgas2", intS2Delay, intS2Width);
-	getValue("fpgaxclk", xClkHalfPeriod, settlingTime);
-	getValue("fpgashift", shiftDelay, intShiftWidth);
-	if (m_headType == lima::Ultra::INGAAS) {
-		zeroWidth = intS2Width;
-		delay = intDelay + intS2Width;
-		sampleWidth = intS1Width;
-		width = (intS1Width + intS1Delay) - (intS2Width + intS2Delay);
-		readoutMode = 0;
-	} else {
-		zeroWidth = intS1Width;
-		delay = intDelay + intS1Width;
-		sampleWidth = intS2Width;
-		width = (intS2Width + intS2Delay) - (intS1Width + intS1Delay);
-		readoutMode =  (shiftDelay == (delay + width)) ? 1 : 0;
-	}
+	XchipTiming timing;
+
+	getXchipTiming(timing);
+	delay = timing.delay;
+	width = timing.width;
+	zeroWidth = timing.zeroWidth;
+	sampleWidth = timing.sampleWidth;
+	resetWidth = timing.resetWidth;
+	settlingTime = timing.settlingTime;
+	xClkHalfPeriod = timing.xClkHalfPeriod;
+	readoutMode = timing.readoutMode;
+	shiftDelay = timing.shiftDelay;
 }
 
 void Camera::setXchipTiming(unsigned int delay, unsigned int width, unsigned int zeroWidth,
 		unsigned int sampleWidth, unsigned int resetWidth, unsigned int settlingTime, unsigned int xClkHalfPeriod,
 		unsigned int readoutMode) {
 	DEB_MEMBER_FUNCT();
-	unsigned int s1Delay, s2Delay, s1Width, s2Width, startDelay, shiftDelay;
+	XchipTimingModel model = getXchipModel();
+	XchipTiming timing = { delay, width, zeroWidth, sampleWidth, resetWidth, settlingTime, xClkHalfPeriod,
+			readoutMode, 0 };
+	vector<string> errors, adjustments;
+	XchipRegisters regs;
 
-	if (delay > zeroWidth)
-		delay = delay - zeroWidth;
-	else
-		delay = 1;
+	if (!model.validate(timing, errors, adjustments)) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setXchipTiming(): " << errors[0];
+	}
+	for (size_t i=0; i<adjustments.size(); i++)
+		DEB_WARNING() << "XCHIP timing: " << adjustments[i];
+	model.toRegisters(timing, regs);
+	setValue(CommandCodec::FpgaRst, regs.rstDelay, regs.rstWidth);
+	setValue(CommandCodec::FpgaS1, regs.s1Delay, regs.s1Width);
+	setValue(CommandCodec::FpgaS2, regs.s2Delay, regs.s2Width);
+	setValue(CommandCodec::FpgaShift, regs.shiftDelay, regs.shiftWidth);
+	setValue(CommandCodec::FpgaXclk, regs.xclkHalfPeriod, regs.xclkSettling);
+}
+
+void Camera::getXchipTiming(XchipTiming& timing) {
+	DEB_MEMBER_FUNCT();
+	XchipRegisters regs;
 
-	startDelay = delay + zeroWidth + width - sampleWidth;
+	getValue(CommandCodec::FpgaRst, regs.rstDelay, regs.rstWidth);
+	getValue(CommandCodec::FpgaS1, regs.s1Delay, regs.s1Width);
+	getValue(CommandCodec::FpgaS2, regs.s2Delay, regs.s2Width);
+	getValue(CommandCodec::FpgaXclk, regs.xclkHalfPeriod, regs.xclkSettling);
+	getValue(CommandCodec::FpgaShift, regs.shiftDelay, regs.shiftWidth);
+	getXchipModel().fromRegisters(regs, timing);
+}
 
-	if (readoutMode == 1)
-		shiftDelay = startDelay + sampleWidth;
-	else
-		shiftDelay = delay;
+XchipTimingModel Camera::getXchipModel() {
+	return XchipTimingModel(m_headType, m_npixels, maxNumChannels, m_xchip_clock_period);
+}
 
-	if (m_headType == lima::Ultra::INGAAS) {
-		s2Width = zeroWidth;
-		s1Width = sampleWidth;
-		s2Delay = delay;
-		s1Delay = startDelay;
-	} else {
-		s1Width = zeroWidth;
-		s2Width = sampleWidth;
-		s1Delay = delay;
-		s2Delay = startDelay;
-	}
-
-	// set reset width automatically
-	//ResetWidth = ZeroWidth + width + 10;
-	stringstream cmd1,cmd2,cmd3,cmd4,cmd5;
-	cmd1 << "fpgarst " << delay << " " << resetWidth;
-	setValue(cmd1.str());
-	cmd2 << "fpgas1 " << s1Delay << " " << s1Width;
-	setValue(cmd2.str());
-	cmd3 << "fpgas2 " << s2Delay << " " << s2Width;
-	setValue(cmd3.str());
-	cmd4 << "fpgashift " << shiftDelay << " " << 1;
-	setValue(cmd4.str());
-	if (settlingTime > (xClkHalfPeriod - 2)) {
-		settlingTime = xClkHalfPeriod - 2;
-		cmd5 << "fpgaxclk " << xClkHalfPeriod << " " << settlingTime;
-		setValue(cmd5.str());
+void Camera::setXchipClockPeriod(double period) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(period);
+	if (period <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setXchipClockPeriod(): invalid period";
+	}
+	m_xchip_clock_period = period;
+}
+
+void Camera::getXchipClockPeriod(double& period) {
+	DEB_MEMBER_FUNCT();
+	period = m_xchip_clock_period;
+}
+
+/*
+ * Check a timing without the head, report holds one error or
+ * adjustment per line
+ */
+void Camera::checkXchipTiming(unsigned int delay, unsigned int width, unsigned int zeroWidth,
+		unsigned int sampleWidth, unsigned int resetWidth, unsigned int settlingTime, unsigned int xClkHalfPeriod,
+		unsigned int readoutMode, bool& valid, std::string& report, double& max_rate) {
+	DEB_MEMBER_FUNCT();
+	XchipTimingModel model = getXchipModel();
+	XchipTiming timing = { delay, width, zeroWidth, sampleWidth, resetWidth, settlingTime, xClkHalfPeriod,
+			readoutMode, 0 };
+	vector<string> errors, adjustments;
+
+	valid = model.validate(timing, errors, adjustments);
+	report.clear();
+	for (size_t i=0; i<errors.size(); i++)
+		report += "error: " + errors[i] + "\n";
+	for (size_t i=0; i<adjustments.size(); i++)
+		report += "adjusted: " + adjustments[i] + "\n";
+	max_rate = valid ? model.getMaxLineRate(timing) : 0;
+}
+
+void Camera::getXchipLineRate(double& line_period, double& max_rate) {
+	DEB_MEMBER_FUNCT();
+	XchipTiming timing;
+
+	getXchipTiming(timing);
+	line_period = getXchipModel().getLinePeriod(timing);
+	max_rate = 1.0 / line_period;
+}
+
+/*
+ * Fastest timing for an integration width, keeping the other analog
+ * settings of the head
+ */
+void Camera::getFastestXchipTiming(unsigned int width, unsigned int& delay, unsigned int& zeroWidth,
+		unsigned int& sampleWidth, unsigned int& resetWidth, unsigned int& settlingTime, unsigned int& xClkHalfPeriod,
+		unsigned int& readoutMode, double& max_rate) {
+	DEB_MEMBER_FUNCT();
+	XchipTimingModel model = getXchipModel();
+	XchipTiming current, fastest;
+
+	if (width == 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getFastestXchipTiming(): width must not be 0";
 	}
+	getXchipTiming(current);
+	model.getFastest(width, current, fastest);
+	delay = fastest.delay;
+	zeroWidth = fastest.zeroWidth;
+	sampleWidth = fastest.sampleWidth;
+	resetWidth = fastest.resetWidth;
+	settlingTime = fastest.settlingTime;
+	xClkHalfPeriod = fastest.xClkHalfPeriod;
+	readoutMode = fastest.readoutMode;
+	max_rate = model.getMaxLineRate(fastest);
 }
 
 void Camera::saveConfiguration(void) {
 	DEB_MEMBER_FUNCT();
-	return setValue("state");
+	return setValue(CommandCodec::State);
 }
 
 void Camera::restoreConfiguration(void) {
 	DEB_MEMBER_FUNCT();
-	return setValue("state");
+	return setValue(CommandCodec::State);
 }
 
 void Camera::getHeadType(unsigned int& headType) {
 	DEB_MEMBER_FUNCT();
-	getValue("eeprom 0x1ff", headType);
+	getValue(CommandCodec::HeadType, headType);
 }
 
-void Camera::getValue(string cmd, float& value) {
+void Camera::getValue(CommandCodec::Id id, float& value, int board, int channel) {
 	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
 	string reply;
 
-	DEB_TRACE() << "Camera::getValue() sending command read " <<  cmd;
-	string command = "read " + cmd;
-	m_ultra->sendWait(command, reply);
+	CommandCodec::formatRead(command, id, board, channel);
+	DEB_TRACE() << "Camera::getValue() sending command " <<  command;
+	readReply(command, reply);
 	DEB_TRACE() << "Camera::getValue() got a reply " <<  reply;
-	if ((reply[0] == '<') || (reply[0] == '>')) {
-		if (sscanf(&reply[1], "%f", &value) == 1) {
-			return;
-		}
-	} else {
-		if (sscanf(reply.c_str(), "%f", &value) == 1) {
-			DEB_TRACE() << "Camera::getValue() received float value " << value;
-			return;
-		}
+	if (!CommandCodec::parseVolts(reply.c_str(), value)) {
+		THROW_HW_ERROR(Error) << "Camera::getValue(): " << command << " failed";
 	}
-	THROW_HW_ERROR(Error) << "read failed";
+	DEB_TRACE() << "Camera::getValue() received float value " << value;
 }
 
-void Camera::getValue(string cmd, unsigned int& value1, unsigned int& value2) {
+void Camera::getValue(CommandCodec::Id id, unsigned int& value1, unsigned int& value2) {
 	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
 	string reply;
 
-	DEB_TRACE() << "Camera::getValue() sending command read " <<  cmd;
-	string command = "read " + cmd;
-	m_ultra->sendWait(command, reply);
-	if (sscanf(reply.c_str(), "%u %u", &value1, &value2) != 2) {
-		THROW_HW_ERROR(Error) << "Camera::getValue(): sscanf failed to read";
+	CommandCodec::formatRead(command, id);
+	DEB_TRACE() << "Camera::getValue() sending command " <<  command;
+	readReply(command, reply);
+	if (!CommandCodec::parsePair(reply.c_str(), value1, value2)) {
+		THROW_HW_ERROR(Error) << "Camera::getValue(): " << command << " failed";
 	}
 }
 
-void Camera::getValue(string cmd, unsigned int& value) {
+void Camera::getValue(CommandCodec::Id id, unsigned int& value) {
 	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
 	string reply;
 
-	DEB_TRACE() << "Camera::getValue() sending command read " <<  cmd;
-	string command = "read " + cmd;
-	m_ultra->sendWait(command, reply);
-//	stringstream ss(reply);
-//	ss >> value;
-//	if (ss.fail() == true) {
-	if (sscanf(reply.c_str(), "%x", &value) != 1) {
-		THROW_HW_ERROR(Error) << "Camera::getValue(): sscanf failed to read";
+	CommandCodec::formatRead(command, id);
+	DEB_TRACE() << "Camera::getValue() sending command " <<  command;
+	readReply(command, reply);
+	if (!CommandCodec::parseHex(reply.c_str(), value)) {
+		THROW_HW_ERROR(Error) << "Camera::getValue(): " << command << " failed";
 	}
 }
 
-void Camera::setValue(string cmd) {
+void Camera::setValue(CommandCodec::Id id, float value, int board, int channel) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	sendSet(id, command, CommandCodec::formatSetVolts(command, id, value, board, channel));
+}
+
+void Camera::setValue(CommandCodec::Id id, unsigned int value) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	sendSet(id, command, CommandCodec::formatSetHex(command, id, value));
+}
+
+void Camera::setValue(CommandCodec::Id id, unsigned int value1, unsigned int value2) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	sendSet(id, command, CommandCodec::formatSetPair(command, id, value1, value2));
+}
+
+void Camera::setValue(CommandCodec::Id id) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	sendSet(id, command, CommandCodec::formatSet(command, id));
+}
+
+/*
+ * Send a formatted set command to the command head or to every head,
+ * length < 0 when the codec refused the value
+ */
+void Camera::sendSet(CommandCodec::Id id, const char* command, int length) {
 	DEB_MEMBER_FUNCT();
 	string reply;
 
-	DEB_TRACE() << "Camera::setValue() sending command set " <<  cmd;
-	string command = "set " + cmd;
-	m_ultra->sendWait(command, reply);
-	if (reply.compare("ACK\r\n") != 0) {
-		THROW_HW_ERROR(Error) << "Camera::setValue(): bad acknowledgement";
+	if (length < 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setValue(): invalid value for " << CommandCodec::describe(id).name;
+	}
+	DEB_TRACE() << "Camera::setValue() sending command " <<  command;
+	clearPrefetch();
+	string cmd(command, length);
+	for (size_t h=0; h<=m_heads.size(); h++) {
+		if (m_cmd_head >= 0 && int(h) != m_cmd_head)
+			continue;
+		getHead(h)->sendWait(cmd, reply);
+		if (!CommandCodec::isAck(reply.c_str())) {
+			THROW_HW_ERROR(Error) << "Camera::setValue(): bad acknowledgement from head " << h;
+		}
+	}
+}
+
+/*
+ * Read an ADC command for all the channels in one batch
+ */
+void Camera::getChannelValues(CommandCodec::Id id, vector<float>& values) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	int adcBoard, adcChannel;
+	vector<string> commands, replies;
+
+	for (int channel=0; channel<maxNumChannels; channel++) {
+		adcChanLookup(m_headType, channel, adcBoard, adcChannel);
+		CommandCodec::formatRead(command, id, adcBoard, adcChannel);
+		commands.push_back(command);
+	}
+	values.clear();
+	for (size_t h=0; h<=m_heads.size(); h++) {
+		if (m_cmd_head >= 0 && int(h) != m_cmd_head)
+			continue;
+		getHead(h)->sendWaitBatch(commands, replies);
+		for (size_t i=0; i<replies.size(); i++) {
+			float value;
+			if (!CommandCodec::parseVolts(replies[i].c_str(), value)) {
+				THROW_HW_ERROR(Error) << "Camera::getChannelValues(): " << commands[i] << " failed on head " << h;
+			}
+			values.push_back(value);
+		}
+	}
+}
+
+/*
+ * Send maxNumChannels values to the command head or to every head, or
+ * maxNumChannels values per head in line order
+ */
+void Camera::setChannelValues(CommandCodec::Id id, const vector<float>& values) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	int adcBoard, adcChannel;
+	vector<string> commands, replies;
+
+	if (m_cmd_head >= 0 && values.size() != (size_t) maxNumChannels) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setChannelValues(): expected " << maxNumChannels << " values";
+	}
+	clearPrefetch();
+	for (size_t h=0; h<=m_heads.size(); h++) {
+		if (m_cmd_head >= 0 && int(h) != m_cmd_head)
+			continue;
+		const float* head_values = &values[(values.size() == (size_t) maxNumChannels) ? 0 : h * maxNumChannels];
+		commands.clear();
+		for (int channel=0; channel<maxNumChannels; channel++) {
+			adcChanLookup(m_headType, channel, adcBoard, adcChannel);
+			int length = CommandCodec::formatSetVolts(command, id, head_values[channel], adcBoard, adcChannel);
+			if (length < 0) {
+				THROW_HW_ERROR(InvalidValue) << "Camera::setChannelValues(): invalid value " << head_values[channel];
+			}
+			commands.push_back(string(command, length));
+		}
+		getHead(h)->sendWaitBatch(commands, replies);
+		for (size_t i=0; i<replies.size(); i++) {
+			if (!CommandCodec::isAck(replies[i].c_str())) {
+				THROW_HW_ERROR(Error) << "Camera::setChannelValues(): bad acknowledgement for " << commands[i];
+			}
+		}
 	}
 }
 
@@ -883,3 +1572,1209 @@ void Camera::adcChanLookup(int headType, int channel, int &adcBoard, int &adcCha
 	}
 	return;
 }
+
+/*
+ * First pixel of a channel. The line holds one contiguous block of pixels
+ * per ADC input, ordered by ADC board then by input on the board, and
+ * adcChanLookup() gives the input of the channel.
+ */
+int Camera::getChannelPixel(int channel) {
+	int adcBoard, adcChannel;
+	adcChanLookup(m_headType, channel, adcBoard, adcChannel);
+	return (adcBoard * adcChannelsPerBoard + adcChannel) * (m_npixels / maxNumChannels);
+}
+
+void Camera::setSparseEnabled(bool state) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(state);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setSparseEnabled(): acquisition is running";
+	}
+	if (state && !m_heads.empty()) {
+		THROW_HW_ERROR(NotSupported) << "Camera::setSparseEnabled(): not available with several heads";
+	}
+	if (state == m_sparse_enabled)
+		return;
+	m_sparse_enabled = state;
+	Size size;
+	getDetectorImageSize(size);
+	maxImageSizeChanged(size, m_image_type);
+}
+
+void Camera::getSparseEnabled(bool& state) {
+	DEB_MEMBER_FUNCT();
+	state = m_sparse_enabled;
+}
+
+void Camera::setSparseCapacity(int nb_pixels) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_pixels);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setSparseCapacity(): acquisition is running";
+	}
+	m_sparse.setCapacity(nb_pixels);
+	if (!m_sparse_enabled)
+		return;
+	Size size;
+	getDetectorImageSize(size);
+	maxImageSizeChanged(size, m_image_type);
+}
+
+void Camera::getSparseCapacity(int& nb_pixels) {
+	DEB_MEMBER_FUNCT();
+	nb_pixels = m_sparse.getCapacity();
+	DEB_RETURN() << DEB_VAR1(nb_pixels);
+}
+
+/*
+ * Lines truncated to the capacity in the frames since startAcq()
+ */
+void Camera::getSparseOverflow(unsigned long long& nb_lines) {
+	DEB_MEMBER_FUNCT();
+	nb_lines = m_sparse_overflow;
+	DEB_RETURN() << DEB_VAR1(nb_lines);
+}
+
+void Camera::setSparseThreshold(unsigned short threshold) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(threshold);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setSparseThreshold(): acquisition is running";
+	}
+	m_sparse.setThreshold(threshold);
+}
+
+void Camera::getSparseThreshold(unsigned short& threshold) {
+	DEB_MEMBER_FUNCT();
+	m_sparse.getThreshold(threshold);
+}
+
+void Camera::setPixelSparseThreshold(int pixel, unsigned short threshold) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(pixel, threshold);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setPixelSparseThreshold(): acquisition is running";
+	}
+	m_sparse.setPixelThreshold(pixel, threshold);
+}
+
+void Camera::getPixelSparseThreshold(int pixel, unsigned short& threshold) {
+	DEB_MEMBER_FUNCT();
+	m_sparse.getPixelThreshold(pixel, threshold);
+}
+
+void Camera::setRawCapture(const std::string& filename, int size_mb) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(filename, size_mb);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setRawCapture(): acquisition is running";
+	}
+	m_ultra->setRawCapture(0);
+	m_raw_capture.close();
+	if (!filename.empty()) {
+		m_raw_capture.open(filename, (long long) size_mb * 1024 * 1024);
+		m_ultra->setRawCapture(&m_raw_capture);
+	}
+}
+
+void Camera::getRawCapture(std::string& filename) {
+	DEB_MEMBER_FUNCT();
+	m_raw_capture.getFilename(filename);
+}
+
+void Camera::setReplay(const std::string& filename, bool realtime) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(filename, realtime);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setReplay(): acquisition is running";
+	}
+	if (!filename.empty() && !m_heads.empty()) {
+		THROW_HW_ERROR(NotSupported) << "Camera::setReplay(): not available with several heads";
+	}
+	m_ultra->setReplay(0);
+	m_replay.close();
+	if (!filename.empty()) {
+		m_replay.open(filename, realtime);
+		m_ultra->setReplay(&m_replay);
+	}
+}
+
+void Camera::getReplay(std::string& filename) {
+	DEB_MEMBER_FUNCT();
+	m_replay.getFilename(filename);
+}
+
+void Camera::setHdf5Saving(const std::string& filename, int chunk_lines, int compression_level, int nb_threads) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(filename, chunk_lines, compression_level, nb_threads);
+#ifdef WITH_HDF5
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setHdf5Saving(): acquisition is running";
+	}
+	if (!filename.empty() && (chunk_lines <= 0 || compression_level < 0 || compression_level > 9 || nb_threads <= 0)) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setHdf5Saving(): invalid argument";
+	}
+	if (!filename.empty() && !isFilePattern(filename)) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setHdf5Saving(): the file name needs exactly one %d and no other conversion";
+	}
+	m_hdf5_filename = filename;
+	m_hdf5_chunk_lines = chunk_lines;
+	m_hdf5_level = compression_level;
+	m_hdf5_threads = nb_threads;
+	m_hdf5_file_nb = 0;
+#else
+	THROW_HW_ERROR(NotSupported) << "Camera::setHdf5Saving(): compiled without HDF5 support";
+#endif
+}
+
+void Camera::getHdf5Saving(std::string& filename) {
+	DEB_MEMBER_FUNCT();
+	filename = m_hdf5_filename;
+}
+
+void Camera::setHistogramEnabled(bool state) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(state);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setHistogramEnabled(): acquisition is running";
+	}
+	if (state && !m_heads.empty()) {
+		THROW_HW_ERROR(NotSupported) << "Camera::setHistogramEnabled(): not available with several heads";
+	}
+	m_histogram_enabled = state;
+}
+
+void Camera::getHistogramEnabled(bool& state) {
+	DEB_MEMBER_FUNCT();
+	state = m_histogram_enabled;
+}
+
+void Camera::setHistogramBinning(int nb_bins, int min_value, int bin_width) {
+	DEB_MEMBER_FUNCT();
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setHistogramBinning(): acquisition is running";
+	}
+	m_histogram.setBinning(nb_bins, min_value, bin_width);
+}
+
+void Camera::getHistogramBinning(int& nb_bins, int& min_value, int& bin_width) {
+	DEB_MEMBER_FUNCT();
+	m_histogram.getBinning(nb_bins, min_value, bin_width);
+}
+
+void Camera::setHistogramPerChannel(bool state) {
+	DEB_MEMBER_FUNCT();
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setHistogramPerChannel(): acquisition is running";
+	}
+	m_histogram.setPerChannel(state);
+}
+
+void Camera::getHistogramPerChannel(bool& state) {
+	DEB_MEMBER_FUNCT();
+	m_histogram.getPerChannel(state);
+}
+
+void Camera::setHistogramThreads(int nb_threads) {
+	DEB_MEMBER_FUNCT();
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setHistogramThreads(): acquisition is running";
+	}
+	m_histogram.setNbThreads(nb_threads);
+}
+
+void Camera::getHistogramThreads(int& nb_threads) {
+	DEB_MEMBER_FUNCT();
+	m_histogram.getNbThreads(nb_threads);
+}
+
+void Camera::getHistogramSize(int& nb_rows, int& nb_bins) {
+	DEB_MEMBER_FUNCT();
+	int min_value, bin_width;
+	m_histogram.getBinning(nb_bins, min_value, bin_width);
+	nb_rows = m_histogram.getNbRows();
+}
+
+void Camera::getHistogramNbLines(long long& nb_lines) {
+	DEB_MEMBER_FUNCT();
+	m_histogram.getNbLines(nb_lines);
+}
+
+void Camera::getHistogram(int row, std::vector<unsigned int>& counts) {
+	DEB_MEMBER_FUNCT();
+	m_histogram.getRow(row, counts);
+}
+
+void Camera::getHistograms(std::vector<unsigned int>& counts) {
+	DEB_MEMBER_FUNCT();
+	m_histogram.getAll(counts);
+}
+
+void Camera::resetHistogram() {
+	DEB_MEMBER_FUNCT();
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::resetHistogram(): acquisition is running";
+	}
+	m_histogram.reset();
+}
+
+/*
+ * Add a head received alongside the first one. Unless a command head is
+ * selected, the set commands are sent to every head and the read commands
+ * to the first one only.
+ */
+void Camera::addHead(std::string headname, std::string hostname, int tcpPort, int udpPort) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(headname, hostname, tcpPort, udpPort);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::addHead(): acquisition is running";
+	}
+	if (m_sparse_enabled || m_histogram_enabled || m_replay.isOpen()) {
+		THROW_HW_ERROR(NotSupported) << "Camera::addHead(): disable zero suppression, histograms and replay first";
+	}
+	UltraNet* net = new UltraNet();
+	try {
+		net->initServerDataPort(hostname, udpPort);
+		net->connectToServer(headname, tcpPort);
+		string reply;
+		net->sendWait("", reply);
+		if (reply.compare("!Command Not Recognised\r\n") != 0) {
+			THROW_HW_ERROR(Error) << "Camera::addHead(): Response is not \"!Command Not Recognised\"";
+		}
+	} catch (...) {
+		net->disconnectFromServer();
+		delete net;
+		throw;
+	}
+	net->setMetrics(&m_metrics);
+	if (m_heads.empty())
+		m_multi.addHead(m_ultra);
+	m_multi.addHead(net);
+	m_heads.push_back(net);
+	Size size;
+	getDetectorImageSize(size);
+	maxImageSizeChanged(size, m_image_type);
+}
+
+void Camera::getNbHeads(int& nb_heads) {
+	DEB_MEMBER_FUNCT();
+	nb_heads = m_heads.size() + 1;
+}
+
+void Camera::setHeadsTiled(bool state) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(state);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setHeadsTiled(): acquisition is running";
+	}
+	m_heads_tiled = state;
+	Size size;
+	getDetectorImageSize(size);
+	maxImageSizeChanged(size, m_image_type);
+}
+
+void Camera::getHeadsTiled(bool& state) {
+	DEB_MEMBER_FUNCT();
+	state = m_heads_tiled;
+}
+
+/*
+ * Position in the image of the first pixel of a head, its npixels follow
+ * on the same row
+ */
+void Camera::getHeadOrigin(int head, int& x, int& y) {
+	DEB_MEMBER_FUNCT();
+	if (head < 0 || head > int(m_heads.size())) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getHeadOrigin(): head is outside of range";
+	}
+	x = (m_heads_tiled) ? 0 : head * m_npixels;
+	y = (m_heads_tiled) ? head : 0;
+}
+
+void Camera::setCommandHead(int head) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(head);
+	if (head < -1 || head > int(m_heads.size())) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setCommandHead(): head is outside of range";
+	}
+	clearPrefetch();
+	m_cmd_head = head;
+}
+
+void Camera::getCommandHead(int& head) {
+	DEB_MEMBER_FUNCT();
+	head = m_cmd_head;
+}
+
+/*
+ * Head in the line order, the first one is the camera own connection
+ */
+UltraNet* Camera::getHead(int head) {
+	return (head == 0) ? m_ultra : m_heads[head-1];
+}
+
+void Camera::getUnmatchedFrames(int head, unsigned long long& count) {
+	DEB_MEMBER_FUNCT();
+	if (m_heads.empty()) {
+		count = 0;
+		return;
+	}
+	m_multi.getUnmatched(head, count);
+}
+
+void Camera::setReceiveShards(int nb_shards, int first_cpu) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(nb_shards, first_cpu);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setReceiveShards(): acquisition is running";
+	}
+	if (nb_shards <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setReceiveShards(): invalid number of shards";
+	}
+	int datagram_size = m_npixels * sizeof(short) + 6;
+	for (size_t h=0; h<=m_heads.size(); h++) {
+		UltraNet* net = (h == 0) ? m_ultra : m_heads[h-1];
+		int first = (first_cpu < 0) ? -1 : first_cpu + h * nb_shards;
+		net->setReceiveShards(nb_shards, first, datagram_size);
+	}
+	m_receive_first_cpu = first_cpu;
+	updateBufferNumaNode();
+}
+
+void Camera::getReceiveShards(int& nb_shards) {
+	DEB_MEMBER_FUNCT();
+	nb_shards = m_ultra->getReceiveShards();
+}
+
+void Camera::setReceiveBufferSize(int size) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(size);
+	for (size_t h=0; h<=m_heads.size(); h++) {
+		UltraNet* net = (h == 0) ? m_ultra : m_heads[h-1];
+		net->setRcvBuf(size);
+	}
+}
+
+/*
+ * Size the receive buffer to hold stall_time seconds of lines at line_rate
+ * lines per second, the kernel charges about twice the datagram size.
+ */
+void Camera::setReceiveBufferStall(double line_rate, double stall_time) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(line_rate, stall_time);
+	if (line_rate <= 0 || stall_time <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setReceiveBufferStall(): invalid argument";
+	}
+	double size = line_rate * stall_time * (m_npixels * sizeof(short) + 6) * skbOverhead;
+	if (size > INT_MAX) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setReceiveBufferStall(): " << size << " bytes is too large";
+	}
+	setReceiveBufferSize((int) size);
+}
+
+void Camera::getReceiveBufferSize(int& requested, int& granted) {
+	DEB_MEMBER_FUNCT();
+	m_ultra->getRcvBuf(requested, granted);
+}
+
+void Camera::getKernelDrops(unsigned long long& drops) {
+	DEB_MEMBER_FUNCT();
+	drops = m_ultra->getKernelDrops();
+	for (size_t h=0; h<m_heads.size(); h++)
+		drops += m_heads[h]->getKernelDrops();
+}
+
+void Camera::setCommandTimeout(double timeout) {
+	DEB_MEMBER_FUNCT();
+	m_ultra->setCommandTimeout(timeout);
+	for (size_t h=0; h<m_heads.size(); h++)
+		m_heads[h]->setCommandTimeout(timeout);
+}
+
+void Camera::getCommandTimeout(double& timeout) {
+	DEB_MEMBER_FUNCT();
+	timeout = m_ultra->getCommandTimeout();
+}
+
+void Camera::setAutoReconnect(bool enabled) {
+	DEB_MEMBER_FUNCT();
+	m_ultra->setReconnect(enabled, reconnectBackoffMin, reconnectBackoffMax);
+	for (size_t h=0; h<m_heads.size(); h++)
+		m_heads[h]->setReconnect(enabled, reconnectBackoffMin, reconnectBackoffMax);
+}
+
+void Camera::getAutoReconnect(bool& enabled) {
+	DEB_MEMBER_FUNCT();
+	enabled = m_ultra->getReconnect();
+}
+
+/*
+ * Outages of all the heads, last_time is the longest of the last ones
+ */
+void Camera::getOutages(int& count, double& total_time, double& last_time) {
+	DEB_MEMBER_FUNCT();
+	m_ultra->getOutages(count, total_time, last_time);
+	for (size_t h=0; h<m_heads.size(); h++) {
+		int c;
+		double total, last;
+		m_heads[h]->getOutages(c, total, last);
+		count += c;
+		total_time += total;
+		if (last > last_time)
+			last_time = last;
+	}
+}
+
+void Camera::getMetricsCounters(std::vector<unsigned long long>& values) {
+	DEB_MEMBER_FUNCT();
+	values.resize(Metrics::NbCounters);
+	for (int i=0; i<Metrics::NbCounters; i++)
+		values[i] = m_metrics.get(Metrics::Counter(i));
+}
+
+void Camera::getMetricsLatency(int stage, std::vector<unsigned long long>& counts) {
+	DEB_MEMBER_FUNCT();
+	if (stage < 0 || stage >= Metrics::NbStages) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getMetricsLatency(): invalid stage";
+	}
+	m_metrics.getLatency(Metrics::Stage(stage), counts);
+}
+
+void Camera::resetMetrics() {
+	DEB_MEMBER_FUNCT();
+	m_metrics.reset();
+}
+
+void Camera::setMetricsDump(const std::string& filename, double period) {
+	DEB_MEMBER_FUNCT();
+	m_metrics.startDump(filename, period);
+}
+
+void Camera::getMetricsDump(std::string& filename) {
+	DEB_MEMBER_FUNCT();
+	m_metrics.getDump(filename);
+}
+
+/*
+ * Host counters, read without blocking
+ */
+void Camera::takeSnapshot(Snapshot& snap) {
+	snap.received = m_metrics.get(Metrics::PacketsReceived);
+	getKernelDrops(snap.kernel_drops);
+	snap.gaps = m_metrics.get(Metrics::SequenceGaps);
+	snap.frames_ready = m_metrics.get(Metrics::FramesReady);
+	snap.lines = m_metrics.get(Metrics::LinesRead);
+	snap.discarded = m_metrics.get(Metrics::LinesDiscarded);
+	snap.filtered = m_metrics.get(Metrics::LinesFiltered);
+	snap.time = Timestamp::now();
+}
+
+/*
+ * FPGA counters of every head, read with one batched exchange per head
+ */
+void Camera::readFpgaCounters(Snapshot& snap) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	vector<string> cmds, replies;
+
+	CommandCodec::formatRead(command, CommandCodec::FpgaFrame);
+	cmds.push_back(command);
+	CommandCodec::formatRead(command, CommandCodec::FpgaError);
+	cmds.push_back(command);
+	snap.fpga_valid = !m_headname.empty() && !m_replay.isOpen();
+	snap.fpga_frames = 0;
+	snap.fpga_errors = 0;
+	for (size_t h=0; snap.fpga_valid && h<=m_heads.size(); h++) {
+		UltraNet* net = (h == 0) ? m_ultra : m_heads[h-1];
+		unsigned int frames, errors;
+		try {
+			net->sendWaitBatch(cmds, replies);
+		} catch (Exception& e) {
+			DEB_WARNING() << "cannot read the FPGA counters: " << e.getErrMsg();
+			snap.fpga_valid = false;
+			break;
+		}
+		if (!CommandCodec::parseHex(replies[0].c_str(), frames) || !CommandCodec::parseHex(replies[1].c_str(), errors)) {
+			DEB_WARNING() << "cannot read the FPGA counters";
+			snap.fpga_valid = false;
+			break;
+		}
+		snap.fpga_frames += frames;
+		snap.fpga_errors += errors;
+	}
+}
+
+/*
+ * The losses are attributed to the head (FPGA errors), to the network
+ * (datagrams sent that never reached the socket, summed over the heads on
+ * both sides) and to the host (kernel socket drops and assembled lines
+ * neither handed to Lima nor discarded on purpose nor of a type not kept).
+ */
+void Camera::formatSummary(int acq_nb, const Snapshot& start, const Snapshot& end, std::string& summary) {
+	DEB_MEMBER_FUNCT();
+	stringstream ss;
+	unsigned long long received = end.received - start.received;
+	unsigned long long drops = end.kernel_drops - start.kernel_drops;
+	unsigned long long ready = end.frames_ready - start.frames_ready;
+	unsigned long long lines = end.lines - start.lines;
+	unsigned long long discarded = end.discarded - start.discarded;
+	unsigned long long filtered = end.filtered - start.filtered;
+
+	ss << "acq=" << acq_nb << " duration=" << fixed << setprecision(3) << end.time - start.time;
+	if (start.fpga_valid && end.fpga_valid) {
+		// the FPGA counters are 32 bit and wrap
+		unsigned int sent = end.fpga_frames - start.fpga_frames;
+		unsigned int errors = end.fpga_errors - start.fpga_errors;
+		long long network = (long long) sent - (long long) (received + drops);
+		ss << " fpga_frames=" << sent << " fpga_errors=" << errors;
+		ss << " head_losses=" << errors << " network_losses=" << ((network > 0) ? network : 0);
+	} else {
+		ss << " fpga_frames=? fpga_errors=? head_losses=? network_losses=?";
+	}
+	ss << " received=" << received << " kernel_drops=" << drops << " sequence_gaps=" << end.gaps - start.gaps
+			<< " lines=" << lines << " discarded=" << discarded << " filtered=" << filtered << " frames_ready=" << ready;
+	unsigned long long handled = ready + discarded + filtered;
+	ss << " host_losses=" << drops + ((lines > handled) ? lines - handled : 0);
+	summary = ss.str();
+}
+
+/*
+ * Called by the acquisition thread once Idle, the FPGA counters are read
+ * then
+ */
+void Camera::endAcqSummary(int acq_nb, const Snapshot& start, Snapshot& end) {
+	DEB_MEMBER_FUNCT();
+	string summary;
+	readFpgaCounters(end);
+	formatSummary(acq_nb, start, end, summary);
+	DEB_TRACE() << summary;
+	AutoMutex aLock(m_cond.mutex());
+	m_acq_summary = summary;
+	if (m_acq_summary_file.empty())
+		return;
+	FILE* fp = fopen(m_acq_summary_file.c_str(), "a");
+	if (!fp) {
+		DEB_ERROR() << "cannot open " << m_acq_summary_file;
+		return;
+	}
+	fprintf(fp, "%ld %s\n", (long) time(0), summary.c_str());
+	fclose(fp);
+}
+
+void Camera::getAcqSummary(std::string& summary) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	summary = m_acq_summary;
+}
+
+/*
+ * Accounting since the current (or last) acquisition started, to be
+ * polled during long acquisitions
+ */
+void Camera::reconcile(std::string& summary) {
+	DEB_MEMBER_FUNCT();
+	Snapshot now;
+	readFpgaCounters(now);
+	takeSnapshot(now);
+	formatSummary(m_acq_nb, m_acq_start, now, summary);
+}
+
+void Camera::setAcqSummaryFile(const std::string& filename) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(filename);
+	AutoMutex aLock(m_cond.mutex());
+	m_acq_summary_file = filename;
+}
+
+void Camera::getAcqSummaryFile(std::string& filename) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	filename = m_acq_summary_file;
+}
+
+void Camera::clearScanTable() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::clearScanTable(): acquisition running";
+	}
+	m_scan_table.clear();
+}
+
+void Camera::addScanPoint(int nb_lines, const std::vector<std::string>& settings) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(nb_lines, settings.size());
+	AutoMutex aLock(m_cond.mutex());
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::addScanPoint(): acquisition running";
+	}
+	if (nb_lines <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::addScanPoint(): invalid number of lines";
+	}
+	ScanPoint point;
+	point.nb_lines = nb_lines;
+	point.settings = settings;
+	m_scan_table.push_back(point);
+}
+
+void Camera::getNbScanPoints(int& nb_points) {
+	DEB_MEMBER_FUNCT();
+	nb_points = m_scan_table.size();
+}
+
+/*
+ * Lima frame number of the first line of each point, the lines dropped
+ * between the points are not numbered
+ */
+void Camera::getScanFirstFrames(std::vector<int>& first_frames) {
+	DEB_MEMBER_FUNCT();
+	int first = 0;
+	first_frames.clear();
+	for (size_t i=0; i<m_scan_table.size(); i++) {
+		first_frames.push_back(first);
+		first += m_scan_table[i].nb_lines;
+	}
+}
+
+void Camera::setScanSettleLines(int nb_lines) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_lines);
+	if (nb_lines < 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setScanSettleLines(): invalid number of lines";
+	}
+	m_scan_settle_lines = nb_lines;
+}
+
+void Camera::getScanSettleLines(int& nb_lines) {
+	DEB_MEMBER_FUNCT();
+	nb_lines = m_scan_settle_lines;
+}
+
+void Camera::getScanStatus(int& point, unsigned long long& dropped_lines) {
+	DEB_MEMBER_FUNCT();
+	point = m_scan_point;
+	dropped_lines = m_scan_dropped;
+}
+
+/*
+ * Check and format the settings of every point, the acquisition must
+ * take exactly the lines of the table
+ */
+void Camera::encodeScanTable() {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	int nb_lines = 0;
+
+	if (m_headname.empty() || m_replay.isOpen()) {
+		THROW_HW_ERROR(Error) << "Camera::prepareAcq(): a scan needs a head";
+	}
+	for (size_t i=0; i<m_scan_table.size(); i++) {
+		ScanPoint& point = m_scan_table[i];
+		point.commands.clear();
+		for (size_t j=0; j<point.settings.size(); j++) {
+			int length = CommandCodec::formatSetting(command, point.settings[j].c_str());
+			if (length < 0) {
+				THROW_HW_ERROR(InvalidValue) << "Camera::prepareAcq(): scan point " << i << ": invalid setting \""
+						<< point.settings[j] << "\"";
+			}
+			point.commands.push_back(string(command, length));
+		}
+		nb_lines += point.nb_lines;
+	}
+	if (m_nb_frames != nb_lines) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::prepareAcq(): the scan table takes " << nb_lines
+				<< " lines, " << m_nb_frames << " frames requested";
+	}
+}
+
+/*
+ * The first point is set before the acquisition starts
+ */
+void Camera::startScan() {
+	DEB_MEMBER_FUNCT();
+	vector<string> replies;
+
+	m_scan_point = 0;
+	m_scan_next_frame = m_scan_table[0].nb_lines;
+	m_scan_dropped = 0;
+	m_scan_state = ScanApplied;
+	m_scan_replies.clear();
+	clearPrefetch();
+	for (size_t h=0; h<=m_heads.size(); h++) {
+		UltraNet* net = (h == 0) ? m_ultra : m_heads[h-1];
+		net->sendWaitBatch(m_scan_table[0].commands, replies);
+		for (size_t i=0; i<replies.size(); i++) {
+			if (!CommandCodec::isAck(replies[i].c_str())) {
+				THROW_HW_ERROR(Error) << "Camera::startAcq(): bad acknowledgement for " << m_scan_table[0].commands[i];
+			}
+		}
+	}
+}
+
+/*
+ * Queue the settings of the next point on every head without waiting,
+ * updateScan() then drops the lines until they are all acknowledged
+ */
+void Camera::startScanTransition() {
+	DEB_MEMBER_FUNCT();
+	if (m_scan_point + 1 >= (int) m_scan_table.size())
+		return;
+	const ScanPoint& point = m_scan_table[++m_scan_point];
+	DEB_TRACE() << "scan point " << m_scan_point;
+	m_scan_next_frame += point.nb_lines;
+	m_scan_replies.clear();
+	clearPrefetch();
+	try {
+		for (size_t h=0; h<=m_heads.size(); h++) {
+			UltraNet* net = (h == 0) ? m_ultra : m_heads[h-1];
+			for (size_t i=0; i<point.commands.size(); i++)
+				m_scan_replies.push_back(net->sendAsync(point.commands[i]));
+		}
+	} catch (Exception& e) {
+		DEB_ERROR() << "scan point " << m_scan_point << ": " << e.getErrMsg();
+		m_scan_state = ScanFailed;
+		return;
+	}
+	m_scan_state = ScanSetting;
+}
+
+/*
+ * Called before each line, true when the line belongs to the current point
+ */
+bool Camera::updateScan() {
+	DEB_MEMBER_FUNCT();
+	if (m_scan_state == ScanSetting) {
+		for (size_t i=0; i<m_scan_replies.size(); i++) {
+			if (m_scan_replies[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return false;
+		}
+		for (size_t i=0; i<m_scan_replies.size(); i++) {
+			string reply;
+			try {
+				reply = m_scan_replies[i].get();
+			} catch (Exception& e) {
+				reply = e.getErrMsg();
+			}
+			if (!CommandCodec::isAck(reply.c_str())) {
+				DEB_ERROR() << "scan point " << m_scan_point << ": bad acknowledgement " << reply;
+				m_scan_state = ScanFailed;
+				return false;
+			}
+		}
+		m_scan_replies.clear();
+		m_scan_settle_left = m_scan_settle_lines;
+		m_scan_state = ScanSettling;
+	}
+	if (m_scan_state == ScanSettling) {
+		if (m_scan_settle_left > 0) {
+			m_scan_settle_left--;
+			return false;
+		}
+		m_scan_state = ScanApplied;
+	}
+	return m_scan_state == ScanApplied;
+}
+
+/*
+ * Pin frames still held by the Lima buffers. The pin is announced
+ * before reading the frame count, the acquisition thread then checks
+ * the pins under the lock, but it may have started writing the next
+ * two frames, so their buffers are refused.
+ */
+void Camera::pinFrames(long long first_frame, int nb_frames, int& pin) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(first_frame, nb_frames);
+	int nb_slots = m_bufferCtrlObj.getNbSlots();
+	AutoMutex aLock(m_cond.mutex());
+	m_nb_pins = m_pins.size() + 1;
+	long long acquired = m_acq_frame_nb;
+	if (nb_frames <= 0 || first_frame < 0 || first_frame + nb_frames > acquired) {
+		m_nb_pins = m_pins.size();
+		THROW_HW_ERROR(InvalidValue) << "Camera::pinFrames(): frames " << first_frame << " to "
+				<< first_frame + nb_frames - 1 << " not acquired, " << acquired << " frames acquired";
+	}
+	if (first_frame <= acquired + 1 - nb_slots) {
+		m_nb_pins = m_pins.size();
+		THROW_HW_ERROR(InvalidValue) << "Camera::pinFrames(): frame " << first_frame << " already overwritten";
+	}
+	PinnedRange range;
+	range.first_frame = first_frame;
+	range.nb_frames = nb_frames;
+	range.overwritten = false;
+	pin = m_next_pin++;
+	m_pins[pin] = range;
+	m_nb_pins = m_pins.size();
+	DEB_RETURN() << DEB_VAR1(pin);
+}
+
+void Camera::unpinFrames(int pin) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(pin);
+	AutoMutex aLock(m_cond.mutex());
+	if (m_pins.erase(pin) == 0) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::unpinFrames(): unknown pin " << pin;
+	}
+	m_nb_pins = m_pins.size();
+	m_cond.broadcast();
+}
+
+void Camera::getPinnedChunks(int pin, std::vector<void*>& ptrs, std::vector<int>& sizes) {
+	DEB_MEMBER_FUNCT();
+	FrameDim frame_dim;
+	m_bufferCtrlObj.getFrameDim(frame_dim);
+	int frame_size = frame_dim.getMemSize();
+	AutoMutex aLock(m_cond.mutex());
+	std::map<int, PinnedRange>::iterator it = m_pins.find(pin);
+	if (it == m_pins.end()) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getPinnedChunks(): unknown pin " << pin;
+	}
+	if (it->second.overwritten) {
+		THROW_HW_ERROR(Error) << "Camera::getPinnedChunks(): pinned frames overwritten";
+	}
+	ptrs.clear();
+	sizes.clear();
+	long long frame_nb = it->second.first_frame;
+	long long end = frame_nb + it->second.nb_frames;
+	while (frame_nb < end) {
+		int run = m_bufferCtrlObj.getSlotRun(frame_nb, end - frame_nb);
+		ptrs.push_back(m_bufferCtrlObj.getSlot(frame_nb));
+		sizes.push_back(run * frame_size);
+		frame_nb += run;
+	}
+}
+
+/*
+ * Called by the acquisition thread before writing a frame over a pinned
+ * one, or over one Lima has not released: wait for the unpin or the
+ * release, overwrite it or drop the new line, depending on the ring policy
+ */
+Camera::SlotWait Camera::waitPinnedBuffer(long long frame_nb, int nb_slots) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	long long overwritten = frame_nb - nb_slots;
+	bool counted = false;
+	for (;;) {
+		std::map<int, PinnedRange>::iterator pinned = m_pins.end();
+		for (std::map<int, PinnedRange>::iterator it = m_pins.begin(); it != m_pins.end(); ++it) {
+			if (overwritten >= it->second.first_frame &&
+					overwritten < it->second.first_frame + it->second.nb_frames && !it->second.overwritten)
+				pinned = it;
+		}
+		bool held = m_release_tracking && overwritten > m_released_frame;
+		if (pinned == m_pins.end() && !held)
+			return SlotFree;
+		if (m_quit || m_state != Running)
+			return SlotStopped;
+		if (m_ring_policy == RingOverwriteOldest) {
+			DEB_TRACE() << "frame " << frame_nb << " overwrites frame " << overwritten;
+			if (pinned != m_pins.end()) {
+				pinned->second.overwritten = true;
+				m_ring_overwritten += pinned->second.nb_frames;
+				counted = true;
+				continue;
+			}
+			if (!counted)
+				m_ring_overwritten++;
+			return SlotFree;
+		}
+		if (m_ring_policy == RingDropNewest)
+			return SlotBusy;
+		DEB_TRACE() << "frame " << frame_nb << " waits for frame " << overwritten;
+		m_cond.wait();
+	}
+}
+
+void Camera::checkNoPins() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_pins.empty()) {
+		THROW_HW_ERROR(Error) << "Camera: " << m_pins.size() << " frame ranges still pinned";
+	}
+}
+
+/*
+ * Read the commands in one exchange and keep the replies for the
+ * getters, until a value is set or for prefetchLifetime at most
+ */
+void Camera::prefetchValues(const std::vector<std::string>& names) {
+	DEB_MEMBER_FUNCT();
+	char command[CommandCodec::maxLength];
+	vector<string> commands, replies;
+
+	for (size_t i=0; i<names.size(); i++) {
+		CommandCodec::Id id;
+		int board, channel;
+		if (!CommandCodec::lookup(names[i].c_str(), id, board, channel) ||
+				CommandCodec::describe(id).format == CommandCodec::NoValue) {
+			THROW_HW_ERROR(InvalidValue) << "Camera::prefetchValues(): unknown command " << names[i];
+		}
+		CommandCodec::formatRead(command, id, board, channel);
+		commands.push_back(command);
+	}
+	getHead(m_cmd_head > 0 ? m_cmd_head : 0)->sendWaitBatch(commands, replies);
+	AutoMutex aLock(m_prefetch_lock);
+	m_prefetch.clear();
+	for (size_t i=0; i<commands.size(); i++)
+		m_prefetch[commands[i]] = replies[i];
+	m_prefetch_time = Metrics::now();
+}
+
+void Camera::clearPrefetch() {
+	AutoMutex aLock(m_prefetch_lock);
+	m_prefetch.clear();
+}
+
+void Camera::readReply(const char* command, std::string& reply) {
+	{
+		AutoMutex aLock(m_prefetch_lock);
+		std::map<string, string>::iterator it = m_prefetch.find(command);
+		if (it != m_prefetch.end() && Metrics::now() - m_prefetch_time < prefetchLifetime) {
+			reply = it->second;
+			return;
+		}
+	}
+	getHead(m_cmd_head > 0 ? m_cmd_head : 0)->sendWait(command, reply);
+}
+
+void Camera::registerEventCallback(EventCallback& cb) {
+	DEB_MEMBER_FUNCT();
+	m_events.registerCallback(cb);
+}
+
+void Camera::unregisterEventCallback(EventCallback& cb) {
+	DEB_MEMBER_FUNCT();
+	m_events.unregisterCallback(cb);
+}
+
+void Camera::setTelemetryEvents(const std::vector<std::string>& names, const std::vector<double>& deadbands,
+		double period, double heartbeat) {
+	DEB_MEMBER_FUNCT();
+	m_events.setTelemetry(m_headname.empty() ? 0 : m_ultra, names, deadbands, period, heartbeat);
+}
+
+void Camera::getTelemetryEvents(std::vector<std::string>& names, std::vector<double>& deadbands,
+		double& period, double& heartbeat) {
+	DEB_MEMBER_FUNCT();
+	m_events.getTelemetry(names, deadbands, period, heartbeat);
+}
+
+void Camera::setDataReadyFrames(int nb_frames) {
+	DEB_MEMBER_FUNCT();
+	m_events.setDataReadyPeriod(nb_frames);
+}
+
+void Camera::getDataReadyFrames(int& nb_frames) {
+	DEB_MEMBER_FUNCT();
+	nb_frames = m_events.getDataReadyPeriod();
+}
+
+void Camera::getEventCounts(unsigned long long& telemetry, unsigned long long& data_ready, unsigned long long& errors) {
+	DEB_MEMBER_FUNCT();
+	m_events.getCounts(telemetry, data_ready, errors);
+}
+
+void Camera::setRingPolicy(RingPolicy policy) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(policy);
+	AutoMutex aLock(m_cond.mutex());
+	m_ring_policy = policy;
+	m_cond.broadcast();
+}
+
+void Camera::getRingPolicy(RingPolicy& policy) {
+	DEB_MEMBER_FUNCT();
+	policy = m_ring_policy;
+}
+
+/*
+ * The frames still in the buffers, the oldest being overwritten by
+ * the next line
+ */
+void Camera::getRingWindow(long long& first_frame, int& nb_frames) {
+	DEB_MEMBER_FUNCT();
+	long long acquired = m_acq_frame_nb;
+	int nb_slots = m_bufferCtrlObj.getNbSlots();
+	first_frame = (acquired > nb_slots) ? acquired - nb_slots : 0;
+	nb_frames = (acquired > 0) ? acquired - first_frame : 0;
+	DEB_RETURN() << DEB_VAR2(first_frame, nb_frames);
+}
+
+void Camera::getRingCounters(unsigned long long& overwritten, unsigned long long& dropped) {
+	DEB_MEMBER_FUNCT();
+	overwritten = m_ring_overwritten;
+	dropped = m_ring_dropped;
+}
+
+void Camera::setReleaseTracking(bool enabled) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(enabled);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setReleaseTracking(): acquisition is running";
+	}
+	m_release_tracking = enabled;
+}
+
+void Camera::getReleaseTracking(bool& enabled) {
+	DEB_MEMBER_FUNCT();
+	enabled = m_release_tracking;
+}
+
+/*
+ * Lima is done with the frames up to last_frame, a Lima frame number.
+ * The frames not yet released are at most one ring behind the last
+ * acquired, well within a wrap of the Lima numbers.
+ */
+void Camera::releaseFrames(int last_frame) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(last_frame);
+	AutoMutex aLock(m_cond.mutex());
+	long long acquired = m_acq_frame_nb;
+	if (acquired <= 0 || last_frame < 0)
+		return;
+	long long frame_nb = acquired - 1 - (limaFrame(acquired - 1) - last_frame + m_lima_wrap) % m_lima_wrap;
+	if (frame_nb > m_released_frame) {
+		m_released_frame = frame_nb;
+		m_cond.broadcast();
+	}
+}
+
+/*
+ * Program the gate or start/stop sync of the head for the trigger mode, the
+ * FPGA only sends the lines of the gates so none are received and dropped.
+ * The gated modes force the sync on, the internal ones give it back its
+ * setSyncEnabled() state. The aux outputs keep their setAux1/2() delay and width.
+ */
+void Camera::applyTrigMode() {
+	DEB_MEMBER_FUNCT();
+	if (m_headname.empty() || m_replay.isOpen())
+		return;
+	unsigned int reg, sync;
+	bool gated = (m_trigger_mode == ExtGate || m_trigger_mode == ExtStartStop);
+	getFpgaSyncReg(reg);
+	sync = reg & ~(SYNCGATEMASK | SYNCSTARTSTOPMASK);
+	if (gated && !m_sync_forced)
+		m_sync_enabled = (reg & SYNCENABLEMASK) ? true : false;
+	if (!gated && m_sync_forced)
+		sync = (m_sync_enabled) ? (sync | SYNCENABLEMASK) : (sync & ~SYNCENABLEMASK);
+	m_sync_forced = gated;
+	if (m_trigger_mode == ExtGate)
+		sync |= SYNCENABLEMASK | SYNCGATEMASK;
+	else if (m_trigger_mode == ExtStartStop)
+		sync |= SYNCENABLEMASK | SYNCSTARTSTOPMASK;
+	DEB_TRACE() << DEB_VAR3(m_trigger_mode, reg, sync);
+	if (sync != reg)
+		setFpgaSyncReg(sync);
+}
+
+void Camera::getFrameGates(long long first_frame, int nb_frames, std::vector<int>& gates) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(first_frame, nb_frames);
+	long long window_first;
+	int window_nb;
+	getRingWindow(window_first, window_nb);
+	if (nb_frames < 0 || first_frame < window_first || first_frame + nb_frames > window_first + window_nb) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getFrameGates(): frames not in the ring window";
+	}
+	AutoMutex aLock(m_gate_lock);
+	int nb_slots = m_frame_gates.size();
+	gates.resize(nb_frames);
+	for (int f=0; f<nb_frames; f++)
+		gates[f] = m_frame_gates[(first_frame + f) % nb_slots];
+}
+
+void Camera::getNbGates(unsigned long long& nb_gates) {
+	DEB_MEMBER_FUNCT();
+	nb_gates = m_nb_gates;
+	DEB_RETURN() << DEB_VAR1(nb_gates);
+}
+
+void Camera::setLineTypeKept(LineType type, bool kept) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(type, kept);
+	if (type < 0 || type >= nbLineTypes) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::setLineTypeKept(): unknown line type " << type;
+	}
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setLineTypeKept(): acquisition is running";
+	}
+	m_line_kept[type] = kept;
+}
+
+void Camera::getLineTypeKept(LineType type, bool& kept) {
+	DEB_MEMBER_FUNCT();
+	if (type < 0 || type >= nbLineTypes) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getLineTypeKept(): unknown line type " << type;
+	}
+	kept = m_line_kept[type];
+	DEB_RETURN() << DEB_VAR1(kept);
+}
+
+/*
+ * Lines received by type since startAcq(), the last count is the lines of
+ * unknown types
+ */
+void Camera::getLineTypeCounts(std::vector<unsigned long long>& counts) {
+	DEB_MEMBER_FUNCT();
+	counts.resize(nbLineTypes + 1);
+	for (int t=0; t<=nbLineTypes; t++)
+		counts[t] = m_line_counts[t].load(std::memory_order_relaxed);
+}
+
+void Camera::getLastLine(LineType type, std::vector<unsigned short>& line) {
+	DEB_MEMBER_FUNCT();
+	if (type <= DataLine || type >= nbLineTypes) {
+		THROW_HW_ERROR(InvalidValue) << "Camera::getLastLine(): no line kept aside for type " << type;
+	}
+	AutoMutex aLock(m_line_lock);
+	line = m_last_lines[type];
+}
+
+void Camera::setCalibCorrection(bool enabled) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(enabled);
+	if (isAcqRunning()) {
+		THROW_HW_ERROR(Error) << "Camera::setCalibCorrection(): acquisition is running";
+	}
+	m_calib_correction = enabled;
+}
+
+void Camera::getCalibCorrection(bool& enabled) {
+	DEB_MEMBER_FUNCT();
+	enabled = m_calib_correction;
+	DEB_RETURN() << DEB_VAR1(enabled);
+}
+
+void Camera::setCalibWindow(int nb_lines) {
+	DEB_MEMBER_FUNCT();
+	m_calibration.setWindow(nb_lines);
+}
+
+void Camera::getCalibWindow(int& nb_lines) {
+	DEB_MEMBER_FUNCT();
+	m_calibration.getWindow(nb_lines);
+}
+
+void Camera::setCalibReference(double amplitude) {
+	DEB_MEMBER_FUNCT();
+	m_calibration.setReference(amplitude);
+}
+
+void Camera::getCalibReference(double& amplitude) {
+	DEB_MEMBER_FUNCT();
+	m_calibration.getReference(amplitude);
+}
+
+void Camera::resetCalibEstimates() {
+	DEB_MEMBER_FUNCT();
+	m_calibration.reset();
+}
+
+void Camera::getCalibEstimates(std::vector<double>& gains, std::vector<double>& offsets, std::vector<double>& noise) {
+	DEB_MEMBER_FUNCT();
+	m_calibration.getEstimates(gains, offsets, noise);
+}
+
+void Camera::getCalibLines(unsigned long long& calibration, unsigned long long& pedestal) {
+	DEB_MEMBER_FUNCT();
+	m_calibration.getNbLines(calibration, pedestal);
+}
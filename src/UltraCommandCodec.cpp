@@ -0,0 +1,310 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraCommandCodec.cpp
+// Created on: Oct 19, 2026
+
+#include <cstdio>
+#include <cstdlib>
+#include "UltraCommandCodec.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+
+// in CommandCodec::Id order
+static const CommandCodec::Descriptor descriptors[CommandCodec::NbCommands] = {
+	{ "coldtemp",		0,		CommandCodec::Volts,	false },
+	{ "hottemp",		0,		CommandCodec::Volts,	false },
+	{ "tectemp",		0,		CommandCodec::Volts,	false },
+	{ "tecsup",			0,		CommandCodec::Volts,	false },
+	{ "psupvadc",		0,		CommandCodec::Volts,	false },
+	{ "psunvadc",		0,		CommandCodec::Volts,	false },
+	{ "psupvin",		0,		CommandCodec::Volts,	false },
+	{ "psunvin",		0,		CommandCodec::Volts,	false },
+	{ "headvccadc",		0,		CommandCodec::Volts,	false },
+	{ "headvcc",		0,		CommandCodec::Volts,	true },
+	{ "headvref",		0,		CommandCodec::Volts,	true },
+	{ "headvrefc",		0,		CommandCodec::Volts,	true },
+	{ "headvpupref",	0,		CommandCodec::Volts,	true },
+	{ "headvclamp",		0,		CommandCodec::Volts,	true },
+	{ "headvres1",		0,		CommandCodec::Volts,	true },
+	{ "headvres2",		0,		CommandCodec::Volts,	true },
+	{ "headtrip",		0,		CommandCodec::Volts,	true },
+	{ "fpgaxchip",		0,		CommandCodec::Hex,		true },
+	{ "fpgapwr",		0,		CommandCodec::Hex,		true },
+	{ "fpgasync",		0,		CommandCodec::Hex,		true },
+	{ "fpgaadc",		0,		CommandCodec::Hex,		true },
+	{ "fpgaframe",		0,		CommandCodec::Hex,		false },
+	{ "fpgaerror",		0,		CommandCodec::Hex,		false },
+	{ "fpgaaux1",		0,		CommandCodec::Pair,		true },
+	{ "fpgaaux2",		0,		CommandCodec::Pair,		true },
+	{ "fpgarst",		0,		CommandCodec::Pair,		true },
+	{ "fpgas1",			0,		CommandCodec::Pair,		true },
+	{ "fpgas2",			0,		CommandCodec::Pair,		true },
+	{ "fpgaxclk",		0,		CommandCodec::Pair,		true },
+	{ "fpgashift",		0,		CommandCodec::Pair,		true },
+	{ "adc",			"off",	CommandCodec::Volts,	true },
+	{ "adc",			"ref",	CommandCodec::Volts,	true },
+	{ "eeprom 0x1ff",	0,		CommandCodec::Hex,		false },
+	{ "state",			0,		CommandCodec::NoValue,	true },
+};
+
+static char* putString(char* p, const char* s) {
+	while (*s)
+		*p++ = *s++;
+	return p;
+}
+
+static char* putDecimal(char* p, unsigned int value) {
+	char digits[10];
+	int n = 0;
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (n)
+		*p++ = digits[--n];
+	return p;
+}
+
+static char* putHex(char* p, unsigned int value) {
+	static const char hex[] = "0123456789abcdef";
+	char digits[8];
+	int n = 0;
+	do {
+		digits[n++] = hex[value & 0xf];
+		value >>= 4;
+	} while (value);
+	while (n)
+		*p++ = digits[--n];
+	return p;
+}
+
+static char* putName(char* p, const CommandCodec::Descriptor& desc, int board, int channel) {
+	p = putString(p, desc.name);
+	if (desc.suffix) {
+		p = putDecimal(p, board);
+		p = putString(p, desc.suffix);
+		p = putDecimal(p, channel);
+	}
+	return p;
+}
+
+static const char* skipSpaces(const char* p) {
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+static const char* getDecimal(const char* p, unsigned int& value) {
+	const char* start = p = skipSpaces(p);
+	value = 0;
+	while (*p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	return (p == start) ? 0 : p;
+}
+
+const CommandCodec::Descriptor& CommandCodec::describe(Id id) {
+	return descriptors[id];
+}
+
+int CommandCodec::formatRead(char* buf, Id id, int board, int channel) {
+	char* p = putString(buf, "read ");
+	p = putName(p, descriptors[id], board, channel);
+	*p = 0;
+	return p - buf;
+}
+
+int CommandCodec::formatSet(char* buf, Id id) {
+	if (descriptors[id].format != NoValue || !descriptors[id].writable)
+		return -1;
+	char* p = putString(buf, "set ");
+	p = putName(p, descriptors[id], 0, 0);
+	*p = 0;
+	return p - buf;
+}
+
+/*
+ * %g formats as the default ostream used to, 6 significant digits
+ */
+int CommandCodec::formatSetVolts(char* buf, Id id, float value, int board, int channel) {
+	if (descriptors[id].format != Volts || !descriptors[id].writable)
+		return -1;
+	char* p = putString(buf, "set ");
+	p = putName(p, descriptors[id], board, channel);
+	int len = snprintf(p, maxLength - (p - buf), " %gV", value);
+	if (len < 0 || len >= maxLength - (p - buf))
+		return -1;
+	return p + len - buf;
+}
+
+int CommandCodec::formatSetHex(char* buf, Id id, unsigned int value) {
+	if (descriptors[id].format != Hex || !descriptors[id].writable)
+		return -1;
+	char* p = putString(buf, "set ");
+	p = putName(p, descriptors[id], 0, 0);
+	*p++ = ' ';
+	p = putHex(p, value);
+	*p = 0;
+	return p - buf;
+}
+
+int CommandCodec::formatSetPair(char* buf, Id id, unsigned int value1, unsigned int value2) {
+	if (descriptors[id].format != Pair || !descriptors[id].writable)
+		return -1;
+	char* p = putString(buf, "set ");
+	p = putName(p, descriptors[id], 0, 0);
+	*p++ = ' ';
+	p = putDecimal(p, value1);
+	*p++ = ' ';
+	p = putDecimal(p, value2);
+	*p = 0;
+	return p - buf;
+}
+
+/*
+ * Formats "set <setting>" after checking its name and values, hex
+ * registers take a 0x prefix or are decimal
+ */
+int CommandCodec::formatSetting(char* buf, const char* setting) {
+	char name[maxLength];
+	const char* p = skipSpaces(setting);
+	int n = 0;
+	while (*p && *p != ' ' && n < maxLength - 1)
+		name[n++] = *p++;
+	name[n] = 0;
+	Id id;
+	int board, channel;
+	if (!lookup(name, id, board, channel) || !descriptors[id].writable)
+		return -1;
+	char* end;
+	unsigned int value1, value2;
+	switch (descriptors[id].format) {
+	case NoValue:
+		return (*skipSpaces(p)) ? -1 : formatSet(buf, id);
+	case Volts: {
+		float value = strtof(p, &end);
+		if (end == p || *skipSpaces(end))
+			return -1;
+		return formatSetVolts(buf, id, value, board, channel);
+	}
+	case Hex:
+		value1 = strtoul(p, &end, 0);
+		if (end == p || *skipSpaces(end))
+			return -1;
+		return formatSetHex(buf, id, value1);
+	case Pair:
+		p = getDecimal(p, value1);
+		if (!p || !(p = getDecimal(p, value2)) || *skipSpaces(p))
+			return -1;
+		return formatSetPair(buf, id, value1, value2);
+	}
+	return -1;
+}
+
+/*
+ * Finds a command by name, the ADC ones being <name><board><suffix><channel>
+ */
+bool CommandCodec::lookup(const char* name, Id& id, int& board, int& channel) {
+	board = channel = 0;
+	for (int i=0; i<NbCommands; i++) {
+		const Descriptor& desc = descriptors[i];
+		const char* p = name;
+		const char* q = desc.name;
+		while (*q && *p == *q) {
+			p++;
+			q++;
+		}
+		if (*q)
+			continue;
+		if (!desc.suffix) {
+			if (*p)
+				continue;
+		} else {
+			unsigned int b, c;
+			if (*p < '0' || *p > '9')
+				continue;
+			for (b = 0; *p >= '0' && *p <= '9'; p++)
+				b = b * 10 + (*p - '0');
+			q = desc.suffix;
+			while (*q && *p == *q) {
+				p++;
+				q++;
+			}
+			if (*q || *p < '0' || *p > '9')
+				continue;
+			for (c = 0; *p >= '0' && *p <= '9'; p++)
+				c = c * 10 + (*p - '0');
+			if (*p)
+				continue;
+			board = b;
+			channel = c;
+		}
+		id = Id(i);
+		return true;
+	}
+	return false;
+}
+
+/*
+ * The voltage replies start with < or >
+ */
+bool CommandCodec::parseVolts(const char* reply, float& value) {
+	char* end;
+	if (*reply == '<' || *reply == '>')
+		reply++;
+	value = strtof(reply, &end);
+	return end != reply;
+}
+
+bool CommandCodec::parseHex(const char* reply, unsigned int& value) {
+	const char* p = skipSpaces(reply);
+	if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+	const char* start = p;
+	value = 0;
+	for (;; p++) {
+		if (*p >= '0' && *p <= '9')
+			value = (value << 4) | (*p - '0');
+		else if (*p >= 'a' && *p <= 'f')
+			value = (value << 4) | (*p - 'a' + 10);
+		else if (*p >= 'A' && *p <= 'F')
+			value = (value << 4) | (*p - 'A' + 10);
+		else
+			break;
+	}
+	return p != start;
+}
+
+bool CommandCodec::parsePair(const char* reply, unsigned int& value1, unsigned int& value2) {
+	const char* p = getDecimal(reply, value1);
+	return p && getDecimal(p, value2);
+}
+
+bool CommandCodec::isAck(const char* reply) {
+	const char* ack = "ACK\r\n";
+	while (*ack && *reply == *ack) {
+		reply++;
+		ack++;
+	}
+	return !*ack && !*reply;
+}
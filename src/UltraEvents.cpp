@@ -0,0 +1,248 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraEvents.cpp
+// Created on: Oct 19, 2026
+
+#include <cmath>
+#include "UltraEvents.h"
+#include "UltraNet.h"
+#include "UltraCommandCodec.h"
+#include "UltraMetrics.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+//---------------------------
+//- telemetry thread, samples the monitors every period
+//---------------------------
+class EventPublisher::TelemetryThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "EventPublisher", "TelemetryThread");
+public:
+	TelemetryThread(EventPublisher& publisher);
+	virtual ~TelemetryThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	EventPublisher& m_publisher;
+};
+
+EventPublisher::TelemetryThread::TelemetryThread(EventPublisher& publisher) : m_publisher(publisher) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+EventPublisher::TelemetryThread::~TelemetryThread() {
+	AutoMutex aLock(m_publisher.m_cond.mutex());
+	m_publisher.m_quit = true;
+	m_publisher.m_cond.broadcast();
+}
+
+void EventPublisher::TelemetryThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_publisher.m_cond.mutex());
+
+	while (!m_publisher.m_quit) {
+		aLock.unlock();
+		m_publisher.sample();
+		aLock.lock();
+		if (!m_publisher.m_quit)
+			m_publisher.m_cond.wait(m_publisher.m_period);
+	}
+}
+
+//---------------------------
+//- EventPublisher
+//---------------------------
+EventPublisher::EventPublisher() : m_cb(0), m_net(0), m_period(0), m_heartbeat(0), m_thread(0), m_quit(false),
+		m_data_period(0), m_telemetry_events(0), m_data_events(0), m_errors(0) {
+	DEB_CONSTRUCTOR();
+}
+
+EventPublisher::~EventPublisher() {
+	DEB_DESTRUCTOR();
+	stopTelemetry();
+}
+
+void EventPublisher::registerCallback(EventCallback& cb) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cb_lock);
+	if (m_cb && m_cb != &cb) {
+		THROW_HW_ERROR(Error) << "EventPublisher::registerCallback(): another callback is registered";
+	}
+	m_cb = &cb;
+}
+
+void EventPublisher::unregisterCallback(EventCallback& cb) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cb_lock);
+	if (m_cb != &cb) {
+		THROW_HW_ERROR(Error) << "EventPublisher::unregisterCallback(): callback not registered";
+	}
+	m_cb = 0;
+}
+
+void EventPublisher::setTelemetry(UltraNet* net, const vector<string>& names, const vector<double>& deadbands,
+		double period, double heartbeat) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(names.size(), period, heartbeat);
+	char command[CommandCodec::maxLength];
+	vector<Monitor> monitors;
+
+	if (deadbands.size() != names.size() && deadbands.size() > 1) {
+		THROW_HW_ERROR(InvalidValue) << "EventPublisher::setTelemetry(): one deadband per monitor or one for all";
+	}
+	if (period < 0 || heartbeat < 0) {
+		THROW_HW_ERROR(InvalidValue) << "EventPublisher::setTelemetry(): invalid period";
+	}
+	for (size_t i=0; i<names.size(); i++) {
+		CommandCodec::Id id;
+		int board, channel;
+		if (!CommandCodec::lookup(names[i].c_str(), id, board, channel) ||
+				(CommandCodec::describe(id).format != CommandCodec::Volts &&
+				CommandCodec::describe(id).format != CommandCodec::Hex)) {
+			THROW_HW_ERROR(InvalidValue) << "EventPublisher::setTelemetry(): unknown monitor " << names[i];
+		}
+		CommandCodec::formatRead(command, id, board, channel);
+		Monitor monitor;
+		monitor.name = names[i];
+		monitor.command = command;
+		monitor.hex = CommandCodec::describe(id).format == CommandCodec::Hex;
+		monitor.deadband = deadbands.empty() ? 0 : deadbands[(deadbands.size() == 1) ? 0 : i];
+		monitor.sent = false;
+		monitor.value = 0;
+		monitor.time = 0;
+		monitors.push_back(monitor);
+	}
+	stopTelemetry();
+	m_net = net;
+	m_monitors = monitors;
+	m_period = period;
+	m_heartbeat = heartbeat;
+	if (!net || m_monitors.empty() || period == 0)
+		return;
+	m_quit = false;
+	m_thread = new TelemetryThread(*this);
+	m_thread->start();
+}
+
+void EventPublisher::getTelemetry(vector<string>& names, vector<double>& deadbands,
+		double& period, double& heartbeat) const {
+	names.clear();
+	deadbands.clear();
+	for (size_t i=0; i<m_monitors.size(); i++) {
+		names.push_back(m_monitors[i].name);
+		deadbands.push_back(m_monitors[i].deadband);
+	}
+	period = m_period;
+	heartbeat = m_heartbeat;
+}
+
+void EventPublisher::stopTelemetry() {
+	DEB_MEMBER_FUNCT();
+	delete m_thread;
+	m_thread = 0;
+}
+
+void EventPublisher::setDataReadyPeriod(int nb_frames) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_frames);
+	if (nb_frames < 0) {
+		THROW_HW_ERROR(InvalidValue) << "EventPublisher::setDataReadyPeriod(): invalid number of frames";
+	}
+	m_data_period = nb_frames;
+}
+
+void EventPublisher::endAcq(long long nb_frames) {
+	int period = m_data_period.load(std::memory_order_relaxed);
+	if (period && nb_frames % period != 0)
+		pushDataReady(nb_frames);
+}
+
+void EventPublisher::acqFailed(const std::string& message) {
+	AutoMutex aLock(m_cb_lock);
+	if (!m_cb)
+		return;
+	m_cb->acqFailed(message);
+}
+
+void EventPublisher::getCounts(unsigned long long& telemetry, unsigned long long& data_ready,
+		unsigned long long& errors) const {
+	telemetry = m_telemetry_events;
+	data_ready = m_data_events;
+	errors = m_errors;
+}
+
+void EventPublisher::pushDataReady(long long nb_frames) {
+	AutoMutex aLock(m_cb_lock);
+	if (!m_cb)
+		return;
+	m_cb->dataReady(nb_frames);
+	m_data_events++;
+}
+
+/*
+ * All the monitors are read in one exchange; a failed read is counted
+ * and skipped, the next period tries again
+ */
+void EventPublisher::sample() {
+	DEB_MEMBER_FUNCT();
+	vector<string> commands, replies;
+
+	for (size_t i=0; i<m_monitors.size(); i++)
+		commands.push_back(m_monitors[i].command);
+	try {
+		m_net->sendWaitBatch(commands, replies);
+	} catch (Exception& e) {
+		DEB_WARNING() << "telemetry read failed: " << e.getErrMsg();
+		m_errors++;
+		return;
+	}
+	long long now = Metrics::now();
+	long long heartbeat = (long long) (m_heartbeat * 1e9);
+	AutoMutex aLock(m_cb_lock);
+	for (size_t i=0; i<m_monitors.size(); i++) {
+		Monitor& monitor = m_monitors[i];
+		double value;
+		float volts;
+		unsigned int reg;
+		if (monitor.hex ? !CommandCodec::parseHex(replies[i].c_str(), reg) :
+				!CommandCodec::parseVolts(replies[i].c_str(), volts)) {
+			m_errors++;
+			continue;
+		}
+		value = monitor.hex ? (double) reg : (double) volts;
+		if (monitor.sent && fabs(value - monitor.value) < monitor.deadband &&
+				(!heartbeat || now - monitor.time < heartbeat))
+			continue;
+		if (!m_cb)
+			continue;
+		m_cb->telemetryChanged(monitor.name, value);
+		m_telemetry_events++;
+		monitor.sent = true;
+		monitor.value = value;
+		monitor.time = now;
+	}
+}
@@ -0,0 +1,420 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraHdf5Writer.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include <zlib.h>
+#include "UltraHdf5Writer.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+//---------------------------
+//- compression worker thread
+//---------------------------
+class Hdf5Writer::WorkerThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "Hdf5Writer", "WorkerThread");
+public:
+	WorkerThread(Hdf5Writer& writer);
+	virtual ~WorkerThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	Hdf5Writer& m_writer;
+};
+
+Hdf5Writer::WorkerThread::WorkerThread(Hdf5Writer& writer) : m_writer(writer) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+Hdf5Writer::WorkerThread::~WorkerThread() {
+	AutoMutex aLock(m_writer.m_cond.mutex());
+	m_writer.m_quit = true;
+	m_writer.m_cond.broadcast();
+}
+
+void Hdf5Writer::WorkerThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_writer.m_cond.mutex());
+
+	while (true) {
+		while (!m_writer.m_quit && m_writer.m_todo.empty())
+			m_writer.m_cond.wait();
+		if (m_writer.m_quit)
+			return;
+		Chunk* chunk = m_writer.m_todo.front();
+		m_writer.m_todo.pop_front();
+		aLock.unlock();
+		try {
+			m_writer.compressChunk(chunk);
+		} catch (Exception& e) {
+			aLock.lock();
+			m_writer.m_error = e.getErrMsg();
+			m_writer.m_cond.broadcast();
+			continue;
+		}
+		aLock.lock();
+		m_writer.m_done[chunk->seq] = chunk;
+		m_writer.writeChunks(aLock);
+	}
+}
+
+//---------------------------
+// @brief  Ctor
+//---------------------------
+Hdf5Writer::Hdf5Writer() : m_current(0), m_next_seq(0), m_write_seq(0), m_nb_lines(0),
+		m_queued_lines(0), m_queued_pairs(0), m_writing(false), m_quit(false), m_npixels(0),
+		m_chunk_lines(0), m_level(0), m_sparse(false),
+		m_file(-1), m_data(-1), m_frame_nb(-1), m_frame_type(-1), m_timestamp(-1), m_count(-1) {
+	DEB_CONSTRUCTOR();
+}
+
+Hdf5Writer::~Hdf5Writer() {
+	DEB_DESTRUCTOR();
+	try {
+		close();
+	} catch (Exception& e) {
+		DEB_ERROR() << "Hdf5Writer::~Hdf5Writer(): " << e.getErrMsg();
+	}
+}
+
+void Hdf5Writer::open(const string& filename, int npixels, int chunk_lines, int compression_level, int nb_threads,
+		bool sparse) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR6(filename, npixels, chunk_lines, compression_level, nb_threads, sparse);
+
+	if (isOpen()) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer::open(): a file is already open";
+	}
+	if (npixels <= 0 || chunk_lines <= 0 || nb_threads <= 0 || compression_level < 0 || compression_level > 9) {
+		THROW_HW_ERROR(InvalidValue) << "Hdf5Writer::open(): invalid arguement";
+	}
+	if ((m_file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT)) < 0) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer::open(): can't create " << filename;
+	}
+	m_npixels = npixels;
+	m_chunk_lines = chunk_lines;
+	m_level = compression_level;
+	m_sparse = sparse;
+
+	// a sparse chunk holds chunk_lines lines of half the pixels, and at least one full line
+	int chunk_words = (m_sparse && chunk_lines < 2) ? 2 * npixels : chunk_lines * npixels;
+	int width = (m_sparse) ? 2 : npixels;
+	hsize_t dims[2] = {0, (hsize_t) width};
+	hsize_t maxdims[2] = {H5S_UNLIMITED, (hsize_t) width};
+	hsize_t chunk[2] = {(hsize_t) chunk_words / width, (hsize_t) width};
+	hid_t space = H5Screate_simple(2, dims, maxdims);
+	hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	H5Pset_chunk(dcpl, 2, chunk);
+	if (m_level > 0) {
+		H5Pset_shuffle(dcpl);
+		H5Pset_deflate(dcpl, m_level);
+	}
+	m_data = H5Dcreate2(m_file, (m_sparse) ? "sparse_pairs" : "data", H5T_STD_U16LE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	H5Pclose(dcpl);
+	H5Sclose(space);
+
+	chunk[0] = chunk_lines;
+	space = H5Screate_simple(1, dims, maxdims);
+	dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	H5Pset_chunk(dcpl, 1, chunk);
+	m_frame_nb = H5Dcreate2(m_file, "frame_number", H5T_STD_I32LE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	m_frame_type = H5Dcreate2(m_file, "frame_type", H5T_STD_U8LE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	m_timestamp = H5Dcreate2(m_file, "timestamp", H5T_IEEE_F64LE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	if (m_sparse)
+		m_count = H5Dcreate2(m_file, "sparse_count", H5T_STD_U16LE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+	H5Pclose(dcpl);
+	H5Sclose(space);
+	if (m_data < 0 || m_frame_nb < 0 || m_frame_type < 0 || m_timestamp < 0 || (m_sparse && m_count < 0)) {
+		close();
+		THROW_HW_ERROR(Error) << "Hdf5Writer::open(): can't create the datasets in " << filename;
+	}
+
+	// enough chunks to keep every worker and the acquisition busy
+	for (int i=0; i<2*nb_threads+2; i++) {
+		Chunk* c = new Chunk;
+		c->data.resize(chunk_words);
+		if (m_sparse)
+			c->count.resize(chunk_lines);
+		c->frame_nb.resize(chunk_lines);
+		c->frame_type.resize(chunk_lines);
+		c->timestamp.resize(chunk_lines);
+		if (m_level > 0 && !m_sparse) {
+			c->shuffled.resize(c->data.size() * sizeof(unsigned short));
+			c->compressed.resize(compressBound(c->shuffled.size()));
+		}
+		m_chunks.push_back(c);
+		m_free.push_back(c);
+	}
+	m_next_seq = m_write_seq = m_nb_lines = m_queued_lines = m_queued_pairs = 0;
+	m_error.clear();
+	m_quit = false;
+	for (int i=0; i<nb_threads; i++) {
+		m_workers.push_back(new WorkerThread(*this));
+		m_workers.back()->start();
+	}
+}
+
+void Hdf5Writer::close() {
+	DEB_MEMBER_FUNCT();
+	if (!isOpen())
+		return;
+
+	if (m_current) {
+		if (m_current->nb_lines > 0) {
+			queueChunk(m_current);
+		} else {
+			AutoMutex aLock(m_cond.mutex());
+			m_free.push_back(m_current);
+		}
+		m_current = 0;
+	}
+	AutoMutex aLock(m_cond.mutex());
+	while (m_write_seq < m_next_seq && m_error.empty())
+		m_cond.wait();
+	aLock.unlock();
+	for (size_t i=0; i<m_workers.size(); i++)
+		delete m_workers[i];
+	m_workers.clear();
+
+	if (m_count >= 0)
+		H5Dclose(m_count);
+	if (m_timestamp >= 0)
+		H5Dclose(m_timestamp);
+	if (m_frame_type >= 0)
+		H5Dclose(m_frame_type);
+	if (m_frame_nb >= 0)
+		H5Dclose(m_frame_nb);
+	if (m_data >= 0)
+		H5Dclose(m_data);
+	H5Fclose(m_file);
+	m_file = m_data = m_frame_nb = m_frame_type = m_timestamp = m_count = -1;
+
+	for (size_t i=0; i<m_chunks.size(); i++)
+		delete m_chunks[i];
+	m_chunks.clear();
+	m_free.clear();
+	m_todo.clear();
+	m_done.clear();
+	if (!m_error.empty()) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer::close(): " << m_error;
+	}
+}
+
+bool Hdf5Writer::isOpen() const {
+	return m_file >= 0;
+}
+
+void Hdf5Writer::getNbLines(long long& nb_lines) const {
+	AutoMutex aLock(m_cond.mutex());
+	nb_lines = m_nb_lines;
+}
+
+/*
+ * Take a free chunk as the current one, waiting for the workers if none
+ */
+void Hdf5Writer::getChunk() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	while (m_free.empty() && m_error.empty())
+		m_cond.wait();
+	checkError();
+	m_current = m_free.front();
+	m_free.pop_front();
+	m_current->nb_lines = 0;
+	m_current->used = 0;
+}
+
+void Hdf5Writer::addLine(const void* line, int frame_nb, int frame_type, double timestamp) {
+	DEB_MEMBER_FUNCT();
+	if (!m_current)
+		getChunk();
+	int n = m_current->nb_lines;
+	memcpy(&m_current->data[n * m_npixels], line, m_npixels * sizeof(unsigned short));
+	m_current->frame_nb[n] = frame_nb;
+	m_current->frame_type[n] = frame_type;
+	m_current->timestamp[n] = timestamp;
+	if (++m_current->nb_lines == m_chunk_lines) {
+		queueChunk(m_current);
+		m_current = 0;
+	}
+}
+
+/*
+ * Append the pairs of a zero suppressed line, the file must be open sparse
+ */
+void Hdf5Writer::addSparseLine(const unsigned short* pairs, int count, int frame_nb, int frame_type, double timestamp) {
+	DEB_MEMBER_FUNCT();
+	if (!m_current)
+		getChunk();
+	int n = m_current->nb_lines;
+	memcpy(&m_current->data[m_current->used], pairs, 2 * count * sizeof(unsigned short));
+	m_current->used += 2 * count;
+	m_current->count[n] = count;
+	m_current->frame_nb[n] = frame_nb;
+	m_current->frame_type[n] = frame_type;
+	m_current->timestamp[n] = timestamp;
+	if (++m_current->nb_lines == m_chunk_lines || m_current->used + 2 * m_npixels > m_current->data.size()) {
+		queueChunk(m_current);
+		m_current = 0;
+	}
+}
+
+void Hdf5Writer::queueChunk(Chunk* chunk) {
+	AutoMutex aLock(m_cond.mutex());
+	chunk->seq = m_next_seq++;
+	chunk->first_line = m_queued_lines;
+	chunk->first_pair = m_queued_pairs;
+	m_queued_lines += chunk->nb_lines;
+	m_queued_pairs += chunk->used / 2;
+	m_todo.push_back(chunk);
+	m_cond.broadcast();
+}
+
+void Hdf5Writer::compressChunk(Chunk* chunk) {
+	DEB_MEMBER_FUNCT();
+	// the sparse pairs go through the HDF5 filters when written
+	if (m_sparse)
+		return;
+	size_t used = chunk->nb_lines * m_npixels;
+	if (used < chunk->data.size())
+		memset(&chunk->data[used], 0, (chunk->data.size() - used) * sizeof(unsigned short));
+	if (m_level == 0) {
+		chunk->size = chunk->data.size() * sizeof(unsigned short);
+		return;
+	}
+
+	// byte shuffle as done by the HDF5 shuffle filter, then deflate
+	size_t nb_elem = chunk->data.size();
+	const unsigned char* src = (const unsigned char*) &chunk->data[0];
+	unsigned char* lo = &chunk->shuffled[0];
+	unsigned char* hi = lo + nb_elem;
+	for (size_t i=0; i<nb_elem; i++) {
+		lo[i] = src[2*i];
+		hi[i] = src[2*i+1];
+	}
+	uLongf len = chunk->compressed.size();
+	if (compress2(&chunk->compressed[0], &len, lo, chunk->shuffled.size(), m_level) != Z_OK) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer::compressChunk(): deflate failed";
+	}
+	chunk->size = len;
+}
+
+/*
+ * Write the compressed chunks in order, only one thread at a time
+ * touches the file. Called and returns with the lock held.
+ */
+void Hdf5Writer::writeChunks(AutoMutex& aLock) {
+	DEB_MEMBER_FUNCT();
+	if (m_writing)
+		return;
+	m_writing = true;
+	while (!m_done.empty() && m_done.begin()->first == m_write_seq) {
+		Chunk* chunk = m_done.begin()->second;
+		m_done.erase(m_done.begin());
+		aLock.unlock();
+		string error;
+		try {
+			writeChunk(chunk);
+		} catch (Exception& e) {
+			error = e.getErrMsg();
+		}
+		aLock.lock();
+		if (!error.empty())
+			m_error = error;
+		m_nb_lines += chunk->nb_lines;
+		m_write_seq++;
+		m_free.push_back(chunk);
+		m_cond.broadcast();
+	}
+	m_writing = false;
+}
+
+void Hdf5Writer::writeChunk(Chunk* chunk) {
+	DEB_MEMBER_FUNCT();
+	hsize_t first = chunk->first_line;
+	hsize_t dims[2] = {first + chunk->nb_lines, (hsize_t) m_npixels};
+	if (m_sparse) {
+		writePairs(chunk);
+	} else {
+		hsize_t offset[2] = {first, 0};
+		const void* buf = (m_level > 0) ? (const void*) &chunk->compressed[0] : (const void*) &chunk->data[0];
+		if (H5Dset_extent(m_data, dims) < 0 ||
+				H5Dwrite_chunk(m_data, H5P_DEFAULT, 0, offset, chunk->size, buf) < 0) {
+			THROW_HW_ERROR(Error) << "Hdf5Writer::writeChunk(): can't write chunk " << chunk->seq;
+		}
+	}
+
+	hsize_t count = chunk->nb_lines;
+	hid_t mspace = H5Screate_simple(1, &count, 0);
+	herr_t err = 0;
+	hid_t dsets[4] = {m_frame_nb, m_frame_type, m_timestamp, m_count};
+	hid_t types[4] = {H5T_NATIVE_INT, H5T_NATIVE_UCHAR, H5T_NATIVE_DOUBLE, H5T_NATIVE_USHORT};
+	const void* bufs[4] = {&chunk->frame_nb[0], &chunk->frame_type[0], &chunk->timestamp[0],
+			(m_sparse) ? &chunk->count[0] : 0};
+	for (int i=0; i<((m_sparse) ? 4 : 3); i++) {
+		err |= H5Dset_extent(dsets[i], dims);
+		hid_t fspace = H5Dget_space(dsets[i]);
+		err |= H5Sselect_hyperslab(fspace, H5S_SELECT_SET, &first, 0, &count, 0);
+		err |= H5Dwrite(dsets[i], types[i], mspace, fspace, H5P_DEFAULT, bufs[i]);
+		H5Sclose(fspace);
+	}
+	H5Sclose(mspace);
+	if (err < 0) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer::writeChunk(): can't write line info of chunk " << chunk->seq;
+	}
+}
+
+/*
+ * Append the pairs of a sparse chunk to the 2 column pairs dataset
+ */
+void Hdf5Writer::writePairs(Chunk* chunk) {
+	DEB_MEMBER_FUNCT();
+	hsize_t offset[2] = {(hsize_t) chunk->first_pair, 0};
+	hsize_t count[2] = {chunk->used / 2, 2};
+	if (count[0] == 0)
+		return;
+	hsize_t dims[2] = {offset[0] + count[0], 2};
+	herr_t err = H5Dset_extent(m_data, dims);
+	hid_t mspace = H5Screate_simple(2, count, 0);
+	hid_t fspace = H5Dget_space(m_data);
+	err |= H5Sselect_hyperslab(fspace, H5S_SELECT_SET, offset, 0, count, 0);
+	err |= H5Dwrite(m_data, H5T_NATIVE_USHORT, mspace, fspace, H5P_DEFAULT, &chunk->data[0]);
+	H5Sclose(fspace);
+	H5Sclose(mspace);
+	if (err < 0) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer::writePairs(): can't write the pairs of chunk " << chunk->seq;
+	}
+}
+
+void Hdf5Writer::checkError() {
+	DEB_MEMBER_FUNCT();
+	if (!m_error.empty()) {
+		THROW_HW_ERROR(Error) << "Hdf5Writer: " << m_error;
+	}
+}
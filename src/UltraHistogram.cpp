@@ -0,0 +1,381 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraHistogram.cpp
+// Created on: Oct 19, 2026
+
+#include <algorithm>
+#include <cstring>
+#include "UltraHistogram.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+const int histBatchLines = 64;		// lines handed to the threads at once
+
+//---------------------------
+//- shard thread, updates a slice of pixels
+//---------------------------
+class Histogram::ShardThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "Histogram", "ShardThread");
+public:
+	ShardThread(Histogram& hist, int shard);
+	virtual ~ShardThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	Histogram& m_hist;
+	int m_shard;
+	long long m_seq;
+};
+
+Histogram::ShardThread::ShardThread(Histogram& hist, int shard) : m_hist(hist), m_shard(shard), m_seq(0) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+Histogram::ShardThread::~ShardThread() {
+	AutoMutex aLock(m_hist.m_cond.mutex());
+	m_hist.m_quit = true;
+	m_hist.m_cond.broadcast();
+}
+
+void Histogram::ShardThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	int first = m_hist.getShardPixel(m_shard);
+	int last = m_hist.getShardPixel(m_shard + 1);
+	AutoMutex aLock(m_hist.m_cond.mutex());
+
+	while (true) {
+		Batch* batch = 0;
+		while (!m_hist.m_quit) {
+			list<Batch*>::iterator it;
+			for (it = m_hist.m_todo.begin(); it != m_hist.m_todo.end(); ++it) {
+				if ((*it)->seq == m_seq)
+					break;
+			}
+			if (it != m_hist.m_todo.end()) {
+				batch = *it;
+				break;
+			}
+			m_hist.m_cond.wait();
+		}
+		if (!batch)
+			return;
+		m_hist.beginUpdate();
+		aLock.unlock();
+		m_hist.update(&batch->lines[0], batch->nb_lines, first, last);
+		aLock.lock();
+		m_hist.endUpdate();
+		m_seq++;
+		if (--batch->pending == 0) {
+			m_hist.m_todo.remove(batch);
+			m_hist.m_free.push_back(batch);
+			m_hist.m_nb_lines += batch->nb_lines;
+			m_hist.m_cond.broadcast();
+		}
+	}
+}
+
+//---------------------------
+// @brief  Ctor
+//---------------------------
+Histogram::Histogram(int npixels, int nb_channels) : m_npixels(npixels), m_nb_channels(nb_channels),
+		m_nb_bins(4096), m_min_value(0), m_shift(4), m_per_channel(false), m_nb_lines(0),
+		m_nb_threads(0), m_current(0), m_next_seq(0), m_quit(false), m_updating(0), m_reading(0) {
+	DEB_CONSTRUCTOR();
+	int block = npixels / nb_channels;
+	for (int c=0; c<nb_channels; c++)
+		m_channel_pixels.push_back(c * block);
+	allocate();
+}
+
+Histogram::~Histogram() {
+	DEB_DESTRUCTOR();
+	stopThreads();
+}
+
+void Histogram::setBinning(int nb_bins, int min_value, int bin_width) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(nb_bins, min_value, bin_width);
+	int shift = 0;
+
+	while ((1 << shift) < bin_width)
+		shift++;
+	if (nb_bins <= 0 || bin_width <= 0 || (1 << shift) != bin_width) {
+		THROW_HW_ERROR(InvalidValue) << "Histogram::setBinning(): bin width must be a power of two";
+	}
+	stopThreads();
+	AutoMutex aLock(m_cond.mutex());
+	m_nb_bins = nb_bins;
+	m_min_value = min_value;
+	m_shift = shift;
+	allocate();
+}
+
+void Histogram::getBinning(int& nb_bins, int& min_value, int& bin_width) const {
+	nb_bins = m_nb_bins;
+	min_value = m_min_value;
+	bin_width = 1 << m_shift;
+}
+
+void Histogram::setPerChannel(bool state) {
+	DEB_MEMBER_FUNCT();
+	stopThreads();
+	AutoMutex aLock(m_cond.mutex());
+	m_per_channel = state;
+	allocate();
+}
+
+void Histogram::getPerChannel(bool& state) const {
+	state = m_per_channel;
+}
+
+/*
+ * First pixel of each channel row. The line holds one block of
+ * npixels / nb_channels pixels per channel, the pixels left over at the
+ * end go with the last block.
+ */
+void Histogram::setChannelPixels(const std::vector<int>& first_pixels) {
+	DEB_MEMBER_FUNCT();
+	int block = m_npixels / m_nb_channels;
+	vector<bool> used(m_nb_channels, false);
+
+	if (first_pixels == m_channel_pixels)
+		return;
+	if (first_pixels.size() != (size_t) m_nb_channels || block == 0) {
+		THROW_HW_ERROR(InvalidValue) << "Histogram::setChannelPixels(): expected one block per channel";
+	}
+	for (int c=0; c<m_nb_channels; c++) {
+		int b = first_pixels[c] / block;
+		if (first_pixels[c] < 0 || first_pixels[c] % block || b >= m_nb_channels || used[b]) {
+			THROW_HW_ERROR(InvalidValue) << "Histogram::setChannelPixels(): invalid first pixel of channel " << c;
+		}
+		used[b] = true;
+	}
+	stopThreads();
+	AutoMutex aLock(m_cond.mutex());
+	m_channel_pixels = first_pixels;
+	allocate();
+}
+
+void Histogram::setNbThreads(int nb_threads) {
+	DEB_MEMBER_FUNCT();
+	if (nb_threads < 0 || nb_threads > m_npixels) {
+		THROW_HW_ERROR(InvalidValue) << "Histogram::setNbThreads(): invalid number of threads";
+	}
+	stopThreads();
+	m_nb_threads = nb_threads;
+}
+
+void Histogram::getNbThreads(int& nb_threads) const {
+	nb_threads = m_nb_threads;
+}
+
+int Histogram::getNbRows() const {
+	return (m_per_channel) ? m_nb_channels : m_npixels;
+}
+
+/*
+ * To be called with the lock held, and no update in progress
+ */
+void Histogram::allocate() {
+	int block = m_npixels / m_nb_channels;
+	vector<int> block_channel(m_nb_channels);
+	for (int c=0; c<m_nb_channels; c++)
+		block_channel[(block) ? m_channel_pixels[c] / block : c] = c;
+	m_row.resize(m_npixels);
+	for (int i=0; i<m_npixels; i++) {
+		int b = (block) ? min(i / block, m_nb_channels - 1) : i * m_nb_channels / m_npixels;
+		m_row[i] = ((m_per_channel) ? block_channel[b] : i) * m_nb_bins;
+	}
+	m_counts.assign(getNbRows() * m_nb_bins, 0);
+	m_nb_lines = 0;
+}
+
+/*
+ * First pixel of a shard, in per channel mode the shards are aligned on
+ * channels so that two threads never update the same row.
+ */
+int Histogram::getShardPixel(int shard) const {
+	int pixel = shard * m_npixels / m_nb_threads;
+	int block = m_npixels / m_nb_channels;
+	if (m_per_channel && block) {
+		int b = (pixel + block - 1) / block;
+		pixel = (b < m_nb_channels) ? b * block : m_npixels;
+	} else if (m_per_channel) {
+		int chan = (pixel * m_nb_channels + m_npixels - 1) / m_npixels;
+		pixel = chan * m_npixels / m_nb_channels;
+	}
+	return pixel;
+}
+
+void Histogram::startThreads() {
+	DEB_MEMBER_FUNCT();
+	m_quit = false;
+	m_next_seq = 0;
+	for (int i=0; i<2; i++) {
+		Batch* b = new Batch;
+		b->lines.resize(histBatchLines * m_npixels);
+		m_batches.push_back(b);
+		m_free.push_back(b);
+	}
+	for (int i=0; i<m_nb_threads; i++) {
+		m_threads.push_back(new ShardThread(*this, i));
+		m_threads.back()->start();
+	}
+}
+
+void Histogram::stopThreads() {
+	DEB_MEMBER_FUNCT();
+	if (m_threads.empty())
+		return;
+	flush();
+	for (size_t i=0; i<m_threads.size(); i++)
+		delete m_threads[i];
+	m_threads.clear();
+	for (size_t i=0; i<m_batches.size(); i++)
+		delete m_batches[i];
+	m_batches.clear();
+	m_free.clear();
+	m_todo.clear();
+}
+
+void Histogram::update(const unsigned short* lines, int nb_lines, int first_pixel, int last_pixel) {
+	unsigned int* counts = &m_counts[0];
+	const int* row = &m_row[0];
+	unsigned int range = m_nb_bins << m_shift;
+
+	// pixel major so that a pixel histogram stays in cache for the whole batch
+	for (int p=first_pixel; p<last_pixel; p++) {
+		unsigned int* hist = counts + row[p];
+		const unsigned short* v = lines + p;
+		for (int l=0; l<nb_lines; l++, v += m_npixels) {
+			unsigned int offset = (unsigned int) (*v - m_min_value);
+			if (offset < range)
+				hist[offset >> m_shift]++;
+		}
+	}
+}
+
+/*
+ * A shard update waits for the pending reads, so that a reader polling the
+ * histograms while acquiring is not starved by the threads. To be called
+ * with the lock held.
+ */
+void Histogram::beginUpdate() {
+	while (m_reading > 0)
+		m_cond.wait();
+	m_updating++;
+}
+
+void Histogram::endUpdate() {
+	if (--m_updating == 0 && m_reading > 0)
+		m_cond.broadcast();
+}
+
+void Histogram::addLine(const unsigned short* line) {
+	DEB_MEMBER_FUNCT();
+	if (m_nb_threads == 0) {
+		AutoMutex aLock(m_cond.mutex());
+		update(line, 1, 0, m_npixels);
+		m_nb_lines++;
+		return;
+	}
+	if (m_threads.empty())
+		startThreads();
+	if (!m_current) {
+		AutoMutex aLock(m_cond.mutex());
+		while (m_free.empty())
+			m_cond.wait();
+		m_current = m_free.front();
+		m_free.pop_front();
+		m_current->nb_lines = 0;
+	}
+	memcpy(&m_current->lines[m_current->nb_lines * m_npixels], line, m_npixels * sizeof(unsigned short));
+	if (++m_current->nb_lines == histBatchLines)
+		queueBatch();
+}
+
+void Histogram::queueBatch() {
+	AutoMutex aLock(m_cond.mutex());
+	m_current->seq = m_next_seq++;
+	m_current->pending = m_nb_threads;
+	m_todo.push_back(m_current);
+	m_current = 0;
+	m_cond.broadcast();
+}
+
+/*
+ * Hand over the partial batch and wait for the threads to be done,
+ * to be called from the thread adding the lines.
+ */
+void Histogram::flush() {
+	DEB_MEMBER_FUNCT();
+	if (m_threads.empty())
+		return;
+	if (m_current && m_current->nb_lines > 0)
+		queueBatch();
+	AutoMutex aLock(m_cond.mutex());
+	while (!m_todo.empty())
+		m_cond.wait();
+}
+
+void Histogram::reset() {
+	DEB_MEMBER_FUNCT();
+	flush();
+	AutoMutex aLock(m_cond.mutex());
+	allocate();
+}
+
+void Histogram::getRow(int row, vector<unsigned int>& counts) {
+	DEB_MEMBER_FUNCT();
+	if (row < 0 || row >= getNbRows()) {
+		THROW_HW_ERROR(InvalidValue) << "Histogram::getRow(): row is outside of range";
+	}
+	AutoMutex aLock(m_cond.mutex());
+	m_reading++;
+	while (m_updating > 0)
+		m_cond.wait();
+	counts.assign(m_counts.begin() + row * m_nb_bins, m_counts.begin() + (row + 1) * m_nb_bins);
+	m_reading--;
+	m_cond.broadcast();
+}
+
+void Histogram::getAll(vector<unsigned int>& counts) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	m_reading++;
+	while (m_updating > 0)
+		m_cond.wait();
+	counts = m_counts;
+	m_reading--;
+	m_cond.broadcast();
+}
+
+void Histogram::getNbLines(long long& nb_lines) {
+	AutoMutex aLock(m_cond.mutex());
+	nb_lines = m_nb_lines;
+}
@@ -55,7 +55,8 @@ Interface::Interface(Camera& cam) :
 	FrameDim frame_dim(image_size, image_type);
 	m_bufferCtrlObj->setFrameDim(frame_dim);
 	m_bufferCtrlObj->setNbConcatFrames(1);
-	m_bufferCtrlObj->setNbBuffers(2);
+	// no buffers yet, CtControl allocates them at prepareAcq(), as many as the
+	// acquisition needs within the pool budget (Camera::setBufferPoolMemory())
 }
 
 Interface::~Interface() {
@@ -94,15 +95,24 @@ void Interface::stopAcq() {
 
 void Interface::getStatus(StatusType& status) {
 	DEB_MEMBER_FUNCT();
-	if (m_cam.isAcqRunning()) {
+	Camera::AcqState state;
+	m_cam.getAcqState(state);
+	switch (state) {
+	case Camera::Armed:
+	case Camera::Running:
+	case Camera::Stopping:
 		status.det = DetExposure;
 		status.acq = AcqRunning;
-		std::cout << "Camera running" << std::endl;
-	} else {
+		break;
+	case Camera::Fault:
+		status.det = DetFault;
+		status.acq = AcqFault;
+		break;
+	default:
 		status.acq = AcqReady;
 		status.det = DetIdle;
-		std::cout << "Camera idle" << std::endl;
 	}
+	DEB_RETURN() << DEB_VAR2(status.det, status.acq);
 //	Camera::UltraStatus xhStatus;
 //	m_cam.getStatus(xhStatus);
 //	switch (xhStatus.state) {
@@ -0,0 +1,195 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraMetrics.cpp
+// Created on: Oct 19, 2026
+
+#include <cstdio>
+#include <time.h>
+#include "UltraMetrics.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+static const char* counterNames[Metrics::NbCounters] = {
+	"packets_received", "bytes_received", "sequence_gaps", "kernel_drops", "ring_occupancy", "frames_ready",
+	"lines_read", "lines_discarded", "lines_filtered"
+};
+
+static const char* stageNames[Metrics::NbStages] = {
+	"receive", "process", "frame_ready", "command_rtt"
+};
+
+//---------------------------
+//- dump thread, appends a line to the file every period
+//---------------------------
+class Metrics::DumpThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "Metrics", "DumpThread");
+public:
+	DumpThread(Metrics& metrics, FILE* fp);
+	virtual ~DumpThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	Metrics& m_metrics;
+	FILE* m_fp;
+};
+
+Metrics::DumpThread::DumpThread(Metrics& metrics, FILE* fp) : m_metrics(metrics), m_fp(fp) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+Metrics::DumpThread::~DumpThread() {
+	AutoMutex aLock(m_metrics.m_cond.mutex());
+	m_metrics.m_quit = true;
+	m_metrics.m_cond.broadcast();
+}
+
+void Metrics::DumpThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_metrics.m_cond.mutex());
+
+	while (!m_metrics.m_quit) {
+		m_metrics.m_cond.wait(m_metrics.m_dump_period);
+		if (m_metrics.m_quit)
+			break;
+		m_metrics.dump(m_fp);
+	}
+	fclose(m_fp);
+}
+
+//---------------------------
+//- Metrics
+//---------------------------
+Metrics::Metrics() : m_dump_thread(0), m_dump_period(0), m_quit(false) {
+	DEB_CONSTRUCTOR();
+	reset();
+}
+
+Metrics::~Metrics() {
+	DEB_DESTRUCTOR();
+	stopDump();
+}
+
+long long Metrics::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+const char* Metrics::getCounterName(int counter) {
+	return (counter >= 0 && counter < NbCounters) ? counterNames[counter] : "";
+}
+
+const char* Metrics::getStageName(int stage) {
+	return (stage >= 0 && stage < NbStages) ? stageNames[stage] : "";
+}
+
+void Metrics::addLatency(Stage stage, long long ns) {
+	int bucket = (ns > 1) ? 63 - __builtin_clzll(ns) : 0;
+	if (bucket >= nbBuckets)
+		bucket = nbBuckets - 1;
+	m_latency[stage][bucket].fetch_add(1, memory_order_relaxed);
+}
+
+void Metrics::getLatency(Stage stage, vector<unsigned long long>& counts) const {
+	counts.resize(nbBuckets);
+	for (int i=0; i<nbBuckets; i++)
+		counts[i] = m_latency[stage][i].load(memory_order_relaxed);
+}
+
+/*
+ * Upper bound in ns of the bucket holding the given fraction of the samples
+ */
+long long Metrics::getPercentile(Stage stage, double fraction) const {
+	vector<unsigned long long> counts;
+	unsigned long long total = 0, sum = 0;
+	getLatency(stage, counts);
+	for (int i=0; i<nbBuckets; i++)
+		total += counts[i];
+	if (!total)
+		return 0;
+	for (int i=0; i<nbBuckets; i++) {
+		sum += counts[i];
+		if (sum >= fraction * total)
+			return 2LL << i;
+	}
+	return 2LL << (nbBuckets - 1);
+}
+
+void Metrics::reset() {
+	for (int i=0; i<NbCounters; i++)
+		m_counters[i].store(0, memory_order_relaxed);
+	for (int s=0; s<NbStages; s++)
+		for (int i=0; i<nbBuckets; i++)
+			m_latency[s][i].store(0, memory_order_relaxed);
+}
+
+void Metrics::startDump(const string& filename, double period) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(filename, period);
+	stopDump();
+	if (filename.empty())
+		return;
+	if (period <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "Metrics::startDump(): invalid period";
+	}
+	FILE* fp = fopen(filename.c_str(), "a");
+	if (!fp) {
+		THROW_HW_ERROR(Error) << "Metrics::startDump(): cannot open " << filename;
+	}
+	m_dump_filename = filename;
+	m_dump_period = period;
+	m_quit = false;
+	m_dump_thread = new DumpThread(*this, fp);
+	m_dump_thread->start();
+}
+
+void Metrics::stopDump() {
+	DEB_MEMBER_FUNCT();
+	delete m_dump_thread;
+	m_dump_thread = 0;
+	m_dump_filename.clear();
+}
+
+void Metrics::getDump(string& filename) const {
+	filename = m_dump_filename;
+}
+
+/*
+ * One line: wall clock time, the counters then the median and 99th
+ * percentile of each stage in ns
+ */
+void Metrics::dump(FILE* fp) {
+	fprintf(fp, "%ld", (long) time(0));
+	for (int i=0; i<NbCounters; i++)
+		fprintf(fp, " %s=%llu", counterNames[i], get(Counter(i)));
+	for (int s=0; s<NbStages; s++)
+		fprintf(fp, " %s_p50=%lld %s_p99=%lld", stageNames[s], getPercentile(Stage(s), 0.5),
+				stageNames[s], getPercentile(Stage(s), 0.99));
+	fprintf(fp, "\n");
+	fflush(fp);
+}
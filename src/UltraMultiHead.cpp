@@ -0,0 +1,290 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraMultiHead.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include "UltraMultiHead.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+const int multiRingLines = 1024;	// lines buffered per head
+const int multiPollMs = 100;		// receive thread stop latency
+
+//---------------------------
+//- receive thread, one per head
+//---------------------------
+class MultiHead::RecvThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "MultiHead", "RecvThread");
+public:
+	RecvThread(MultiHead& multi, int head);
+	virtual ~RecvThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	MultiHead& m_multi;
+	int m_head;
+};
+
+MultiHead::RecvThread::RecvThread(MultiHead& multi, int head) : m_multi(multi), m_head(head) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+MultiHead::RecvThread::~RecvThread() {
+	AutoMutex aLock(m_multi.m_cond.mutex());
+	m_multi.m_quit = true;
+	m_multi.m_cond.broadcast();
+}
+
+void MultiHead::RecvThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	Ring& ring = m_multi.m_rings[m_head];
+	int num = m_multi.m_npixels * sizeof(short);
+	AutoMutex aLock(m_multi.m_cond.mutex());
+
+	while (!m_multi.m_quit && !ring.ended) {
+		if (ring.count == multiRingLines) {
+			m_multi.m_cond.wait();
+			continue;
+		}
+		// only this thread writes the free slots, no lock needed to fill one
+		int slot = (ring.first + ring.count) % multiRingLines;
+		int frame_nb, frame_type;
+		int len = -1;
+		bool failed = false;
+		string error;
+		aLock.unlock();
+		try {
+			// poll only when no line is pending
+			len = ring.net->recvFrame(&ring.lines[slot * m_multi.m_npixels], num, frame_nb, frame_type, false);
+			if (len == -1 && ring.net->waitData(multiPollMs))
+				len = ring.net->recvFrame(&ring.lines[slot * m_multi.m_npixels], num, frame_nb, frame_type, false);
+		} catch (Exception& e) {
+			DEB_ERROR() << "head " << m_head << ": " << e.getErrMsg();
+			failed = true;
+			error = e.getErrMsg();
+		}
+		aLock.lock();
+		if (failed) {
+			ring.failed = true;
+			ring.error = error;
+			ring.ended = true;
+			m_multi.m_cond.broadcast();
+		} else if (len == 0) {
+			ring.ended = true;
+			m_multi.m_cond.broadcast();
+		} else if (len > 0) {
+			ring.frame_nb[slot] = frame_nb;
+			ring.frame_type[slot] = frame_type;
+			ring.count++;
+			m_multi.m_cond.broadcast();
+		}
+	}
+}
+
+//---------------------------
+//- MultiHead
+//---------------------------
+MultiHead::MultiHead(int npixels) : m_npixels(npixels), m_quit(false) {
+	DEB_CONSTRUCTOR();
+}
+
+MultiHead::~MultiHead() {
+	DEB_DESTRUCTOR();
+	stop();
+}
+
+void MultiHead::addHead(UltraNet* net) {
+	DEB_MEMBER_FUNCT();
+	if (!m_threads.empty()) {
+		THROW_HW_ERROR(Error) << "MultiHead::addHead(): heads are being received";
+	}
+	Ring ring;
+	ring.net = net;
+	ring.first = 0;
+	ring.count = 0;
+	ring.ended = false;
+	ring.failed = false;
+	ring.unmatched = 0;
+	m_rings.push_back(ring);
+}
+
+int MultiHead::getNbHeads() const {
+	return m_rings.size();
+}
+
+void MultiHead::start() {
+	DEB_MEMBER_FUNCT();
+	stop();
+	m_quit = false;
+	for (size_t h=0; h<m_rings.size(); h++) {
+		Ring& ring = m_rings[h];
+		ring.lines.resize(multiRingLines * m_npixels);
+		ring.frame_nb.resize(multiRingLines);
+		ring.frame_type.resize(multiRingLines);
+		ring.first = 0;
+		ring.count = 0;
+		ring.ended = false;
+		ring.failed = false;
+		ring.error.clear();
+	}
+	AutoMutex tLock(m_thread_lock);
+	for (size_t h=0; h<m_rings.size(); h++) {
+		m_threads.push_back(new RecvThread(*this, h));
+		m_threads.back()->start();
+	}
+}
+
+/*
+ * Ends the receive threads and any getLine() waiting, called by the
+ * acquisition thread at the end and by stopAcq() meanwhile
+ */
+void MultiHead::stop() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex tLock(m_thread_lock);
+	for (size_t i=0; i<m_threads.size(); i++)
+		delete m_threads[i];
+	m_threads.clear();
+}
+
+/*
+ * Every head has a line waiting, or getLine() would return false or throw
+ */
+bool MultiHead::isLineReady() const {
+	if (m_quit)
+		return true;
+	for (size_t h=0; h<m_rings.size(); h++)
+		if (m_rings[h].failed)
+			return true;
+	for (size_t h=0; h<m_rings.size(); h++) {
+		if (m_rings[h].count == 0)
+			return m_rings[h].ended;
+	}
+	return true;
+}
+
+/*
+ * Wait up to timeout_ms for a line from every head, so that the caller
+ * can check whether it was stopped before calling getLine()
+ */
+bool MultiHead::waitLine(int timeout_ms) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	if (!isLineReady())
+		m_cond.wait(timeout_ms / 1000.);
+	return isLineReady();
+}
+
+/*
+ * Wait for the next frame number received by all the heads, returns
+ * false when stopped or when a replay source is exhausted, throws the
+ * error of a head that failed. Dropping the unmatched lines may empty
+ * a ring again, the wait is then bounded so that stop() is seen.
+ */
+bool MultiHead::getLine(unsigned short* bptr, int& frame_type) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+
+	while (!m_quit) {
+		for (size_t h=0; h<m_rings.size(); h++) {
+			if (m_rings[h].failed) {
+				THROW_HW_ERROR(Error) << "MultiHead::getLine(): head " << h << ": " << m_rings[h].error;
+			}
+		}
+		bool ready = true;
+		int newest = 0;
+		for (size_t h=0; h<m_rings.size(); h++) {
+			Ring& ring = m_rings[h];
+			if (ring.count == 0) {
+				if (ring.ended)
+					return false;
+				ready = false;
+				break;
+			}
+			int frame_nb = ring.frame_nb[ring.first];
+			if (h == 0 || frame_nb - newest > 0)
+				newest = frame_nb;
+		}
+		if (!ready) {
+			m_cond.wait(multiPollMs / 1000.);
+			continue;
+		}
+		bool aligned = true;
+		for (size_t h=0; h<m_rings.size(); h++) {
+			Ring& ring = m_rings[h];
+			while (ring.count && ring.frame_nb[ring.first] - newest < 0) {
+				DEB_TRACE() << "MultiHead::getLine() unmatched " << DEB_VAR2(h, ring.frame_nb[ring.first]);
+				ring.first = (ring.first + 1) % multiRingLines;
+				ring.count--;
+				ring.unmatched++;
+			}
+			if (ring.count == 0)
+				aligned = false;
+		}
+		m_cond.broadcast();
+		if (!aligned)
+			continue;
+		frame_type = m_rings[0].frame_type[m_rings[0].first];
+		for (size_t h=0; h<m_rings.size(); h++) {
+			Ring& ring = m_rings[h];
+			memcpy(bptr + h * m_npixels, &ring.lines[ring.first * m_npixels], m_npixels * sizeof(short));
+			ring.first = (ring.first + 1) % multiRingLines;
+			ring.count--;
+		}
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Most lines waiting in a head ring
+ */
+int MultiHead::getPending() {
+	AutoMutex aLock(m_cond.mutex());
+	int pending = 0;
+	for (size_t h=0; h<m_rings.size(); h++)
+		if (m_rings[h].count > pending)
+			pending = m_rings[h].count;
+	return pending;
+}
+
+void MultiHead::getUnmatched(int head, unsigned long long& count) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	if (head < 0 || head >= (int) m_rings.size()) {
+		THROW_HW_ERROR(InvalidValue) << "MultiHead::getUnmatched(): invalid head";
+	}
+	count = m_rings[head].unmatched;
+}
+
+void MultiHead::resetCounters() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	for (size_t h=0; h<m_rings.size(); h++)
+		m_rings[h].unmatched = 0;
+}
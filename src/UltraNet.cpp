@@ -43,9 +43,11 @@
 #include <fcntl.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <signal.h>
 
 #include "UltraNet.h"
+#include "UltraSocketUtils.h"
 #include "lima/ThreadUtils.h"
 #include "lima/Exceptions.h"
 #include "lima/Debug.h"
@@ -60,6 +62,154 @@ const string terminator = "\r\n";
 
 using namespace std;
 using namespace lima;
+
+//---------------------------
+//- command I/O thread
+//---------------------------
+class UltraNet::IoThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "UltraNet", "IoThread");
+public:
+	IoThread(UltraNet& net);
+	virtual ~IoThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	UltraNet& m_net;
+};
+
+UltraNet::IoThread::IoThread(UltraNet& net) : m_net(net) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+UltraNet::IoThread::~IoThread() {
+	AutoMutex aLock(m_net.m_cond.mutex());
+	m_net.m_io_quit = true;
+	m_net.wakeIoThread();
+	m_net.m_cond.broadcast();
+}
+
+/*
+ * Write the queued commands as soon as they are submitted, without
+ * waiting for the replies of the previous ones, and complete the
+ * commands in flight in order as their replies come back. A socket
+ * error or a reply missing its deadline starts an outage: the socket is
+ * closed and reopened with an exponential backoff, then the cached
+ * configuration is sent again before the commands still queued. The
+ * commands queued meanwhile still fail at their own deadline.
+ */
+void UltraNet::IoThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	char recvBuf[RD_BUFF];
+	string replies;
+	double backoff = m_net.m_backoff_min;
+	long long reconnect_time = 0;		// next connection attempt, 0 when not scheduled
+	AutoMutex aLock(m_net.m_cond.mutex());
+
+	while (!m_net.m_io_quit) {
+		long long now = Metrics::now();
+		m_net.expireCommands(now);
+		if (!m_net.m_valid) {
+			if (!m_net.m_reconnect) {
+				m_net.failCommands("UltraNet::IoThread: not connected to server");
+				reconnect_time = 0;
+				m_net.m_cond.wait();
+				continue;
+			}
+			// a submission wakes us up, keep the attempt time but expire the commands in time
+			if (!reconnect_time)
+				reconnect_time = now + (long long) (backoff * 1e9);
+			if (now < reconnect_time) {
+				long long wake = reconnect_time;
+				for (size_t i=0; i<m_net.m_queue.size(); i++)
+					if (m_net.m_queue[i]->deadline < wake)
+						wake = m_net.m_queue[i]->deadline;
+				m_net.m_cond.wait((wake - now) * 1e-9 + 1e-3);
+				continue;
+			}
+			reconnect_time = 0;
+			aLock.unlock();
+			bool connected = true;
+			try {
+				m_net.openControl();
+			} catch (Exception& e) {
+				connected = false;
+			}
+			aLock.lock();
+			if (!connected) {
+				backoff = (backoff * 2 < m_net.m_backoff_max) ? backoff * 2 : m_net.m_backoff_max;
+				continue;
+			}
+			backoff = m_net.m_backoff_min;
+			replies.clear();
+			m_net.endOutage();
+			continue;
+		}
+		if (m_net.m_queue.empty() && m_net.m_inflight.empty()) {
+			m_net.m_cond.wait();
+			continue;
+		}
+		string out;
+		while (!m_net.m_queue.empty()) {
+			out += m_net.m_queue.front()->text + terminator;
+			m_net.m_inflight.push_back(m_net.m_queue.front());
+			m_net.m_queue.pop_front();
+		}
+		long long wait_ns = m_net.m_inflight.front()->deadline - Metrics::now();
+		int timeout_ms = (wait_ns > 0) ? wait_ns / 1000000 + 1 : 0;
+		aLock.unlock();
+		try {
+			if (!out.empty())
+				m_net.writeControl(out);
+			struct pollfd pfd[2];
+			pfd[0].fd = m_net.m_skt;
+			pfd[0].events = POLLIN;
+			pfd[1].fd = m_net.m_wake[0];
+			pfd[1].events = POLLIN;
+			if (poll(pfd, 2, timeout_ms) < 0 && errno != EINTR) {
+				THROW_HW_ERROR(Error) << "UltraNet::IoThread: poll error";
+			}
+			if (pfd[1].revents) {
+				char c;
+				while (read(m_net.m_wake[0], &c, 1) > 0)
+					;
+			}
+			if (pfd[0].revents) {
+				int count = read(m_net.m_skt, recvBuf, RD_BUFF);
+				if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+					THROW_HW_ERROR(Error) << "UltraNet::IoThread: read from socket error";
+				}
+				if (count > 0)
+					replies.append(recvBuf, count);
+			}
+		} catch (Exception& e) {
+			aLock.lock();
+			m_net.startOutage(e.getErrMsg());
+			continue;
+		}
+		aLock.lock();
+		size_t end;
+		while (!m_net.m_inflight.empty() && (end = replies.find(terminator)) != string::npos) {
+			end += terminator.size();
+			Command* command = m_net.m_inflight.front();
+			m_net.m_inflight.pop_front();
+			string reply = replies.substr(0, end);
+			replies.erase(0, end);
+			if (m_net.m_metrics)
+				m_net.m_metrics->addLatency(Metrics::CommandRtt, Metrics::now() - command->submitted);
+			if (reply.compare("ACK\r\n") == 0)
+				m_net.cacheCommand(command->text);
+			command->reply.set_value(reply);
+			delete command;
+		}
+		// the replies to come would be out of step, start over
+		if (!m_net.m_inflight.empty() && Metrics::now() > m_net.m_inflight.front()->deadline)
+			m_net.startOutage("UltraNet::IoThread: no reply to " + m_net.m_inflight.front()->text);
+	}
+	m_net.failCommands("UltraNet::IoThread: disconnected");
+}
+
 UltraNet::UltraNet() {
 	DEB_CONSTRUCTOR();
 	// Ignore the sigpipe we get we try to send quit to
@@ -73,56 +223,128 @@ UltraNet::UltraNet() {
 	m_data_port = -1;
 	firstFrame = true;
 	lastFrameNo = 0;
+	m_frame_type = 0;
+	m_capture = 0;
+	m_replay = 0;
+	m_metrics = 0;
+	m_rcvbuf_size = 32000000;
+	m_rcvbuf_granted = 0;
+	m_kernel_drops = 0;
+	m_io_thread = 0;
+	m_io_quit = false;
+	m_ctrl_port = 0;
+	m_cmd_timeout = 2.0;
+	m_reconnect = true;
+	m_backoff_min = 0.1;
+	m_backoff_max = 10.0;
+	m_outage_count = 0;
+	m_outage_total = 0;
+	m_outage_last = 0;
+	m_outage_start = 0;
+	if (pipe(m_wake) < 0) {
+		THROW_HW_ERROR(Error) << "UltraNet::UltraNet(): cannot create the wake up pipe";
+	}
+	fcntl(m_wake[0], F_SETFL, O_NONBLOCK);
+	fcntl(m_wake[1], F_SETFL, O_NONBLOCK);
 }
 
 UltraNet::~UltraNet() {
 	DEB_DESTRUCTOR();
+	disconnectFromServer();
+	close(m_wake[0]);
+	close(m_wake[1]);
 }
 
 /*
- * Connect to remote server
+ * Connect to remote server, the connection is then kept by the I/O thread
  */
 void UltraNet::connectToServer(const string hostname, int port) {
 	DEB_MEMBER_FUNCT();
-	struct hostent *host;
-	struct protoent *protocol;
-	int opt;
 
-	if (m_valid) {
+	if (m_io_thread) {
 		THROW_HW_ERROR(Error) << "UltraNet::connectToServer(): Already connected to server";
 	}
-	if ((host = gethostbyname(hostname.c_str())) == 0) {
-		endhostent();
-		THROW_HW_ERROR(Error) << "UltraNet::connectToServer(): Can't get gethostbyname";
-	}
-	if ((m_skt = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-		endhostent();
-		THROW_HW_ERROR(Error) << "UltraNet::connectToServer(): Can't create socket";
+	m_ctrl_host = hostname;
+	m_ctrl_port = port;
+	openControl();
+	m_io_quit = false;
+	m_io_thread = new IoThread(*this);
+	m_io_thread->start();
+}
+
+/*
+ * Non-blocking connect bounded by the command timeout, sets m_skt and
+ * m_valid. The host name should be numeric, a name lookup may block.
+ */
+void UltraNet::openControl() {
+	DEB_MEMBER_FUNCT();
+	struct addrinfo hints, *res;
+	stringstream port;
+	int skt, opt, err;
+	socklen_t len = sizeof(err);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	port << m_ctrl_port;
+	if (getaddrinfo(m_ctrl_host.c_str(), port.str().c_str(), &hints, &res) != 0) {
+		THROW_HW_ERROR(Error) << "UltraNet::openControl(): Can't resolve " << m_ctrl_host;
 	}
-	m_remote_addr.sin_family = host->h_addrtype;
-	m_remote_addr.sin_port = htons (port);
-	size_t len = host->h_length;
-	memcpy(&m_remote_addr.sin_addr.s_addr, host->h_addr, len);
-	endhostent();
-	if (connect(m_skt, (struct sockaddr *) &m_remote_addr, sizeof(struct sockaddr_in)) == -1) {
-		close(m_skt);
-		THROW_HW_ERROR(Error) << "UltraNet::connectToServer(): Connection to server refused. Is the server running?";
+	if ((skt = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+		freeaddrinfo(res);
+		THROW_HW_ERROR(Error) << "UltraNet::openControl(): Can't create socket";
 	}
-	protocol = getprotobyname("tcp");
-	if (protocol == 0) {
-		THROW_HW_ERROR(Error) << "UltraNet::connectToServer(): Can't get protocol TCP";
-	} else {
-		opt = 1;
-		if (setsockopt(m_skt, protocol->p_proto, TCP_NODELAY, (char *) &opt, 4) < 0) {
-			THROW_HW_ERROR(Error) << "UltraNet::connectToServer(): Can't set socket options";
+	memcpy(&m_remote_addr, res->ai_addr, sizeof(m_remote_addr));
+	freeaddrinfo(res);
+	fcntl(skt, F_SETFL, O_NONBLOCK);
+	if (connect(skt, (struct sockaddr *) &m_remote_addr, sizeof(struct sockaddr_in)) == -1) {
+		struct pollfd pfd;
+		pfd.fd = skt;
+		pfd.events = POLLOUT;
+		if (errno != EINPROGRESS || poll(&pfd, 1, (int) (m_cmd_timeout * 1000)) <= 0 ||
+				getsockopt(skt, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+			close(skt);
+			THROW_HW_ERROR(Error) << "UltraNet::openControl(): Connection to server refused. Is the server running?";
 		}
 	}
-	endprotoent();
+	opt = 1;
+	if (setsockopt(skt, IPPROTO_TCP, TCP_NODELAY, (char *) &opt, sizeof(opt)) < 0) {
+		close(skt);
+		THROW_HW_ERROR(Error) << "UltraNet::openControl(): Can't set socket options";
+	}
+	AutoMutex aLock(m_cond.mutex());
+	m_skt = skt;
 	m_valid = 1;
 }
 
+/*
+ * Write all the data, bounded by the command timeout
+ */
+void UltraNet::writeControl(const string& data) {
+	DEB_MEMBER_FUNCT();
+	size_t done = 0;
+	while (done < data.size()) {
+		int count = write(m_skt, data.data() + done, data.size() - done);
+		if (count > 0) {
+			done += count;
+			continue;
+		}
+		if (count < 0 && errno != EAGAIN && errno != EINTR) {
+			THROW_HW_ERROR(Error) << "UltraNet::writeControl(): write to socket error";
+		}
+		struct pollfd pfd;
+		pfd.fd = m_skt;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, (int) (m_cmd_timeout * 1000)) <= 0) {
+			THROW_HW_ERROR(Error) << "UltraNet::writeControl(): write timeout";
+		}
+	}
+}
+
 void UltraNet::disconnectFromServer() {
 	DEB_MEMBER_FUNCT();
+	delete m_io_thread;
+	m_io_thread = 0;
 	if (m_valid) {
 		shutdown(m_skt, 2);
 		close(m_skt);
@@ -130,24 +352,198 @@ void UltraNet::disconnectFromServer() {
 	}
 }
 
+void UltraNet::wakeIoThread() {
+	char c = 0;
+	if (write(m_wake[1], &c, 1) < 0)
+		return;
+}
+
+/*
+ * The functions below are called with the lock held
+ */
+static exception_ptr makeError(const string& msg) {
+	DEB_GLOBAL_FUNCT();
+	try {
+		THROW_HW_ERROR(Error) << msg;
+	} catch (...) {
+		return current_exception();
+	}
+	return exception_ptr();
+}
+
+void UltraNet::failCommands(const string& msg) {
+	exception_ptr error = makeError(msg);
+	while (!m_inflight.empty()) {
+		m_inflight.front()->reply.set_exception(error);
+		delete m_inflight.front();
+		m_inflight.pop_front();
+	}
+	while (!m_queue.empty()) {
+		m_queue.front()->reply.set_exception(error);
+		delete m_queue.front();
+		m_queue.pop_front();
+	}
+}
+
+void UltraNet::expireCommands(long long now) {
+	deque<Command*>::iterator it = m_queue.begin();
+	while (it != m_queue.end()) {
+		if (now < (*it)->deadline) {
+			++it;
+			continue;
+		}
+		(*it)->reply.set_exception(makeError("UltraNet: command timeout: " + (*it)->text));
+		delete *it;
+		it = m_queue.erase(it);
+	}
+}
+
+void UltraNet::startOutage(const string& reason) {
+	DEB_MEMBER_FUNCT();
+	DEB_WARNING() << "connection to " << m_ctrl_host << " lost: " << reason;
+	shutdown(m_skt, 2);
+	close(m_skt);
+	m_valid = 0;
+	exception_ptr error = makeError(reason);
+	while (!m_inflight.empty()) {
+		m_inflight.front()->reply.set_exception(error);
+		delete m_inflight.front();
+		m_inflight.pop_front();
+	}
+	m_outage_start = Metrics::now();
+	m_outage_count++;
+}
+
+void UltraNet::endOutage() {
+	DEB_MEMBER_FUNCT();
+	double duration = (Metrics::now() - m_outage_start) * 1e-9;
+	m_outage_last = duration;
+	m_outage_total += duration;
+	DEB_WARNING() << "reconnected to " << m_ctrl_host << " after " << duration << " s, replaying "
+			<< m_config.size() << " settings";
+	long long now = Metrics::now();
+	for (size_t i=m_config.size(); i>0; i--) {
+		Command* command = new Command;
+		command->text = m_config[i-1];
+		command->submitted = now;
+		command->deadline = now + (long long) (m_cmd_timeout * 1e9);
+		m_queue.push_front(command);
+	}
+}
+
+/*
+ * Keep the last acknowledged value of each set command, in first set order
+ */
+void UltraNet::cacheCommand(const string& cmd) {
+	if (cmd.compare(0, 4, "set ") != 0)
+		return;
+	string key = cmd.substr(4, cmd.find(' ', 4) - 4);
+	map<string, size_t>::iterator it = m_config_index.find(key);
+	if (it != m_config_index.end()) {
+		m_config[it->second] = cmd;
+	} else {
+		m_config_index[key] = m_config.size();
+		m_config.push_back(cmd);
+	}
+}
+
+UltraNet::Command* UltraNet::newCommand(const string& cmd, long long now) {
+	DEB_MEMBER_FUNCT();
+	if (!m_io_thread || (!m_valid && !m_reconnect)) {
+		THROW_HW_ERROR(Error) << "UltraNet: not connected to server";
+	}
+	Command* command = new Command;
+	command->text = cmd;
+	command->submitted = now;
+	command->deadline = now + (long long) (m_cmd_timeout * 1e9);
+	m_queue.push_back(command);
+	return command;
+}
+
+/*
+ * Queue a command for the I/O thread, the future holds its reply or
+ * the error, at the latest after the command timeout
+ */
+future<string> UltraNet::sendAsync(const string& cmd) {
+	DEB_MEMBER_FUNCT();
+	DEB_TRACE() << "sendAsync(" << cmd << ")";
+	AutoMutex aLock(m_cond.mutex());
+
+	future<string> reply = newCommand(cmd, Metrics::now())->reply.get_future();
+	wakeIoThread();
+	m_cond.broadcast();
+	return reply;
+}
+
 void UltraNet::sendWait(string cmd, string& value) {
 	DEB_MEMBER_FUNCT();
 	DEB_TRACE() << "sendWait(" << cmd << ")";
-	AutoMutex aLock(m_cond.mutex());
-	int count;
-	char recvBuf[41];
-	string command = cmd + terminator;
+	value = sendAsync(cmd).get();
+}
+
+/*
+ * Submit all the commands before waiting for the first reply, they go
+ * out in a single write unless the I/O thread is already busy.
+ */
+void UltraNet::sendWaitBatch(const vector<string>& cmds, vector<string>& values) {
+	DEB_MEMBER_FUNCT();
+	DEB_TRACE() << "sendWaitBatch(" << cmds.size() << " commands)";
+	vector<future<string> > replies;
+
+	{
+		AutoMutex aLock(m_cond.mutex());
+		long long now = Metrics::now();
+		for (size_t i=0; i<cmds.size(); i++)
+			replies.push_back(newCommand(cmds[i], now)->reply.get_future());
+		wakeIoThread();
+		m_cond.broadcast();
+	}
+	values.clear();
+	for (size_t i=0; i<replies.size(); i++)
+		values.push_back(replies[i].get());
+}
 
-	if (write(m_skt, command.c_str(), strlen(command.c_str())) <= 0) {
-		THROW_HW_ERROR(Error) << "UltraNet::sendWait(): write to socket error";
+void UltraNet::setCommandTimeout(double timeout) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(timeout);
+	if (timeout <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "UltraNet::setCommandTimeout(): invalid timeout";
 	}
-	if ((count = read(m_skt, recvBuf, 40)) <= 0) {
-		THROW_HW_ERROR(Error) << "UltraNet::sendWait(): read from socket error";
+	AutoMutex aLock(m_cond.mutex());
+	m_cmd_timeout = timeout;
+}
+
+void UltraNet::setReconnect(bool enabled, double backoff_min, double backoff_max) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(enabled, backoff_min, backoff_max);
+	if (backoff_min <= 0 || backoff_max < backoff_min) {
+		THROW_HW_ERROR(InvalidValue) << "UltraNet::setReconnect(): invalid backoff";
 	}
-	recvBuf[count] = 0;
-	stringstream ss;
-	ss << recvBuf;
-	value = ss.str();
+	AutoMutex aLock(m_cond.mutex());
+	m_reconnect = enabled;
+	m_backoff_min = backoff_min;
+	m_backoff_max = backoff_max;
+	m_cond.broadcast();
+}
+
+double UltraNet::getCommandTimeout() const {
+	AutoMutex aLock(m_cond.mutex());
+	return m_cmd_timeout;
+}
+
+bool UltraNet::getReconnect() const {
+	AutoMutex aLock(m_cond.mutex());
+	return m_reconnect;
+}
+
+void UltraNet::getOutages(int& count, double& total, double& last) const {
+	AutoMutex aLock(m_cond.mutex());
+	count = m_outage_count;
+	total = m_outage_total;
+	last = m_outage_last;
+	// still running
+	if (!m_valid && m_io_thread)
+		last = (Metrics::now() - m_outage_start) * 1e-9;
 }
 
 void UltraNet::initServerDataPort(const string hostname, int port) {
@@ -160,10 +556,12 @@ void UltraNet::initServerDataPort(const string hostname, int port) {
 		if ((m_data_listen_skt = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
 			THROW_HW_ERROR(Error) << "UltraNet::initServerDataPort(): create data socket error";
 		}
-		int optval = 32000000;
-		if (setsockopt(m_data_listen_skt, SOL_SOCKET, SO_RCVBUF,(const char *)&optval, sizeof(optval)) < 0) {
+		if ((m_rcvbuf_granted = setSocketRcvBuf(m_data_listen_skt, m_rcvbuf_size)) < 0) {
 			THROW_HW_ERROR(Error) << "UltraNet::initServerDataPort(): setsocketopt error";
 		}
+		checkRcvBuf();
+		enableSocketDropCounter(m_data_listen_skt);
+		m_kernel_drops = 0;
 		// Bind the listening socket so that the server may connect to it.
 		// Create a unique port number for the server to connect to.
 		// Assign a port number at random. Allow anyone to connect.
@@ -175,6 +573,8 @@ void UltraNet::initServerDataPort(const string hostname, int port) {
 		if (bind(m_data_listen_skt, (struct sockaddr *) &data_addr, sizeof(struct sockaddr_in)) == -1) {
 			THROW_HW_ERROR(Error) << "UltraNet::initServerDataPort(): bind to socket error";
 		}
+		m_data_port = port;
+		m_data_host = hostname;
 //		if (listen(m_data_listen_skt, 1) == -1) {
 //			THROW_HW_ERROR(Error) << "UltraNet::sendWait(): write to socket error";
 //			close(m_data_listen_skt);
@@ -189,30 +589,241 @@ void UltraNet::initServerDataPort(const string hostname, int port) {
 	}
 }
 
-void UltraNet::getData(void* bptr, int numBytes) {
+void UltraNet::setRawCapture(RawCapture* capture) {
+	DEB_MEMBER_FUNCT();
+	m_capture = capture;
+}
+
+void UltraNet::setReplay(RawReplay* replay) {
+	DEB_MEMBER_FUNCT();
+	m_replay = replay;
+	resetFrameSequence();
+}
+
+/*
+ * Receive on nb_shards SO_REUSEPORT sockets instead of one, 1 goes back
+ * to the single socket
+ */
+void UltraNet::setReceiveShards(int nb_shards, int first_cpu, int datagram_size) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(nb_shards, first_cpu);
+	if (m_data_port == -1) {
+		THROW_HW_ERROR(Error) << "UltraNet::setReceiveShards(): data port not initialised";
+	}
+	if (nb_shards <= 1) {
+		if (!m_shards.getNbShards())
+			return;
+		m_shards.close();
+		int port = m_data_port;
+		m_data_port = -1;
+		initServerDataPort(m_data_host, port);
+	} else {
+		if (!m_shards.getNbShards())
+			close(m_data_listen_skt);
+		m_shards.open(m_data_host, m_data_port, nb_shards, first_cpu, datagram_size);
+		m_rcvbuf_granted = m_shards.setRcvBuf(m_rcvbuf_size);
+		checkRcvBuf();
+	}
+	resetFrameSequence();
+}
+
+/*
+ * Receive buffer of the data socket(s), each shard gets the full size
+ */
+void UltraNet::setRcvBuf(int size) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(size);
+	if (size <= 0) {
+		THROW_HW_ERROR(InvalidValue) << "UltraNet::setRcvBuf(): invalid size";
+	}
+	m_rcvbuf_size = size;
+	if (m_shards.getNbShards())
+		m_rcvbuf_granted = m_shards.setRcvBuf(size);
+	else if (m_data_port != -1)
+		m_rcvbuf_granted = setSocketRcvBuf(m_data_listen_skt, size);
+	else
+		return;
+	checkRcvBuf();
+}
+
+void UltraNet::getRcvBuf(int& requested, int& granted) const {
+	requested = m_rcvbuf_size;
+	granted = m_rcvbuf_granted;
+}
+
+void UltraNet::checkRcvBuf() {
+	DEB_MEMBER_FUNCT();
+	// the kernel reports twice the size it was given
+	if (m_rcvbuf_granted / 2 < m_rcvbuf_size) {
+		DEB_WARNING() << "receive buffer clamped to " << m_rcvbuf_granted / 2 << " bytes instead of "
+				<< m_rcvbuf_size << ", check net.core.rmem_max";
+	}
+}
+
+/*
+ * Datagrams dropped by the kernel on the data socket(s) since they were opened
+ */
+unsigned long long UltraNet::getKernelDrops() const {
+	if (m_shards.getNbShards())
+		return m_shards.getKernelDrops();
+	return m_kernel_drops;
+}
+
+int UltraNet::getReceiveShards() const {
+	int nb_shards = m_shards.getNbShards();
+	return (nb_shards) ? nb_shards : 1;
+}
+
+void UltraNet::setMetrics(Metrics* metrics) {
+	DEB_MEMBER_FUNCT();
+	m_metrics = metrics;
+}
+
+/*
+ * Lines received but not read yet, only known for the sharded receive
+ */
+int UltraNet::getPending() {
+	return (m_shards.getNbShards()) ? m_shards.getPending() : 0;
+}
+
+void UltraNet::resetFrameSequence() {
+	DEB_MEMBER_FUNCT();
+	firstFrame = true;
+	if (m_shards.getNbShards())
+		m_shards.reset();
+}
+
+/*
+ * Drop the datagrams already queued on the data socket
+ */
+void UltraNet::flushData() {
+	DEB_MEMBER_FUNCT();
+	char buffer[RD_BUFF * 2];
+	if (m_replay)
+		return;
+	if (m_shards.getNbShards()) {
+		resetFrameSequence();
+		return;
+	}
+	while (recvCounted(m_data_listen_skt, buffer, sizeof(buffer), MSG_DONTWAIT, m_kernel_drops) > 0)
+		;
+	resetFrameSequence();
+}
+
+/*
+ * Wait up to timeout_ms for a datagram, always true for a replay source
+ */
+bool UltraNet::waitData(int timeout_ms) {
+	DEB_MEMBER_FUNCT();
+	struct pollfd pfd;
+	if (m_replay)
+		return true;
+	if (m_shards.getNbShards())
+		return m_shards.waitNext(timeout_ms);
+	pfd.fd = m_data_listen_skt;
+	pfd.events = POLLIN;
+	return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+/*
+ * Receive one line, its hardware frame number and frame type without
+ * any sequence check. Returns the datagram length, 0 when the replay source is
+ * exhausted or -1 on a receive error, or with errno EAGAIN when wait is false
+ * and no line is pending.
+ */
+int UltraNet::recvFrame(void* bptr, int numBytes, int& frameNo, int& frameType, bool wait) {
 	DEB_MEMBER_FUNCT();
 	unsigned char buffer[numBytes+6];
 	unsigned char* cptr = buffer;
-	int frameNo;
-//	int frameType;
-	if (recv(m_data_listen_skt, buffer, sizeof(buffer), 0) != -1) {
-		frameNo = (((unsigned int) cptr[0]) << 24) + (((unsigned int) cptr[1]) << 16) + (((unsigned int) cptr[2]) << 8)
-				+ (unsigned int) cptr[3];
-		// no used at the moment
-//		frameType = (((unsigned int) cptr[4]) << 8) + (unsigned int) cptr[5];
-		// check for missing frames
-		if (!firstFrame && frameNo != lastFrameNo + 1) {
-			THROW_HW_ERROR(Error) << "UltraNet::getData(): frame sequence error: Lost data";
+	int len;
+	if (m_replay) {
+		if ((len = m_replay->next(buffer, sizeof(buffer))) == 0)
+			return 0;
+	} else {
+		if (m_shards.getNbShards()) {
+			if (!wait && !m_shards.waitNext(0)) {
+				errno = EAGAIN;
+				return -1;
+			}
+			len = m_shards.next(buffer, sizeof(buffer));
+		} else {
+			len = recvCounted(m_data_listen_skt, buffer, sizeof(buffer), (wait) ? 0 : MSG_DONTWAIT, m_kernel_drops);
 		}
-		DEB_TRACE() << "UltraNet::getData()" << DEB_VAR3(firstFrame, frameNo, lastFrameNo);
-		lastFrameNo = frameNo;
-		firstFrame = false;
-		memcpy(bptr, cptr+6, numBytes);
-		unsigned short *dptr = (unsigned short*) bptr;
-		for (int i=0; i<numBytes/2; i++) {
-			if (dptr[i] != 0)
-				DEB_TRACE() << "UltraNet::getData()" << DEB_VAR2(i, dptr[i]);
+		if (len != -1 && m_capture)
+			m_capture->append(buffer, len);
+	}
+	if (len == -1)
+		return -1;
+	if (m_metrics) {
+		m_metrics->add(Metrics::PacketsReceived);
+		m_metrics->add(Metrics::BytesReceived, len);
+	}
+	frameNo = (((unsigned int) cptr[0]) << 24) + (((unsigned int) cptr[1]) << 16) + (((unsigned int) cptr[2]) << 8)
+			+ (unsigned int) cptr[3];
+	frameType = (((unsigned int) cptr[4]) << 8) + (unsigned int) cptr[5];
+	memcpy(bptr, cptr+6, numBytes);
+	return len;
+}
+
+/*
+ * Receive one line, returns false when the replay source is exhausted or the
+ * receiver threads are stopped. An interrupted receive is retried, any other
+ * receive error throws. The lines missing from the frame sequence are counted
+ * in the sequence gaps and skipped, the next line received is returned.
+ */
+bool UltraNet::getData(void* bptr, int numBytes) {
+	return receiveLine(bptr, numBytes, true) > 0;
+}
+
+/*
+ * getData() without blocking, so that the caller polls only once the lines
+ * pending are read. Returns 1 with a line, 0 when none is pending and -1
+ * when the replay source is exhausted.
+ */
+int UltraNet::tryGetData(void* bptr, int numBytes) {
+	return receiveLine(bptr, numBytes, false);
+}
+
+int UltraNet::receiveLine(void* bptr, int numBytes, bool wait) {
+	DEB_MEMBER_FUNCT();
+	int frameNo, frameType;
+	int len;
+	while ((len = recvFrame(bptr, numBytes, frameNo, frameType, wait)) == -1) {
+		if (!wait && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		if (m_shards.getNbShards())
+			return -1;
+		if (errno != EINTR && errno != EAGAIN) {
+			THROW_HW_ERROR(Error) << "UltraNet::getData(): receive error: " << strerror(errno);
 		}
 	}
-	return;
+	if (len == 0)
+		return -1;
+	// check for missing frames
+	if (!firstFrame && frameNo != lastFrameNo + 1) {
+		unsigned int missing = (unsigned int) frameNo - (unsigned int) lastFrameNo - 1;
+		if (missing >= 0x80000000u)		// out of order, or the head restarted
+			missing = 1;
+		if (m_metrics)
+			m_metrics->add(Metrics::SequenceGaps, missing);
+		DEB_WARNING() << "UltraNet::getData(): frame sequence error: " << missing << " lines lost after frame "
+				<< lastFrameNo << " (" << getKernelDrops() << " datagrams dropped by the kernel)";
+	}
+	DEB_TRACE() << "UltraNet::getData()" << DEB_VAR3(firstFrame, frameNo, lastFrameNo);
+	lastFrameNo = frameNo;
+	m_frame_type = frameType;
+	firstFrame = false;
+	unsigned short *dptr = (unsigned short*) bptr;
+	for (int i=0; i<numBytes/2; i++) {
+		if (dptr[i] != 0)
+			DEB_TRACE() << "UltraNet::getData()" << DEB_VAR2(i, dptr[i]);
+	}
+	return 1;
+}
+
+/*
+ * Frame type field of the last line returned by getData()
+ */
+int UltraNet::getFrameType() const {
+	return m_frame_type;
 }
@@ -0,0 +1,314 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraRawCapture.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "UltraRawCapture.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+static const char rawMagic[8] = {'U','L','T','R','A','R','A','W'};
+static const uint32_t rawVersion = 1;
+static const uint32_t rawHeaderSize = 4096;
+static const uint64_t rawFlushSize = 8 * 1024 * 1024;	// writeback granularity
+
+static inline uint64_t recordSize(uint32_t len) {
+	return (sizeof(RawRecordHeader) + len + 7) & ~((uint64_t) 7);
+}
+
+static inline uint64_t monotonicNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//---------------------------
+// RawCapture
+//---------------------------
+
+RawCapture::RawCapture() : m_fd(-1), m_map(0), m_header(0), m_flushed(0) {
+	DEB_CONSTRUCTOR();
+}
+
+RawCapture::~RawCapture() {
+	DEB_DESTRUCTOR();
+	close();
+}
+
+void RawCapture::open(const string& filename, long long size) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(filename, size);
+
+	if (isOpen()) {
+		THROW_HW_ERROR(Error) << "RawCapture::open(): a capture file is already open";
+	}
+	if (size < (long long) (rawHeaderSize + recordSize(0)) * 2) {
+		THROW_HW_ERROR(InvalidValue) << "RawCapture::open(): capture file size too small";
+	}
+	size = (size + 4095) & ~4095LL;
+	if ((m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+		THROW_HW_ERROR(Error) << "RawCapture::open(): can't create " << filename << ": " << strerror(errno);
+	}
+	int err = posix_fallocate(m_fd, 0, size);
+	if (err != 0) {
+		::close(m_fd);
+		m_fd = -1;
+		THROW_HW_ERROR(Error) << "RawCapture::open(): can't preallocate " << size << " bytes: " << strerror(err);
+	}
+	void* map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED) {
+		::close(m_fd);
+		m_fd = -1;
+		THROW_HW_ERROR(Error) << "RawCapture::open(): mmap failed: " << strerror(errno);
+	}
+	madvise(map, size, MADV_SEQUENTIAL);
+	m_map = (char*) map;
+	m_header = (RawFileHeader*) m_map;
+	memcpy(m_header->magic, rawMagic, sizeof(rawMagic));
+	m_header->version = rawVersion;
+	m_header->headerSize = rawHeaderSize;
+	m_header->fileSize = size;
+	m_header->head = rawHeaderSize;
+	m_header->tail = rawHeaderSize;
+	m_header->nbRecords = 0;
+	m_header->nbDropped = 0;
+	m_flushed = rawHeaderSize;
+	m_filename = filename;
+}
+
+void RawCapture::close() {
+	DEB_MEMBER_FUNCT();
+	if (!isOpen())
+		return;
+	flush(true);
+	munmap(m_map, m_header->fileSize);
+	::close(m_fd);
+	m_fd = -1;
+	m_map = 0;
+	m_header = 0;
+	m_filename.clear();
+}
+
+bool RawCapture::isOpen() const {
+	return m_fd != -1;
+}
+
+void RawCapture::getFilename(string& filename) const {
+	filename = m_filename;
+}
+
+void RawCapture::getNbRecords(long long& nb_records) const {
+	nb_records = (m_header) ? m_header->nbRecords : 0;
+}
+
+void RawCapture::getNbDropped(long long& nb_dropped) const {
+	nb_dropped = (m_header) ? m_header->nbDropped : 0;
+}
+
+void RawCapture::append(const void* datagram, int len) {
+	DEB_MEMBER_FUNCT();
+	RawFileHeader* hdr = m_header;
+	uint64_t size = recordSize(len);
+
+	if (size > hdr->fileSize - hdr->headerSize) {
+		THROW_HW_ERROR(Error) << "RawCapture::append(): datagram larger than the capture file";
+	}
+	if (hdr->head + size > hdr->fileSize) {
+		// give up the end of the file and restart after the header
+		dropOldest(hdr->fileSize);
+		if (hdr->head + sizeof(RawRecordHeader) <= hdr->fileSize)
+			((RawRecordHeader*) (m_map + hdr->head))->length = rawWrapMarker;
+		flush(false);
+		hdr->head = hdr->headerSize;
+		m_flushed = hdr->head;
+	}
+	dropOldest(hdr->head + size);
+	if (hdr->nbRecords == hdr->nbDropped)
+		hdr->tail = hdr->head;
+
+	RawRecordHeader* rec = (RawRecordHeader*) (m_map + hdr->head);
+	rec->length = len;
+	rec->reserved = 0;
+	rec->timestamp = monotonicNs();
+	memcpy(rec + 1, datagram, len);
+	hdr->head += size;
+	hdr->nbRecords++;
+	if (hdr->head - m_flushed >= rawFlushSize)
+		flush(false);
+}
+
+void RawCapture::dropOldest(uint64_t end) {
+	RawFileHeader* hdr = m_header;
+	while (hdr->nbRecords != hdr->nbDropped && hdr->tail >= hdr->head && hdr->tail < end) {
+		const RawRecordHeader* rec = (const RawRecordHeader*) (m_map + hdr->tail);
+		hdr->tail += recordSize(rec->length);
+		hdr->nbDropped++;
+		// never leave the tail on the ring end
+		rec = (const RawRecordHeader*) (m_map + hdr->tail);
+		if (hdr->nbRecords != hdr->nbDropped &&
+				(hdr->tail + sizeof(RawRecordHeader) > hdr->fileSize || rec->length == rawWrapMarker))
+			hdr->tail = hdr->headerSize;
+	}
+}
+
+void RawCapture::flush(bool sync) {
+	// hand the filled pages over to writeback in large sequential chunks
+	uint64_t start = m_flushed & ~((uint64_t) 4095);
+	uint64_t end = (sync) ? m_header->fileSize : m_header->head;
+	if (end > start)
+		msync(m_map + start, end - start, (sync) ? MS_SYNC : MS_ASYNC);
+	msync(m_map, rawHeaderSize, (sync) ? MS_SYNC : MS_ASYNC);
+	m_flushed = m_header->head;
+}
+
+//---------------------------
+// RawReplay
+//---------------------------
+
+RawReplay::RawReplay() : m_realtime(false), m_fd(-1), m_map(0), m_size(0), m_header(0), m_offset(0),
+		m_wrapped(false), m_first_timestamp(0), m_start_time(0) {
+	DEB_CONSTRUCTOR();
+}
+
+RawReplay::~RawReplay() {
+	DEB_DESTRUCTOR();
+	close();
+}
+
+void RawReplay::open(const string& filename, bool realtime) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(filename, realtime);
+	struct stat st;
+
+	if (isOpen()) {
+		THROW_HW_ERROR(Error) << "RawReplay::open(): a replay file is already open";
+	}
+	if ((m_fd = ::open(filename.c_str(), O_RDONLY)) == -1) {
+		THROW_HW_ERROR(Error) << "RawReplay::open(): can't open " << filename << ": " << strerror(errno);
+	}
+	if (fstat(m_fd, &st) == -1 || (uint64_t) st.st_size < rawHeaderSize) {
+		::close(m_fd);
+		m_fd = -1;
+		THROW_HW_ERROR(Error) << "RawReplay::open(): " << filename << " is not a raw capture file";
+	}
+	void* map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED) {
+		::close(m_fd);
+		m_fd = -1;
+		THROW_HW_ERROR(Error) << "RawReplay::open(): mmap failed: " << strerror(errno);
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	m_map = (char*) map;
+	m_size = st.st_size;
+	m_header = (const RawFileHeader*) m_map;
+	if (memcmp(m_header->magic, rawMagic, sizeof(rawMagic)) != 0 || m_header->version != rawVersion
+			|| m_header->fileSize != m_size) {
+		close();
+		THROW_HW_ERROR(Error) << "RawReplay::open(): " << filename << " is not a raw capture file";
+	}
+	m_realtime = realtime;
+	m_filename = filename;
+	rewind();
+}
+
+void RawReplay::close() {
+	DEB_MEMBER_FUNCT();
+	if (m_map)
+		munmap(m_map, m_size);
+	if (m_fd != -1)
+		::close(m_fd);
+	m_fd = -1;
+	m_map = 0;
+	m_header = 0;
+	m_filename.clear();
+}
+
+bool RawReplay::isOpen() const {
+	return m_fd != -1;
+}
+
+void RawReplay::getFilename(string& filename) const {
+	filename = m_filename;
+}
+
+void RawReplay::rewind() {
+	DEB_MEMBER_FUNCT();
+	m_offset = m_header->tail;
+	m_wrapped = !(m_header->nbRecords != m_header->nbDropped && m_header->tail >= m_header->head);
+	m_start_time = 0;
+}
+
+/*
+ * Copy the next datagram into buffer, returns its length or 0 once
+ * all the records have been read.
+ */
+int RawReplay::next(void* buffer, int len) {
+	DEB_MEMBER_FUNCT();
+	const RawRecordHeader* rec;
+
+	while (true) {
+		if (m_wrapped && m_offset >= m_header->head)
+			return 0;
+		rec = (const RawRecordHeader*) (m_map + m_offset);
+		if (m_offset + sizeof(RawRecordHeader) > m_size || rec->length == rawWrapMarker) {
+			if (m_wrapped)
+				return 0;
+			m_wrapped = true;
+			m_offset = m_header->headerSize;
+			continue;
+		}
+		break;
+	}
+	if (m_offset + recordSize(rec->length) > m_size) {
+		THROW_HW_ERROR(Error) << "RawReplay::next(): corrupted record at offset " << m_offset;
+	}
+	if (m_realtime) {
+		uint64_t now = monotonicNs();
+		if (m_start_time == 0) {
+			m_start_time = now;
+			m_first_timestamp = rec->timestamp;
+		}
+		uint64_t due = m_start_time + (rec->timestamp - m_first_timestamp);
+		if (due > now) {
+			struct timespec ts;
+			ts.tv_sec = (due - now) / 1000000000ULL;
+			ts.tv_nsec = (due - now) % 1000000000ULL;
+			nanosleep(&ts, 0);
+		}
+	}
+	int n = ((int) rec->length < len) ? rec->length : len;
+	memcpy(buffer, rec + 1, n);
+	m_offset += recordSize(rec->length);
+	return n;
+}
@@ -0,0 +1,346 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraShardedReceiver.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "UltraShardedReceiver.h"
+#include "UltraSocketUtils.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+const int shardSlots = 1024;		// frames held for reordering, power of two
+const int reorderWindow = 64;		// frames ahead before a missing one is skipped
+const int slotWaitUs = 50;			// writer retry while its slot is not read yet
+const int shardPollMs = 100;		// receive thread stop latency
+
+//---------------------------
+//- receive thread, one per socket
+//---------------------------
+class ShardedReceiver::RecvThread: public Thread {
+DEB_CLASS_NAMESPC(DebModCamera, "ShardedReceiver", "RecvThread");
+public:
+	RecvThread(ShardedReceiver& recv, int shard, int cpu);
+	virtual ~RecvThread();
+
+protected:
+	virtual void threadFunction();
+
+private:
+	ShardedReceiver& m_recv;
+	int m_shard;
+	int m_cpu;
+};
+
+ShardedReceiver::RecvThread::RecvThread(ShardedReceiver& recv, int shard, int cpu) :
+		m_recv(recv), m_shard(shard), m_cpu(cpu) {
+	pthread_attr_setscope(&m_thread_attr, PTHREAD_SCOPE_PROCESS);
+}
+
+ShardedReceiver::RecvThread::~RecvThread() {
+	AutoMutex aLock(m_recv.m_cond.mutex());
+	m_recv.m_quit = true;
+	m_recv.m_cond.broadcast();
+}
+
+void ShardedReceiver::RecvThread::threadFunction() {
+	DEB_MEMBER_FUNCT();
+	vector<unsigned char> buffer(m_recv.m_datagram_size);
+	unsigned int drops = 0;
+	struct pollfd pfd;
+
+	if (m_cpu >= 0) {
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(m_cpu, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0)
+			DEB_WARNING() << "cannot pin the receive thread on cpu " << m_cpu;
+	}
+	pfd.fd = m_recv.m_skts[m_shard];
+	pfd.events = POLLIN;
+	while (!m_recv.m_quit) {
+		if (poll(&pfd, 1, shardPollMs) <= 0)
+			continue;
+		// drain the socket before polling again
+		int len;
+		while ((len = recvCounted(pfd.fd, &buffer[0], buffer.size(), MSG_DONTWAIT, drops)) >= 0) {
+			if (len >= 6)
+				m_recv.store(&buffer[0], len, m_shard, drops);
+		}
+	}
+}
+
+//---------------------------
+//- ShardedReceiver
+//---------------------------
+ShardedReceiver::ShardedReceiver() : m_datagram_size(0), m_synced(false), m_consumed(false), m_next(0), m_highest(0),
+		m_waiting(false), m_quit(false) {
+	DEB_CONSTRUCTOR();
+}
+
+ShardedReceiver::~ShardedReceiver() {
+	DEB_DESTRUCTOR();
+	close();
+}
+
+/*
+ * Bind nb_shards sockets on hostname:port, the threads are pinned on
+ * first_cpu, first_cpu + 1, ... unless first_cpu is negative.
+ */
+void ShardedReceiver::open(const string& hostname, int port, int nb_shards, int first_cpu, int datagram_size) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(hostname, port, nb_shards, first_cpu);
+	struct sockaddr_in data_addr;
+
+	close();
+	if (nb_shards <= 0 || datagram_size <= 6) {
+		THROW_HW_ERROR(InvalidValue) << "ShardedReceiver::open(): invalid argument";
+	}
+	data_addr.sin_family = AF_INET;
+	data_addr.sin_addr.s_addr = inet_addr(hostname.c_str());
+	data_addr.sin_port = htons(port);
+	for (int i=0; i<nb_shards; i++) {
+		int skt;
+		int one = 1;
+		if ((skt = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+			close();
+			THROW_HW_ERROR(Error) << "ShardedReceiver::open(): create data socket error";
+		}
+		m_skts.push_back(skt);
+		if (setsockopt(skt, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+			close();
+			THROW_HW_ERROR(Error) << "ShardedReceiver::open(): setsocketopt error";
+		}
+		enableSocketDropCounter(skt);
+		if (bind(skt, (struct sockaddr *) &data_addr, sizeof(struct sockaddr_in)) == -1) {
+			close();
+			THROW_HW_ERROR(Error) << "ShardedReceiver::open(): bind to socket error";
+		}
+	}
+	vector<atomic<unsigned int> >(nb_shards).swap(m_drops);
+	m_datagram_size = datagram_size;
+	m_slots.resize(shardSlots * datagram_size);
+	vector<atomic<int> >(shardSlots).swap(m_slot_state);
+	vector<atomic<int> >(shardSlots).swap(m_slot_frame);
+	m_slot_len.resize(shardSlots);
+	reset();
+	m_quit = false;
+	for (int i=0; i<nb_shards; i++) {
+		m_threads.push_back(new RecvThread(*this, i, (first_cpu < 0) ? -1 : first_cpu + i));
+		m_threads.back()->start();
+	}
+}
+
+void ShardedReceiver::close() {
+	DEB_MEMBER_FUNCT();
+	for (size_t i=0; i<m_threads.size(); i++)
+		delete m_threads[i];
+	m_threads.clear();
+	for (size_t i=0; i<m_skts.size(); i++)
+		::close(m_skts[i]);
+	m_skts.clear();
+}
+
+int ShardedReceiver::getNbShards() const {
+	return m_skts.size();
+}
+
+/*
+ * The kernel may deliver the whole stream to one socket, so each one gets
+ * the full size. Returns the smallest size granted.
+ */
+int ShardedReceiver::setRcvBuf(int size) {
+	DEB_MEMBER_FUNCT();
+	int granted = 0;
+	for (size_t i=0; i<m_skts.size(); i++) {
+		int skt_granted = setSocketRcvBuf(m_skts[i], size);
+		if (i == 0 || skt_granted < granted)
+			granted = skt_granted;
+	}
+	return granted;
+}
+
+int ShardedReceiver::getPending() const {
+	return (m_synced) ? m_highest - m_next + 1 : 0;
+}
+
+unsigned long long ShardedReceiver::getKernelDrops() const {
+	unsigned long long drops = 0;
+	for (size_t i=0; i<m_drops.size(); i++)
+		drops += m_drops[i];
+	return drops;
+}
+
+/*
+ * Forget the frames received so far, the next datagram restarts the sequence
+ */
+void ShardedReceiver::reset() {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	m_synced = false;
+	m_consumed = false;
+	for (int i=0; i<shardSlots; i++)
+		m_slot_state[i] = SlotFree;
+	m_cond.broadcast();
+}
+
+/*
+ * First datagram since reset(), or an earlier frame overtaken on another
+ * socket while nothing was read yet
+ */
+void ShardedReceiver::sync(int frame_nb) {
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_synced) {
+		m_next = frame_nb;
+		m_highest = frame_nb;
+		m_synced = true;
+	} else if (!m_consumed && frame_nb - m_next < 0) {
+		m_next = frame_nb;
+	}
+}
+
+void ShardedReceiver::store(const unsigned char* datagram, int len, int shard, unsigned int drops) {
+	DEB_MEMBER_FUNCT();
+	int frame_nb = (((unsigned int) datagram[0]) << 24) + (((unsigned int) datagram[1]) << 16)
+			+ (((unsigned int) datagram[2]) << 8) + (unsigned int) datagram[3];
+
+	m_drops[shard] = drops;
+	if (!m_synced || (!m_consumed && frame_nb - m_next < 0))
+		sync(frame_nb);
+	if (frame_nb - m_next < 0) {
+		DEB_TRACE() << "ShardedReceiver::store() dropped " << DEB_VAR2(frame_nb, (int) m_next);
+		return;
+	}
+	// claim the slot, free or holding a frame already given up. While the
+	// reader has not read the frame a round earlier, the kernel buffer holds
+	// the next datagrams.
+	int slot = frame_nb & (shardSlots - 1);
+	while (true) {
+		int state = SlotFree;
+		if (m_slot_state[slot].compare_exchange_strong(state, SlotWriting))
+			break;
+		if (state == SlotReady && m_slot_frame[slot] - m_next < 0 &&
+				m_slot_state[slot].compare_exchange_strong(state, SlotWriting))
+			break;
+		if (m_quit || frame_nb - m_next < 0) {
+			// the same frame twice, or given up meanwhile
+			DEB_TRACE() << "ShardedReceiver::store() dropped " << DEB_VAR2(frame_nb, (int) m_next);
+			return;
+		}
+		usleep(slotWaitUs);
+	}
+	if (len > m_datagram_size)
+		len = m_datagram_size;
+	memcpy(&m_slots[slot * m_datagram_size], datagram, len);
+	m_slot_len[slot] = len;
+	m_slot_frame[slot] = frame_nb;
+	m_slot_state[slot] = SlotReady;
+	int highest = m_highest;
+	while (frame_nb - highest > 0 && !m_highest.compare_exchange_weak(highest, frame_nb))
+		;
+
+	int next = m_next;
+	if (m_waiting && (frame_nb == next || frame_nb - next >= reorderWindow)) {
+		AutoMutex aLock(m_cond.mutex());
+		m_cond.broadcast();
+	}
+}
+
+/*
+ * true when next() would return without waiting, skipping the frames
+ * given up as lost on the way. Called by the reader with the lock held.
+ */
+bool ShardedReceiver::isNextReady() {
+	DEB_MEMBER_FUNCT();
+	while (m_synced) {
+		int next = m_next;
+		int slot = next & (shardSlots - 1);
+		// the frame number is written after the data
+		if (m_slot_frame[slot] == next && m_slot_state[slot] == SlotReady)
+			return true;
+		int highest = m_highest;
+		if (highest - next >= shardSlots) {
+			// frame number jump: give up the oldest frames
+			DEB_TRACE() << "ShardedReceiver::isNextReady() overrun " << DEB_VAR2(next, highest);
+			m_next = highest - shardSlots + 1;
+			continue;
+		}
+		if (highest - next < reorderWindow)
+			return false;
+		DEB_TRACE() << "ShardedReceiver::isNextReady() lost " << DEB_VAR1(next);
+		m_next = next + 1;
+	}
+	return false;
+}
+
+/*
+ * Wait for the next frame, the flag is raised before checking again so
+ * that a frame stored meanwhile wakes us up
+ */
+bool ShardedReceiver::waitNext(int timeout_ms) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	if (isNextReady())
+		return true;
+	m_waiting = true;
+	if (!isNextReady() && !m_quit)
+		m_cond.wait(timeout_ms / 1000.);
+	m_waiting = false;
+	return isNextReady();
+}
+
+/*
+ * Next datagram in frame order, header included
+ */
+int ShardedReceiver::next(void* buffer, int size) {
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+
+	while (!m_quit) {
+		if (!isNextReady()) {
+			m_waiting = true;
+			if (!isNextReady() && !m_quit)
+				m_cond.wait();
+			m_waiting = false;
+			continue;
+		}
+		int slot = m_next & (shardSlots - 1);
+		int len = (m_slot_len[slot] < size) ? m_slot_len[slot] : size;
+		memcpy(buffer, &m_slots[slot * m_datagram_size], len);
+		m_slot_state[slot] = SlotFree;
+		m_next++;
+		m_consumed = true;
+		return len;
+	}
+	return -1;
+}
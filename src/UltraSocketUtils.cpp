@@ -0,0 +1,98 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraSocketUtils.cpp
+// Created on: Oct 19, 2026
+
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include "UltraSocketUtils.h"
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+int lima::Ultra::setSocketRcvBuf(int skt, int size) {
+	int granted = 0;
+	socklen_t len = sizeof(granted);
+
+	if (setsockopt(skt, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+		setsockopt(skt, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	if (getsockopt(skt, SOL_SOCKET, SO_RCVBUF, &granted, &len) < 0)
+		return -1;
+	return granted;
+}
+
+void lima::Ultra::enableSocketDropCounter(int skt) {
+	int one = 1;
+	setsockopt(skt, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+}
+
+int lima::Ultra::recvCounted(int skt, void* buffer, int size, int flags, unsigned int& drops) {
+	struct msghdr msg;
+	struct iovec iov;
+	char control[CMSG_SPACE(sizeof(unsigned int))];
+	int len;
+
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if ((len = recvmsg(skt, &msg, flags)) < 0)
+		return len;
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+			memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+	}
+	return len;
+}
+
+int lima::Ultra::getInterfaceNumaNode(const char* address) {
+	struct ifaddrs *ifaddr, *ifa;
+	struct in_addr addr;
+	int node = -1;
+
+	if (inet_pton(AF_INET, address, &addr) != 1 || getifaddrs(&ifaddr) < 0)
+		return -1;
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET ||
+				((struct sockaddr_in*) ifa->ifa_addr)->sin_addr.s_addr != addr.s_addr)
+			continue;
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifa->ifa_name);
+		FILE* fp = fopen(path, "r");
+		if (fp) {
+			if (fscanf(fp, "%d", &node) != 1)
+				node = -1;
+			fclose(fp);
+		}
+		break;
+	}
+	freeifaddrs(ifaddr);
+	return node;
+}
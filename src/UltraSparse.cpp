@@ -0,0 +1,143 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraSparse.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include "UltraSparse.h"
+#include "lima/Exceptions.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+const int sparseHeaderSize = 2;	// count + overflow word
+const int sparseDefaultRatio = 16;	// default capacity, a 16th of the pixels
+
+SparseCodec::SparseCodec(int npixels) : m_npixels(npixels), m_capacity(npixels / sparseDefaultRatio),
+		m_threshold(0), m_pixel_threshold(npixels, 0) {
+	DEB_CONSTRUCTOR();
+	if (m_capacity < 1)
+		m_capacity = 1;
+}
+
+SparseCodec::~SparseCodec() {
+	DEB_DESTRUCTOR();
+}
+
+void SparseCodec::setThreshold(unsigned short threshold) {
+	DEB_MEMBER_FUNCT();
+	m_threshold = threshold;
+	m_pixel_threshold.assign(m_npixels, threshold);
+}
+
+void SparseCodec::getThreshold(unsigned short& threshold) {
+	DEB_MEMBER_FUNCT();
+	threshold = m_threshold;
+}
+
+void SparseCodec::setPixelThreshold(int pixel, unsigned short threshold) {
+	DEB_MEMBER_FUNCT();
+	if (pixel < 0 || pixel >= m_npixels) {
+		THROW_HW_ERROR(Error) << "Invalid arguement pixel value is outside of range";
+	}
+	m_pixel_threshold[pixel] = threshold;
+}
+
+void SparseCodec::getPixelThreshold(int pixel, unsigned short& threshold) {
+	DEB_MEMBER_FUNCT();
+	if (pixel < 0 || pixel >= m_npixels) {
+		THROW_HW_ERROR(Error) << "Invalid arguement pixel value is outside of range";
+	}
+	threshold = m_pixel_threshold[pixel];
+}
+
+/*
+ * Most pairs in a packed frame
+ */
+void SparseCodec::setCapacity(int nb_pixels) {
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_pixels);
+	if (nb_pixels < 1 || nb_pixels > m_npixels) {
+		THROW_HW_ERROR(InvalidValue) << "SparseCodec::setCapacity(): capacity must be in [1, " << m_npixels << "]";
+	}
+	m_capacity = nb_pixels;
+}
+
+int SparseCodec::getCapacity() const {
+	return m_capacity;
+}
+
+/*
+ * List the pixels above their threshold, pairs must hold 2 * npixels
+ * words. Returns the number of pairs.
+ */
+int SparseCodec::encode(const unsigned short* line, unsigned short* pairs) const {
+	const unsigned short* thr = &m_pixel_threshold[0];
+	unsigned short* dptr = pairs;
+	for (int i=0; i<m_npixels; i++) {
+		if (line[i] > thr[i]) {
+			*dptr++ = i;
+			*dptr++ = line[i];
+		}
+	}
+	return (dptr - pairs) / 2;
+}
+
+/*
+ * Copy the pairs into a packed frame of getPackedSize(capacity) words,
+ * returns the number of pairs dropped past the capacity.
+ */
+int SparseCodec::pack(const unsigned short* pairs, int count, unsigned short* packed) const {
+	int stored = (count < m_capacity) ? count : m_capacity;
+	packed[0] = stored;
+	packed[1] = count - stored;
+	memcpy(packed + sparseHeaderSize, pairs, 2 * stored * sizeof(unsigned short));
+	memset(packed + sparseHeaderSize + 2 * stored, 0, 2 * (m_capacity - stored) * sizeof(unsigned short));
+	return count - stored;
+}
+
+int SparseCodec::getPackedSize(int capacity) {
+	return sparseHeaderSize + 2 * capacity;
+}
+
+int SparseCodec::getCount(const unsigned short* packed) {
+	return packed[0];
+}
+
+int SparseCodec::getOverflow(const unsigned short* packed) {
+	return packed[1];
+}
+
+void SparseCodec::decode(const unsigned short* packed, unsigned short* line, int npixels) {
+	DEB_STATIC_FUNCT();
+	int count = getCount(packed);
+	const unsigned short* sptr = packed + sparseHeaderSize;
+	memset(line, 0, npixels * sizeof(unsigned short));
+	for (int i=0; i<count; i++, sptr += 2) {
+		if (sptr[0] >= npixels) {
+			THROW_HW_ERROR(Error) << "SparseCodec::decode(): pixel index out of range";
+		}
+		line[sptr[0]] = sptr[1];
+	}
+}
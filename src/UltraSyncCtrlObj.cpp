@@ -29,6 +29,8 @@ bool SyncCtrlObj::checkTrigMode(TrigMode trig_mode) {
 	case IntTrig:
 	case IntTrigMult:
 	case ExtTrigMult:
+	case ExtGate:
+	case ExtStartStop:
 		valid = true;
 		break;
 	default:
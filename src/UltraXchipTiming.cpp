@@ -0,0 +1,179 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// UltraXchipTiming.cpp
+// Created on: Oct 19, 2026
+
+#include <sstream>
+#include "UltraXchipTiming.h"
+#include "UltraCamera.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+static unsigned int maxTicks(unsigned int a, unsigned int b) {
+	return (a > b) ? a : b;
+}
+
+XchipTimingModel::XchipTimingModel(int headType, int npixels, int nb_channels, double clock_period) :
+		m_head_type(headType), m_pixels_per_channel((npixels + nb_channels - 1) / nb_channels),
+		m_clock_period(clock_period) {
+}
+
+void XchipTimingModel::setClockPeriod(double clock_period) {
+	m_clock_period = clock_period;
+}
+
+double XchipTimingModel::getClockPeriod() const {
+	return m_clock_period;
+}
+
+bool XchipTimingModel::validate(const XchipTiming& timing, vector<string>& errors,
+		vector<string>& adjustments) const {
+	errors.clear();
+	adjustments.clear();
+	if (timing.width == 0)
+		errors.push_back("width must not be 0");
+	if (timing.zeroWidth == 0)
+		errors.push_back("zeroWidth must not be 0");
+	if (timing.sampleWidth == 0)
+		errors.push_back("sampleWidth must not be 0");
+	if (timing.sampleWidth > timing.width)
+		errors.push_back("sampleWidth above width, the sample window would start inside the zero window");
+	if (timing.xClkHalfPeriod < 3)
+		errors.push_back("xClkHalfPeriod must be at least 3");
+	if (timing.readoutMode > 1)
+		errors.push_back("readoutMode must be 0 or 1");
+	if (timing.delay <= timing.zeroWidth) {
+		stringstream msg;
+		msg << "delay " << timing.delay << " not above zeroWidth, set to " << timing.zeroWidth + 1;
+		adjustments.push_back(msg.str());
+	}
+	if (timing.xClkHalfPeriod >= 3 && timing.settlingTime > timing.xClkHalfPeriod - 2) {
+		stringstream msg;
+		msg << "settlingTime " << timing.settlingTime << " above xClkHalfPeriod - 2, set to "
+				<< timing.xClkHalfPeriod - 2;
+		adjustments.push_back(msg.str());
+	}
+	return errors.empty();
+}
+
+/*
+ * The zero window opens at delay - zeroWidth and the sample window
+ * closes width ticks after it, the INGAAS heads use S2 for the zero
+ * window and S1 for the sample one.
+ */
+void XchipTimingModel::toRegisters(const XchipTiming& timing, XchipRegisters& regs) const {
+	unsigned int delay = (timing.delay > timing.zeroWidth) ? timing.delay - timing.zeroWidth : 1;
+	unsigned int startDelay = delay + timing.zeroWidth + timing.width - timing.sampleWidth;
+	unsigned int settlingTime = timing.settlingTime;
+
+	if (timing.xClkHalfPeriod >= 2 && settlingTime > timing.xClkHalfPeriod - 2)
+		settlingTime = timing.xClkHalfPeriod - 2;
+	regs.rstDelay = delay;
+	regs.rstWidth = timing.resetWidth;
+	if (m_head_type == INGAAS) {
+		regs.s2Delay = delay;
+		regs.s2Width = timing.zeroWidth;
+		regs.s1Delay = startDelay;
+		regs.s1Width = timing.sampleWidth;
+	} else {
+		regs.s1Delay = delay;
+		regs.s1Width = timing.zeroWidth;
+		regs.s2Delay = startDelay;
+		regs.s2Width = timing.sampleWidth;
+	}
+	regs.xclkHalfPeriod = timing.xClkHalfPeriod;
+	regs.xclkSettling = settlingTime;
+	regs.shiftDelay = (timing.readoutMode == 1) ? startDelay + timing.sampleWidth : delay;
+	regs.shiftWidth = 1;
+}
+
+void XchipTimingModel::fromRegisters(const XchipRegisters& regs, XchipTiming& timing) const {
+	unsigned int zeroDelay, zeroWidth, sampleDelay, sampleWidth;
+
+	if (m_head_type == INGAAS) {
+		zeroDelay = regs.s2Delay;
+		zeroWidth = regs.s2Width;
+		sampleDelay = regs.s1Delay;
+		sampleWidth = regs.s1Width;
+	} else {
+		zeroDelay = regs.s1Delay;
+		zeroWidth = regs.s1Width;
+		sampleDelay = regs.s2Delay;
+		sampleWidth = regs.s2Width;
+	}
+	timing.zeroWidth = zeroWidth;
+	timing.delay = regs.rstDelay + zeroWidth;
+	timing.sampleWidth = sampleWidth;
+	timing.width = (sampleWidth + sampleDelay) - (zeroWidth + zeroDelay);
+	timing.resetWidth = regs.rstWidth;
+	timing.settlingTime = regs.xclkSettling;
+	timing.xClkHalfPeriod = regs.xclkHalfPeriod;
+	timing.shiftDelay = regs.shiftDelay;
+	timing.readoutMode = (regs.shiftDelay == timing.delay + timing.width) ? 1 : 0;
+}
+
+unsigned int XchipTimingModel::getLineTicks(const XchipTiming& timing) const {
+	XchipRegisters regs;
+	toRegisters(timing, regs);
+	unsigned int cycle = maxTicks(regs.rstDelay + regs.rstWidth,
+			regs.rstDelay + timing.zeroWidth + timing.width);
+	unsigned int readout = m_pixels_per_channel * 2 * timing.xClkHalfPeriod;
+	if (timing.readoutMode == 1)
+		return maxTicks(cycle, regs.shiftDelay + readout);
+	// the readout runs during the next integration
+	return maxTicks(cycle, readout);
+}
+
+double XchipTimingModel::getLinePeriod(const XchipTiming& timing) const {
+	return getLineTicks(timing) * m_clock_period;
+}
+
+double XchipTimingModel::getMaxLineRate(const XchipTiming& timing) const {
+	return 1.0 / getLinePeriod(timing);
+}
+
+/*
+ * Keep the analog settings of base (zero, sample, reset windows and
+ * the settling time it gets), take the shortest delay and XCLK they allow and the
+ * faster readout mode.
+ */
+void XchipTimingModel::getFastest(unsigned int width, const XchipTiming& base, XchipTiming& fastest) const {
+	fastest = base;
+	fastest.width = width;
+	fastest.zeroWidth = (base.zeroWidth > 0) ? base.zeroWidth : 1;
+	fastest.delay = fastest.zeroWidth + 1;
+	fastest.sampleWidth = (base.sampleWidth > 0 && base.sampleWidth < width) ? base.sampleWidth : width;
+	if (base.xClkHalfPeriod >= 3 && base.settlingTime > base.xClkHalfPeriod - 2)
+		fastest.settlingTime = base.xClkHalfPeriod - 2;
+	fastest.xClkHalfPeriod = maxTicks(3, fastest.settlingTime + 2);
+	fastest.readoutMode = 0;
+	XchipTiming afterReadout = fastest;
+	afterReadout.readoutMode = 1;
+	if (getLineTicks(afterReadout) < getLineTicks(fastest))
+		fastest = afterReadout;
+	XchipRegisters regs;
+	toRegisters(fastest, regs);
+	fastest.shiftDelay = regs.shiftDelay;
+}
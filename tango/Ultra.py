@@ -43,10 +43,86 @@ import PyTango
 import numpy
 from Lima import Core
 from Lima import Ultra as UltraAcq
+from Lima.Ultra import frames as UltraFrames
 # import some useful helpers to create direct mapping between tango attributes
 # and Lima interfaces.
 from Lima.Server import AttrHelper
 
+# head commands read by each attribute, prefetched in one exchange by read_attr_hardware
+_attrCommands = {
+    'headColdTemp': ['coldtemp'],
+    'headHotTemp': ['hottemp'],
+    'tecColdTemp': ['tectemp'],
+    'tecSupplyVolts': ['tecsup'],
+    'adcPosSupplyVolts': ['psupvadc'],
+    'adcNegSupplyVolts': ['psunvadc'],
+    'vinPosSupplyVolts': ['psupvin'],
+    'vinNegSupplyVolts': ['psunvin'],
+    'headADCVdd': ['headvccadc'],
+    'headVdd': ['headvcc'],
+    'headVref': ['headvref'],
+    'headVrefc': ['headvrefc'],
+    'headVpupref': ['headvpupref'],
+    'headVclamp': ['headvclamp'],
+    'headVres1': ['headvres1'],
+    'headVres2': ['headvres2'],
+    'headVTrip': ['headtrip'],
+    'fpgaXchipReg': ['fpgaxchip'],
+    'fpgaPwrReg': ['fpgapwr'],
+    'fpgaSyncReg': ['fpgasync'],
+    'fpgaAdcReg': ['fpgaadc'],
+    'frameCount': ['fpgaframe'],
+    'frameError': ['fpgaerror'],
+    'headPowerEnabled': ['fpgapwr'],
+    'tecPowerEnabled': ['fpgapwr'],
+    'biasEnabled': ['fpgapwr'],
+    'syncEnabled': ['fpgasync'],
+    'calibEnabled': ['fpgaxchip'],
+    '8pCEnabled': ['fpgaxchip'],
+    'tecOverTemp': ['fpgapwr'],
+    'aux1': ['fpgaaux1'],
+    'aux2': ['fpgaaux2'],
+    'xchipTiming': ['fpgarst', 'fpgas1', 'fpgas2', 'fpgaxclk', 'fpgashift'],
+}
+
+# telemetry monitors pushed as change events on their attribute
+_telemetryAttrs = {
+    'coldtemp': 'headColdTemp',
+    'hottemp': 'headHotTemp',
+    'tectemp': 'tecColdTemp',
+    'tecsup': 'tecSupplyVolts',
+    'psupvadc': 'adcPosSupplyVolts',
+    'psunvadc': 'adcNegSupplyVolts',
+    'psupvin': 'vinPosSupplyVolts',
+    'psunvin': 'vinNegSupplyVolts',
+    'headvccadc': 'headADCVdd',
+}
+
+# line types in the order of the lineTypesKept and lineTypeCounts attributes
+_lineTypes = [UltraAcq.Camera.DataLine, UltraAcq.Camera.CalibrationLine,
+              UltraAcq.Camera.PedestalLine, UltraAcq.Camera.MarkerLine]
+
+#------------------------------------------------------------------
+# Forward the camera events to the tango clients, called from the
+# camera threads
+#------------------------------------------------------------------
+class _EventForwarder(UltraAcq.EventCallback):
+
+    def __init__(self, device):
+        UltraAcq.EventCallback.__init__(self)
+        self._device = device
+
+    def telemetryChanged(self, name, value):
+        self._device.push_change_event(_telemetryAttrs[name], value)
+
+    def dataReady(self, nb_frames):
+        self._device.push_change_event('acquiredFrames', nb_frames)
+        self._device.push_data_ready_event('acquiredFrames', nb_frames)
+
+    def acqFailed(self, message):
+        self._device.error_stream('acquisition failed: %s' % message)
+        self._device.push_change_event('acqState', 'Fault')
+
 #------------------------------------------------------------------
 #------------------------------------------------------------------
 # class Ultra
@@ -70,7 +146,8 @@ class Ultra(PyTango.Device_4Impl):
 # Device destructor
 #------------------------------------------------------------------
     def delete_device(self):
-        pass
+        _UltraCamera.setTelemetryEvents([], [], 0, 0)
+        _UltraCamera.unregisterEventCallback(self._events)
 
 #------------------------------------------------------------------
 # Device initialization
@@ -79,6 +156,29 @@ class Ultra(PyTango.Device_4Impl):
     def init_device(self):
         self.set_state(PyTango.DevState.ON)
         self.get_device_properties(self.get_device_class())
+        for name in list(_telemetryAttrs.values()) + ['acquiredFrames', 'acqState']:
+            self.set_change_event(name, True, False)
+        self.set_data_ready_event('acquiredFrames', True)
+        self._telemetry = [0.0, 0.0, 0.0]    # period, deadband, heartbeat
+        self._events = _EventForwarder(self)
+        _UltraCamera.registerEventCallback(self._events)
+
+    def _setTelemetry(self):
+        period, deadband, heartbeat = self._telemetry
+        _UltraCamera.setTelemetryEvents(sorted(_telemetryAttrs), [deadband], period, heartbeat)
+
+#------------------------------------------------------------------
+# Read the head commands behind all the requested attributes at once,
+# the read_ methods below then get the prefetched replies
+#------------------------------------------------------------------
+    def read_attr_hardware(self, data):
+        multi_attr = self.get_device_attr()
+        commands = set()
+        for index in data:
+            name = multi_attr.get_attr_by_ind(index).get_name()
+            commands.update(_attrCommands.get(name, []))
+        if commands:
+            _UltraCamera.prefetchValues(sorted(commands))
 
 #------------------------------------------------------------------
 # getAttrStringValueList command:
@@ -102,6 +202,61 @@ class Ultra(PyTango.Device_4Impl):
     def RestoreConfiguration(self):
        _UltraCamera.RestoreConfiguration()
 
+    @Core.DEB_MEMBER_FUNCT
+    def ResetHistogram(self):
+       _UltraCamera.resetHistogram()
+
+    @Core.DEB_MEMBER_FUNCT
+    def ResetCalibEstimates(self):
+       _UltraCamera.resetCalibEstimates()
+
+    @Core.DEB_MEMBER_FUNCT
+    def ResetMetrics(self):
+       _UltraCamera.resetMetrics()
+
+    @Core.DEB_MEMBER_FUNCT
+    def SetMetricsDump(self, argin):
+       filename, period = argin
+       _UltraCamera.setMetricsDump(filename, float(period))
+
+    @Core.DEB_MEMBER_FUNCT
+    def Reconcile(self):
+       return _UltraCamera.reconcile()
+
+    @Core.DEB_MEMBER_FUNCT
+    def ClearScanTable(self):
+       _UltraCamera.clearScanTable()
+
+    @Core.DEB_MEMBER_FUNCT
+    def AddScanPoint(self, argin):
+       _UltraCamera.addScanPoint(int(argin[0]), list(argin[1:]))
+
+    @Core.DEB_MEMBER_FUNCT
+    def CheckXchipTiming(self, argin):
+       valid, report, max_rate = _UltraCamera.checkXchipTiming(*[int(x) for x in argin])
+       return report + 'max line rate: %g Hz' % max_rate if valid else report
+
+    @Core.DEB_MEMBER_FUNCT
+    def FastestXchipTiming(self, argin):
+       timing = _UltraCamera.getFastestXchipTiming(int(argin))
+       delay, zeroWidth, sampleWidth, resetWidth, settlingTime, xClkHalfPeriod, readoutMode, max_rate = timing
+       return [delay, int(argin), zeroWidth, sampleWidth, resetWidth, settlingTime, xClkHalfPeriod, readoutMode]
+
+    @Core.DEB_MEMBER_FUNCT
+    def SetBufferPoolTime(self, argin):
+        line_rate, time = argin
+        _UltraCamera.setBufferPoolTime(line_rate, time)
+
+    @Core.DEB_MEMBER_FUNCT
+    def CalibrateAdcOffsets(self, argin):
+       target, tolerance, max_iterations, nb_lines = argin
+       return _UltraCamera.calibrateAdcOffsets(target, tolerance, int(max_iterations), int(nb_lines))
+
+    @Core.DEB_MEMBER_FUNCT
+    def GetFrameGates(self, argin):
+        first_frame, nb_frames = argin
+        return _UltraCamera.getFrameGates(first_frame, nb_frames)
+
 #==================================================================
 #
 # Ultra read/write attribute methods
@@ -215,7 +370,7 @@ class Ultra(PyTango.Device_4Impl):
         attr.set_value(_UltraCamera.getFrameCount())
 
     def read_frameError(self, attr):
-        attr.set_value(_UltraCamera.getFrameError())
+        attr.set_value(_UltraCamera.getFrameErrorCount())
 
     def read_headPowerEnabled(self, attr):
         attr.set_value(_UltraCamera.getHeadPowerEnabled())
@@ -257,18 +412,18 @@ class Ultra(PyTango.Device_4Impl):
         attr.set_value(_UltraCamera.getTecOverTemp())
 
     def read_adcOffset(self, attr):
-        attr.set_value(_UltraCamera.getAdcOffset())
+        attr.set_value(_UltraCamera.getAdcOffsets())
 
     def write_adcOffset(self, attr):
         data = attr.get_write_value()
-        _UltraCamera.setAdcOffset(*data)
+        _UltraCamera.setAdcOffsets(list(data))
 
     def read_adcGain(self, attr):
-        attr.set_value(_UltraCamera.getAdcGain())
+        attr.set_value(_UltraCamera.getAdcGains())
 
     def write_adcGain(self, attr):
         data = attr.get_write_value()
-        _UltraCamera.setAdcGain(*data)
+        _UltraCamera.setAdcGains(list(data))
 
     def read_aux1(self, attr):
         attr.set_value(_UltraCamera.getAux1())
@@ -285,11 +440,307 @@ class Ultra(PyTango.Device_4Impl):
         _UltraCamera.setAux2(*data)
 
     def read_xchipTiming(self, attr):
-        attr.set_value(_UltraCamera.getxchipTiming())
+        attr.set_value(_UltraCamera.getXchipTiming())
 
     def write_xchipTiming(self, attr):
         data = attr.get_write_value()
-        _UltraCamera.setxchipTiming(*data)
+        _UltraCamera.setXchipTiming(*data[:8])
+
+    def read_xchipClockPeriod(self, attr):
+        attr.set_value(_UltraCamera.getXchipClockPeriod())
+
+    def write_xchipClockPeriod(self, attr):
+        _UltraCamera.setXchipClockPeriod(attr.get_write_value())
+
+    def read_xchipLineRate(self, attr):
+        line_period, max_rate = _UltraCamera.getXchipLineRate()
+        attr.set_value(max_rate)
+
+    def read_sparseEnabled(self, attr):
+        attr.set_value(_UltraCamera.getSparseEnabled())
+
+    def write_sparseEnabled(self, attr):
+        _UltraCamera.setSparseEnabled(attr.get_write_value())
+
+    def read_sparseCapacity(self, attr):
+        attr.set_value(_UltraCamera.getSparseCapacity())
+
+    def write_sparseCapacity(self, attr):
+        _UltraCamera.setSparseCapacity(attr.get_write_value())
+
+    def read_sparseOverflow(self, attr):
+        attr.set_value(_UltraCamera.getSparseOverflow())
+
+    def read_sparseThreshold(self, attr):
+        attr.set_value(_UltraCamera.getSparseThreshold())
+
+    def write_sparseThreshold(self, attr):
+        _UltraCamera.setSparseThreshold(attr.get_write_value())
+
+    def read_histogramEnabled(self, attr):
+        attr.set_value(_UltraCamera.getHistogramEnabled())
+
+    def write_histogramEnabled(self, attr):
+        _UltraCamera.setHistogramEnabled(attr.get_write_value())
+
+    def read_histogramPerChannel(self, attr):
+        attr.set_value(_UltraCamera.getHistogramPerChannel())
+
+    def write_histogramPerChannel(self, attr):
+        _UltraCamera.setHistogramPerChannel(attr.get_write_value())
+
+    def read_histogramBinning(self, attr):
+        attr.set_value(_UltraCamera.getHistogramBinning())
+
+    def write_histogramBinning(self, attr):
+        data = attr.get_write_value()
+        _UltraCamera.setHistogramBinning(*data)
+
+    def read_histogram(self, attr):
+        nb_rows, nb_bins = _UltraCamera.getHistogramSize()
+        data = numpy.frombuffer(_UltraCamera.getHistograms(), dtype=numpy.uint32)
+        attr.set_value(data.reshape(nb_rows, nb_bins))
+
+    def read_headsTiled(self, attr):
+        attr.set_value(_UltraCamera.getHeadsTiled())
+
+    def write_headsTiled(self, attr):
+        _UltraCamera.setHeadsTiled(attr.get_write_value())
+
+    def read_commandHead(self, attr):
+        attr.set_value(_UltraCamera.getCommandHead())
+
+    def write_commandHead(self, attr):
+        _UltraCamera.setCommandHead(attr.get_write_value())
+
+    def read_receiveBufferSize(self, attr):
+        requested, granted = _UltraCamera.getReceiveBufferSize()
+        attr.set_value(requested)
+
+    def write_receiveBufferSize(self, attr):
+        _UltraCamera.setReceiveBufferSize(attr.get_write_value())
+
+    def read_receiveBufferGranted(self, attr):
+        requested, granted = _UltraCamera.getReceiveBufferSize()
+        attr.set_value(granted)
+
+    def read_kernelDrops(self, attr):
+        attr.set_value(_UltraCamera.getKernelDrops())
+
+    def read_commandTimeout(self, attr):
+        attr.set_value(_UltraCamera.getCommandTimeout())
+
+    def write_commandTimeout(self, attr):
+        _UltraCamera.setCommandTimeout(attr.get_write_value())
+
+    def read_autoReconnect(self, attr):
+        attr.set_value(_UltraCamera.getAutoReconnect())
+
+    def write_autoReconnect(self, attr):
+        _UltraCamera.setAutoReconnect(attr.get_write_value())
+
+    def read_outages(self, attr):
+        count, total_time, last_time = _UltraCamera.getOutages()
+        attr.set_value(count)
+
+    def read_outageTime(self, attr):
+        count, total_time, last_time = _UltraCamera.getOutages()
+        attr.set_value([total_time, last_time])
+
+    def read_scanSettleLines(self, attr):
+        attr.set_value(_UltraCamera.getScanSettleLines())
+
+    def write_scanSettleLines(self, attr):
+        _UltraCamera.setScanSettleLines(attr.get_write_value())
+
+    def read_scanPoint(self, attr):
+        point, dropped_lines = _UltraCamera.getScanStatus()
+        attr.set_value(point)
+
+    def read_scanDroppedLines(self, attr):
+        point, dropped_lines = _UltraCamera.getScanStatus()
+        attr.set_value(dropped_lines)
+
+    def read_scanFirstFrames(self, attr):
+        attr.set_value(_UltraCamera.getScanFirstFrames())
+
+    def read_metrics(self, attr):
+        counters = _UltraCamera.getMetricsCounters()
+        attr.set_value(['%s=%d' % (k, v) for k, v in sorted(counters.items())])
+
+    def read_packetsReceived(self, attr):
+        attr.set_value(_UltraCamera.getMetricsCounters()['packets_received'])
+
+    def read_bytesReceived(self, attr):
+        attr.set_value(_UltraCamera.getMetricsCounters()['bytes_received'])
+
+    def read_sequenceGaps(self, attr):
+        attr.set_value(_UltraCamera.getMetricsCounters()['sequence_gaps'])
+
+    def read_ringOccupancy(self, attr):
+        attr.set_value(_UltraCamera.getMetricsCounters()['ring_occupancy'])
+
+    def read_receiveLatency(self, attr):
+        attr.set_value(_UltraCamera.getMetricsLatency(0))
+
+    def read_processLatency(self, attr):
+        attr.set_value(_UltraCamera.getMetricsLatency(1))
+
+    def read_frameReadyLatency(self, attr):
+        attr.set_value(_UltraCamera.getMetricsLatency(2))
+
+    def read_commandRtt(self, attr):
+        attr.set_value(_UltraCamera.getMetricsLatency(3))
+
+    def read_acqSummary(self, attr):
+        attr.set_value(_UltraCamera.getAcqSummary())
+
+    def read_acqSummaryFile(self, attr):
+        attr.set_value(_UltraCamera.getAcqSummaryFile())
+
+    def write_acqSummaryFile(self, attr):
+        _UltraCamera.setAcqSummaryFile(attr.get_write_value())
+
+    def read_telemetryPeriod(self, attr):
+        attr.set_value(self._telemetry[0])
+
+    def write_telemetryPeriod(self, attr):
+        self._telemetry[0] = attr.get_write_value()
+        self._setTelemetry()
+
+    def read_telemetryDeadband(self, attr):
+        attr.set_value(self._telemetry[1])
+
+    def write_telemetryDeadband(self, attr):
+        self._telemetry[1] = attr.get_write_value()
+        self._setTelemetry()
+
+    def read_telemetryHeartbeat(self, attr):
+        attr.set_value(self._telemetry[2])
+
+    def write_telemetryHeartbeat(self, attr):
+        self._telemetry[2] = attr.get_write_value()
+        self._setTelemetry()
+
+    def read_dataReadyFrames(self, attr):
+        attr.set_value(_UltraCamera.getDataReadyFrames())
+
+    def write_dataReadyFrames(self, attr):
+        _UltraCamera.setDataReadyFrames(attr.get_write_value())
+
+    def read_acquiredFrames(self, attr):
+        attr.set_value(_UltraCamera.getAcquiredFrames())
+
+    def read_eventCounts(self, attr):
+        attr.set_value(list(_UltraCamera.getEventCounts()))
+
+    def read_bufferPoolMemory(self, attr):
+        attr.set_value(_UltraCamera.getBufferPoolMemory())
+
+    def write_bufferPoolMemory(self, attr):
+        _UltraCamera.setBufferPoolMemory(attr.get_write_value())
+
+    def read_bufferPoolMaxFrames(self, attr):
+        attr.set_value(_UltraCamera.getBufferPoolMaxFrames())
+
+    def read_bufferHugePages(self, attr):
+        attr.set_value(_UltraCamera.getBufferHugePages())
+
+    def write_bufferHugePages(self, attr):
+        _UltraCamera.setBufferHugePages(attr.get_write_value())
+
+    def read_bufferNumaNode(self, attr):
+        nb_buffers, size, page_mode, numa_node = _UltraCamera.getBufferPool()
+        attr.set_value(numa_node)
+
+    def write_bufferNumaNode(self, attr):
+        _UltraCamera.setBufferNumaNode(attr.get_write_value())
+
+    def read_bufferPool(self, attr):
+        nb_buffers, size, page_mode, numa_node = _UltraCamera.getBufferPool()
+        pages = ['normal', 'transparent huge', 'huge'][page_mode]
+        attr.set_value('%d buffers, %d bytes on %s pages, NUMA node %d' % (nb_buffers, size, pages, numa_node))
+
+    def read_ringPolicy(self, attr):
+        policy = _UltraCamera.getRingPolicy()
+        attr.set_value(['Block', 'OverwriteOldest', 'DropNewest'][int(policy)])
+
+    def write_ringPolicy(self, attr):
+        policies = {'Block': UltraAcq.Camera.RingBlock,
+                    'OverwriteOldest': UltraAcq.Camera.RingOverwriteOldest,
+                    'DropNewest': UltraAcq.Camera.RingDropNewest}
+        _UltraCamera.setRingPolicy(policies[attr.get_write_value()])
+
+    def read_releaseTracking(self, attr):
+        attr.set_value(_UltraCamera.getReleaseTracking())
+
+    def write_releaseTracking(self, attr):
+        _UltraCamera.setReleaseTracking(attr.get_write_value())
+
+    def read_ringWindow(self, attr):
+        attr.set_value(list(_UltraCamera.getRingWindow()))
+
+    def read_ringOverwritten(self, attr):
+        overwritten, dropped = _UltraCamera.getRingCounters()
+        attr.set_value(overwritten)
+
+    def read_ringDropped(self, attr):
+        overwritten, dropped = _UltraCamera.getRingCounters()
+        attr.set_value(dropped)
+
+    def read_nbGates(self, attr):
+        attr.set_value(_UltraCamera.getNbGates())
+
+    def read_lineTypesKept(self, attr):
+        attr.set_value([_UltraCamera.getLineTypeKept(t) for t in _lineTypes])
+
+    def write_lineTypesKept(self, attr):
+        for t, kept in zip(_lineTypes, attr.get_write_value()):
+            _UltraCamera.setLineTypeKept(t, kept)
+
+    def read_lineTypeCounts(self, attr):
+        attr.set_value(_UltraCamera.getLineTypeCounts())
+
+    def read_calibCorrection(self, attr):
+        attr.set_value(_UltraCamera.getCalibCorrection())
+
+    def write_calibCorrection(self, attr):
+        _UltraCamera.setCalibCorrection(attr.get_write_value())
+
+    def read_calibWindow(self, attr):
+        attr.set_value(_UltraCamera.getCalibWindow())
+
+    def write_calibWindow(self, attr):
+        _UltraCamera.setCalibWindow(attr.get_write_value())
+
+    def read_calibReference(self, attr):
+        attr.set_value(_UltraCamera.getCalibReference())
+
+    def write_calibReference(self, attr):
+        _UltraCamera.setCalibReference(attr.get_write_value())
+
+    def read_calibGains(self, attr):
+        gains, offsets, noise = _UltraCamera.getCalibEstimates()
+        attr.set_value(gains)
+
+    def read_calibOffsets(self, attr):
+        gains, offsets, noise = _UltraCamera.getCalibEstimates()
+        attr.set_value(offsets)
+
+    def read_calibNoise(self, attr):
+        gains, offsets, noise = _UltraCamera.getCalibEstimates()
+        attr.set_value(noise)
+
+    def read_calibLines(self, attr):
+        attr.set_value(list(_UltraCamera.getCalibLines()))
+
+    def read_acqState(self, attr):
+        state = _UltraCamera.getAcqState()
+        attr.set_value(['Idle', 'Armed', 'Running', 'Stopping', 'Fault'][int(state)])
+
+    def read_unmatchedFrames(self, attr):
+        nb_heads = _UltraCamera.getNbHeads()
+        attr.set_value([_UltraCamera.getUnmatchedFrames(h) for h in range(nb_heads)])
 
 
 #------------------------------------------------------------------
@@ -324,6 +775,18 @@ class UltraClass(PyTango.DeviceClass):
             [PyTango.DevLong,
             "number of detector pixels.",
             [512]],
+        'extraHeads':
+            [PyTango.DevVarStringArray,
+            "extra heads as headIPaddress:udpPort, received with the first one",
+            []],
+        'receiveShards':
+            [PyTango.DevLong,
+            "number of SO_REUSEPORT sockets receiving each head",
+            [1]],
+        'receiveFirstCpu':
+            [PyTango.DevLong,
+            "first cpu the receive threads are pinned on, -1 for no pinning",
+            [-1]],
         }
 
     cmd_list = {
@@ -336,6 +799,42 @@ class UltraClass(PyTango.DeviceClass):
         'RestoreConfiguration':
             [[PyTango.DevVoid, ""],
             [PyTango.DevVoid, ""]],
+        'ResetHistogram':
+            [[PyTango.DevVoid, ""],
+            [PyTango.DevVoid, ""]],
+        'ResetCalibEstimates':
+            [[PyTango.DevVoid, ""],
+            [PyTango.DevVoid, ""]],
+        'ResetMetrics':
+            [[PyTango.DevVoid, ""],
+            [PyTango.DevVoid, ""]],
+        'SetMetricsDump':
+            [[PyTango.DevVarStringArray, "file name (empty to stop), period in seconds"],
+            [PyTango.DevVoid, ""]],
+        'Reconcile':
+            [[PyTango.DevVoid, ""],
+            [PyTango.DevString, "frame accounting since the acquisition started"]],
+        'ClearScanTable':
+            [[PyTango.DevVoid, ""],
+            [PyTango.DevVoid, ""]],
+        'AddScanPoint':
+            [[PyTango.DevVarStringArray, "number of lines, then the settings as name and values"],
+            [PyTango.DevVoid, ""]],
+        'CheckXchipTiming':
+            [[PyTango.DevVarULongArray, "the 8 xchipTiming values to write"],
+            [PyTango.DevString, "errors, adjustments and the maximum line rate"]],
+        'FastestXchipTiming':
+            [[PyTango.DevULong, "integration width"],
+            [PyTango.DevVarULongArray, "the 8 xchipTiming values to write"]],
+        'SetBufferPoolTime':
+            [[PyTango.DevVarDoubleArray, "line rate in Hz, seconds of lines to hold (0 for no limit)"],
+            [PyTango.DevVoid, ""]],
+        'CalibrateAdcOffsets':
+            [[PyTango.DevVarFloatArray, "target, tolerance, max iterations, lines per step"],
+            [PyTango.DevBoolean, "True when all the channels converged"]],
+        'GetFrameGates':
+            [[PyTango.DevVarLong64Array, "first frame, number of frames in the ring window"],
+            [PyTango.DevVarLongArray, "gate index of each frame, modulo 256"]],
 
         }
 
@@ -463,11 +962,11 @@ class UltraClass(PyTango.DeviceClass):
          'adcOffset':
             [[PyTango.DevFloat,
               PyTango.SPECTRUM,
-              PyTango.READ_WRITE, 16]],
+              PyTango.READ_WRITE, 256]],
          'adcGain':
             [[PyTango.DevFloat,
               PyTango.SPECTRUM,
-              PyTango.READ_WRITE, 16]],
+              PyTango.READ_WRITE, 256]],
          'aux1':
             [[PyTango.DevULong,
               PyTango.SPECTRUM,
@@ -480,6 +979,254 @@ class UltraClass(PyTango.DeviceClass):
             [[PyTango.DevULong,
               PyTango.SPECTRUM,
               PyTango.READ_WRITE, 9]],
+         'sparseEnabled':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'sparseCapacity':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'sparseOverflow':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'sparseThreshold':
+            [[PyTango.DevUShort,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'histogramEnabled':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'histogramPerChannel':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'histogramBinning':
+            [[PyTango.DevLong,
+              PyTango.SPECTRUM,
+              PyTango.READ_WRITE, 3]],
+         'histogram':
+            [[PyTango.DevULong,
+              PyTango.IMAGE,
+              PyTango.READ, 65536, 4096]],
+         'headsTiled':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'commandHead':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'receiveBufferSize':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'receiveBufferGranted':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'kernelDrops':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'xchipClockPeriod':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'xchipLineRate':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'scanSettleLines':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'scanPoint':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'scanDroppedLines':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'scanFirstFrames':
+            [[PyTango.DevLong,
+              PyTango.SPECTRUM,
+              PyTango.READ, 65536]],
+         'commandTimeout':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'autoReconnect':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'outages':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'outageTime':
+            [[PyTango.DevDouble,
+              PyTango.SPECTRUM,
+              PyTango.READ, 2]],
+         'metrics':
+            [[PyTango.DevString,
+              PyTango.SPECTRUM,
+              PyTango.READ, 16]],
+         'packetsReceived':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'bytesReceived':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'sequenceGaps':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'ringOccupancy':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'receiveLatency':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 32]],
+         'processLatency':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 32]],
+         'frameReadyLatency':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 32]],
+         'commandRtt':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 32]],
+         'acqSummary':
+            [[PyTango.DevString,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'acqSummaryFile':
+            [[PyTango.DevString,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'unmatchedFrames':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 64]],
+         'ringPolicy':
+            [[PyTango.DevString,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'ringWindow':
+            [[PyTango.DevLong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 2]],
+         'releaseTracking':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'ringOverwritten':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'ringDropped':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'nbGates':
+            [[PyTango.DevULong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'lineTypesKept':
+            [[PyTango.DevBoolean,
+              PyTango.SPECTRUM,
+              PyTango.READ_WRITE, 4]],
+         'lineTypeCounts':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 5]],
+         'calibCorrection':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'calibWindow':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'calibReference':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'calibGains':
+            [[PyTango.DevDouble,
+              PyTango.SPECTRUM,
+              PyTango.READ, 65536]],
+         'calibOffsets':
+            [[PyTango.DevDouble,
+              PyTango.SPECTRUM,
+              PyTango.READ, 65536]],
+         'calibNoise':
+            [[PyTango.DevDouble,
+              PyTango.SPECTRUM,
+              PyTango.READ, 65536]],
+         'calibLines':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 2]],
+         'acqState':
+            [[PyTango.DevString,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'bufferPoolMemory':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'bufferPoolMaxFrames':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'bufferHugePages':
+            [[PyTango.DevBoolean,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'bufferNumaNode':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'bufferPool':
+            [[PyTango.DevString,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'telemetryPeriod':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'telemetryDeadband':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'telemetryHeartbeat':
+            [[PyTango.DevDouble,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'dataReadyFrames':
+            [[PyTango.DevLong,
+              PyTango.SCALAR,
+              PyTango.READ_WRITE]],
+         'acquiredFrames':
+            [[PyTango.DevLong64,
+              PyTango.SCALAR,
+              PyTango.READ]],
+         'eventCounts':
+            [[PyTango.DevULong64,
+              PyTango.SPECTRUM,
+              PyTango.READ, 3]],
 
       }
 
@@ -495,15 +1242,25 @@ class UltraClass(PyTango.DeviceClass):
 
 _UltraCamera = None
 _UltraInterface = None
+_UltraRelease = None
 
-def get_control(headIPaddress, hostIPaddress, tcpPort, udpPort, nPixels) :
+def get_control(headIPaddress, hostIPaddress, tcpPort, udpPort, nPixels, extraHeads=[], receiveShards=1,
+                receiveFirstCpu=-1) :
     global _UltraCamera
     global _UltraInterface
+    global _UltraRelease
 #    Core.DebParams.setTypeFlags(Core.DebParams.AllFlags)
     if _UltraInterface is None:
         _UltraCamera = UltraAcq.Camera(headIPaddress, hostIPaddress, int(tcpPort), int(udpPort), int(nPixels))
+        for head in extraHeads:
+            address, port = head.split(':')
+            _UltraCamera.addHead(address, hostIPaddress, int(tcpPort), int(port))
+        if int(receiveShards) > 1:
+            _UltraCamera.setReceiveShards(int(receiveShards), int(receiveFirstCpu))
         _UltraInterface = UltraAcq.Interface(_UltraCamera)
-    return Core.CtControl(_UltraInterface)
+    control = Core.CtControl(_UltraInterface)
+    _UltraRelease = UltraFrames.LimaRelease(control, _UltraCamera)
+    return control
 
 def get_tango_specific_class_n_device():
     return UltraClass, Ultra
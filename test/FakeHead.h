@@ -0,0 +1,159 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// FakeHead.h
+// Created on: Oct 19, 2026
+
+#ifndef FAKEHEAD_H_
+#define FAKEHEAD_H_
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+/*
+ * A head control port on the loopback, served by its own thread. The
+ * head acknowledges the set commands, answers "read <x>" with the
+ * reply given to setReply() or "<x", never answers "mute" and closes
+ * the connection on "drop".
+ */
+class FakeHead {
+public:
+	FakeHead() : m_quit(false), m_nb_connections(0) {
+		m_listen = socket(AF_INET, SOCK_STREAM, 0);
+		int opt = 1;
+		setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+		struct sockaddr_in addr;
+		socklen_t len = sizeof(addr);
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+		addr.sin_port = 0;
+		bind(m_listen, (struct sockaddr*) &addr, sizeof(addr));
+		listen(m_listen, 1);
+		getsockname(m_listen, (struct sockaddr*) &addr, &len);
+		m_port = ntohs(addr.sin_port);
+		m_thread = thread(&FakeHead::run, this);
+	}
+
+	~FakeHead() {
+		m_quit = true;
+		m_thread.join();
+		close(m_listen);
+	}
+
+	int getPort() const {
+		return m_port;
+	}
+
+	int getNbConnections() {
+		lock_guard<mutex> lock(m_mutex);
+		return m_nb_connections;
+	}
+
+	void getReceived(vector<string>& received) {
+		lock_guard<mutex> lock(m_mutex);
+		received = m_received;
+	}
+
+	void clearReceived() {
+		lock_guard<mutex> lock(m_mutex);
+		m_received.clear();
+	}
+
+	void setReply(const string& name, const string& reply) {
+		lock_guard<mutex> lock(m_mutex);
+		m_replies[name] = reply;
+	}
+
+private:
+	bool waitReadable(int fd) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		while (!m_quit)
+			if (poll(&pfd, 1, 50) > 0)
+				return true;
+		return false;
+	}
+
+	void run() {
+		while (waitReadable(m_listen)) {
+			int skt = accept(m_listen, 0, 0);
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_nb_connections++;
+			}
+			serve(skt);
+			close(skt);
+		}
+	}
+
+	void serve(int skt) {
+		string pending;
+		char buf[1024];
+		while (waitReadable(skt)) {
+			int count = read(skt, buf, sizeof(buf));
+			if (count <= 0)
+				return;
+			pending.append(buf, count);
+			size_t end;
+			string out;
+			while ((end = pending.find("\r\n")) != string::npos) {
+				string cmd = pending.substr(0, end);
+				pending.erase(0, end + 2);
+				lock_guard<mutex> lock(m_mutex);
+				m_received.push_back(cmd);
+				if (cmd == "drop")
+					return;
+				if (cmd.compare(0, 5, "read ") == 0) {
+					map<string, string>::iterator it = m_replies.find(cmd.substr(5));
+					out += ((it != m_replies.end()) ? it->second : "<" + cmd.substr(5)) + "\r\n";
+				} else if (cmd != "mute") {
+					out += "ACK\r\n";
+				}
+			}
+			if (!out.empty() && write(skt, out.data(), out.size()) < 0)
+				return;
+		}
+	}
+
+	volatile bool m_quit;
+	int m_listen;
+	int m_port;
+	int m_nb_connections;
+	vector<string> m_received;
+	map<string, string> m_replies;
+	mutex m_mutex;
+	thread m_thread;
+};
+
+#endif /* FAKEHEAD_H_ */
@@ -0,0 +1,68 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// TestUtils.h
+// Created on: Oct 19, 2026
+
+#ifndef TESTUTILS_H_
+#define TESTUTILS_H_
+
+#include <cmath>
+#include <iostream>
+
+/*
+ * The checks report the failures and go on, main() returns
+ * testResult() so that ctest sees them.
+ */
+static int testFailures = 0;
+
+#define CHECK(cond)																		\
+	do {																				\
+		if (!(cond)) {																	\
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl;	\
+			testFailures++;																\
+		}																				\
+	} while (0)
+
+#define CHECK_CLOSE(a, b, tol)	CHECK(std::fabs((a) - (b)) <= (tol))
+
+#define CHECK_THROW(expr)																\
+	do {																				\
+		bool thrown = false;															\
+		try {																			\
+			expr;																		\
+		} catch (...) {																	\
+			thrown = true;																\
+		}																				\
+		if (!thrown) {																	\
+			std::cerr << __FILE__ << ":" << __LINE__ << ": no exception: " #expr << std::endl;	\
+			testFailures++;																\
+		}																				\
+	} while (0)
+
+static inline int testResult() {
+	if (testFailures)
+		std::cerr << testFailures << " check(s) failed" << std::endl;
+	return testFailures ? 1 : 0;
+}
+
+#endif /* TESTUTILS_H_ */
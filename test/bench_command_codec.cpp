@@ -0,0 +1,112 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// bench_command_codec.cpp
+// Created on: Oct 19, 2026
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "UltraCommandCodec.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+/*
+ * Times the command codec against the stringstream formatting and
+ * sscanf parsing the camera used before, on the commands sent by the
+ * setters and the telemetry polling. Run it by hand, e.g.
+ * bench_command_codec 1000000
+ */
+
+static const char* const adcNames[] = { "off", "ref" };
+
+typedef chrono::steady_clock Clock;
+
+static double elapsedNs(Clock::time_point start, long iterations) {
+	return chrono::duration<double, nano>(Clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char** argv) {
+	long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+	char buf[CommandCodec::maxLength];
+	unsigned long sink = 0;
+
+	Clock::time_point start = Clock::now();
+	for (long i=0; i<iterations; i++) {
+		float voltage = 1.0f + (i & 0xff) * 0.001f;
+		stringstream cmd;
+		cmd << "headvref " << voltage << "V";
+		string msg = "set " + cmd.str();
+		sink += strlen(msg.c_str());
+		stringstream adc;
+		adc << "adc" << (i & 3) << adcNames[i & 1] << (i & 3) << " " << voltage << "V";
+		msg = "set " + adc.str();
+		sink += strlen(msg.c_str());
+		stringstream pair;
+		pair << "fpgas1 " << (i & 0xfff) << " " << ((i >> 4) & 0xfff);
+		msg = "set " + pair.str();
+		sink += strlen(msg.c_str());
+	}
+	double streamFormat = elapsedNs(start, iterations);
+
+	start = Clock::now();
+	for (long i=0; i<iterations; i++) {
+		float voltage = 1.0f + (i & 0xff) * 0.001f;
+		sink += CommandCodec::formatSetVolts(buf, CommandCodec::HeadVref, voltage);
+		sink += CommandCodec::formatSetVolts(buf, (i & 1) ? CommandCodec::AdcGain : CommandCodec::AdcOffset,
+				voltage, i & 3, i & 3);
+		sink += CommandCodec::formatSetPair(buf, CommandCodec::FpgaS1, i & 0xfff, (i >> 4) & 0xfff);
+	}
+	double codecFormat = elapsedNs(start, iterations);
+
+	start = Clock::now();
+	for (long i=0; i<iterations; i++) {
+		float value;
+		unsigned int reg, value1, value2;
+		sscanf("<1.234", "<%f", &value);
+		sscanf("0x1f3a", "%x", &reg);
+		sscanf("120 40", "%u %u", &value1, &value2);
+		sink += reg + value1 + value2 + (value > 1);
+	}
+	double scanfParse = elapsedNs(start, iterations);
+
+	start = Clock::now();
+	for (long i=0; i<iterations; i++) {
+		float value;
+		unsigned int reg, value1, value2;
+		CommandCodec::parseVolts("<1.234", value);
+		CommandCodec::parseHex("0x1f3a", reg);
+		CommandCodec::parsePair("120 40", value1, value2);
+		sink += reg + value1 + value2 + (value > 1);
+	}
+	double codecParse = elapsedNs(start, iterations);
+
+	cout << "format 3 commands: stringstream " << streamFormat << " ns, codec " << codecFormat << " ns" << endl;
+	cout << "parse 3 replies:   sscanf " << scanfParse << " ns, codec " << codecParse << " ns" << endl;
+	// keeps the loops from being optimised out
+	return (sink == 0) ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_acq_state.cpp
+// Created on: Oct 19, 2026
+
+#include <atomic>
+#include <cstdlib>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "UltraCamera.h"
+#include "TestUtils.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+/*
+ * The acquisition state machine under status polling: a camera without
+ * a head replays a capture file while threads poll the state and the
+ * frame counters, and the acquisitions are started and stopped, also
+ * from two threads at once.
+ */
+
+static const int npixels = 64;
+static const int nbLines = 100000;
+
+class FrameCounter : public HwFrameCallback {
+public:
+	FrameCounter() : m_nb(0) {}
+	atomic<long long> m_nb;
+protected:
+	virtual bool newFrameReady(const HwFrameInfoType&) {
+		m_nb++;
+		return true;
+	}
+};
+
+static string writeCapture() {
+	stringstream filename;
+	filename << "/tmp/test_acq_state_" << getpid() << ".raw";
+	vector<unsigned char> buf(6 + npixels * 2, 0);
+	RawCapture capture;
+	capture.open(filename.str(), (long long) nbLines * (buf.size() + 32) + (1 << 20));
+	for (unsigned int i=0; i<(unsigned int) nbLines; i++) {
+		buf[0] = i >> 24;
+		buf[1] = i >> 16;
+		buf[2] = i >> 8;
+		buf[3] = i;
+		capture.append(&buf[0], buf.size());
+	}
+	capture.close();
+	return filename.str();
+}
+
+// value of a key=value pair of the acquisition summary, -1 if missing
+static long long summaryValue(const string& summary, const string& key) {
+	size_t pos = summary.find(" " + key + "=");
+	if (pos == string::npos)
+		return -1;
+	return atoll(summary.c_str() + pos + key.size() + 2);
+}
+
+// the summary is written once the acquisition is Idle
+static string waitSummary(Camera& cam, int acq_nb) {
+	string summary;
+	for (int i=0; i<1000; i++) {
+		cam.getAcqSummary(summary);
+		stringstream prefix;
+		prefix << "acq=" << acq_nb << " ";
+		if (summary.compare(0, prefix.str().size(), prefix.str()) == 0)
+			break;
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	return summary;
+}
+
+static bool waitIdle(Camera& cam) {
+	for (int i=0; i<10000 && cam.isAcqRunning(); i++)
+		this_thread::sleep_for(chrono::milliseconds(1));
+	return !cam.isAcqRunning();
+}
+
+int main() {
+	string filename = writeCapture();
+	Camera cam("", "", 7, 5005, npixels);
+	// the camera turns all the debug output on
+	DebParams::setTypeFlags(0);
+	FrameCounter counter;
+	HwBufferCtrlObj* buffer = cam.getBufferCtrlObj();
+	buffer->setFrameDim(FrameDim(npixels, 1, Bpp16));
+	buffer->setNbBuffers(1000);
+	buffer->registerFrameCallback(counter);
+	cam.setReplay(filename, false);
+	cam.setNbFrames(0);
+
+	atomic<bool> done(false);
+	atomic<long long> nb_polls(0);
+	atomic<int> bad_states(0);
+	vector<thread> pollers;
+	for (int t=0; t<4; t++) {
+		pollers.push_back(thread([&]() {
+			while (!done) {
+				Camera::AcqState state;
+				long long nb_frames;
+				cam.isAcqRunning();
+				cam.getAcqState(state);
+				cam.getAcquiredFrames(nb_frames);
+				// -1 before the first acquisition
+				if (state < Camera::Idle || state >= Camera::Fault || nb_frames < -1 ||
+						cam.getNbHwAcquiredFrames() < -1)
+					bad_states++;
+				nb_polls++;
+			}
+		}));
+	}
+
+	// stopping at any point of the acquisition ends it in Idle
+	for (int i=0; i<200; i++) {
+		cam.setTrigMode((i % 2) ? ExtTrigMult : IntTrig);
+		counter.m_nb = 0;
+		cam.prepareAcq();
+		cam.startAcq();
+		this_thread::sleep_for(chrono::microseconds((i * 37) % 500));
+		if (i % 3 == 0) {
+			thread other([&cam]() { cam.stopAcq(); });
+			cam.stopAcq();
+			other.join();
+		} else {
+			cam.stopAcq();
+		}
+		Camera::AcqState state;
+		cam.getAcqState(state);
+		CHECK(state == Camera::Idle);
+		CHECK(!cam.isAcqRunning());
+		long long nb_frames;
+		cam.getAcquiredFrames(nb_frames);
+		CHECK(nb_frames == counter.m_nb);
+		CHECK(nb_frames <= nbLines);
+	}
+
+	// to the end of the replay, a stop when idle does nothing
+	for (int i=0; i<3; i++) {
+		cam.setTrigMode(IntTrig);
+		counter.m_nb = 0;
+		cam.prepareAcq();
+		cam.startAcq();
+		CHECK(waitIdle(cam));
+		long long nb_frames;
+		cam.getAcquiredFrames(nb_frames);
+		CHECK(nb_frames == nbLines);
+		CHECK(counter.m_nb == nbLines);
+		// every line read is handed to Lima
+		string summary = waitSummary(cam, 201 + i);
+		CHECK(summaryValue(summary, "lines") == nbLines);
+		CHECK(summaryValue(summary, "frames_ready") == nbLines);
+		CHECK(summaryValue(summary, "discarded") == 0);
+		CHECK(summaryValue(summary, "filtered") == 0);
+		CHECK(summaryValue(summary, "host_losses") == 0);
+		cam.stopAcq();
+		Camera::AcqState state;
+		cam.getAcqState(state);
+		CHECK(state == Camera::Idle);
+	}
+
+	// the lines of a type not kept are no host losses
+	cam.setLineTypeKept(Camera::DataLine, false);
+	counter.m_nb = 0;
+	cam.prepareAcq();
+	cam.startAcq();
+	CHECK(waitIdle(cam));
+	CHECK(counter.m_nb == 0);
+	string summary = waitSummary(cam, 204);
+	CHECK(summaryValue(summary, "lines") == nbLines);
+	CHECK(summaryValue(summary, "filtered") == nbLines);
+	CHECK(summaryValue(summary, "frames_ready") == 0);
+	CHECK(summaryValue(summary, "host_losses") == 0);
+	cam.setLineTypeKept(Camera::DataLine, true);
+
+	done = true;
+	for (size_t t=0; t<pollers.size(); t++)
+		pollers[t].join();
+	CHECK(bad_states == 0);
+	CHECK(nb_polls > 0);
+	buffer->unregisterFrameCallback(counter);
+	cam.setReplay("", false);
+	unlink(filename.c_str());
+	return testResult();
+}
@@ -0,0 +1,179 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_calibration.cpp
+// Created on: Oct 19, 2026
+
+#include <cmath>
+#include <vector>
+#include "UltraCalibration.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+static const int npixels = 16;
+
+static unsigned int lcg(unsigned int& seed) {
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 16;
+}
+
+/*
+ * The running mean and variance match the two pass ones, also on a
+ * large offset with a small noise where the sum of squares would lose
+ * the variance
+ */
+static void testPedestal(unsigned short base, unsigned int spread) {
+	Calibration calib(npixels);
+	const int nb_lines = 2000;
+	vector<vector<unsigned short> > lines(nb_lines, vector<unsigned short>(npixels));
+	unsigned int seed = 12345;
+
+	for (int l=0; l<nb_lines; l++) {
+		for (int p=0; p<npixels; p++)
+			lines[l][p] = base + p + lcg(seed) % spread;
+		calib.addPedestalLine(&lines[l][0]);
+	}
+	vector<double> gains, offsets, noise;
+	calib.getEstimates(gains, offsets, noise);
+	CHECK(offsets.size() == (size_t) npixels);
+	for (int p=0; p<npixels; p++) {
+		double mean = 0, var = 0;
+		for (int l=0; l<nb_lines; l++)
+			mean += lines[l][p];
+		mean /= nb_lines;
+		for (int l=0; l<nb_lines; l++)
+			var += (lines[l][p] - mean) * (lines[l][p] - mean);
+		var /= nb_lines;
+		CHECK_CLOSE(offsets[p], mean, 1e-9 * mean);
+		CHECK_CLOSE(noise[p], sqrt(var), 1e-6 * sqrt(var) + 1e-9);
+		CHECK(gains[p] == 1.);
+	}
+	unsigned long long calibration, pedestal;
+	calib.getNbLines(calibration, pedestal);
+	CHECK(calibration == 0 && pedestal == nb_lines);
+}
+
+/*
+ * Past the window the mean follows the last lines
+ */
+static void testWindow() {
+	Calibration calib(npixels);
+	vector<unsigned short> low(npixels, 100), high(npixels, 200);
+	vector<double> gains, offsets, noise;
+	int nb_lines;
+
+	CHECK_THROW(calib.setWindow(-1));
+	calib.setWindow(10);
+	calib.getWindow(nb_lines);
+	CHECK(nb_lines == 10);
+
+	// up to the window, the plain mean
+	for (int l=0; l<5; l++)
+		calib.addPedestalLine(&low[0]);
+	for (int l=0; l<5; l++)
+		calib.addPedestalLine(&high[0]);
+	calib.getEstimates(gains, offsets, noise);
+	CHECK_CLOSE(offsets[0], 150., 1e-9);
+	CHECK_CLOSE(noise[0], 50., 1e-9);
+
+	for (int l=0; l<500; l++)
+		calib.addPedestalLine(&high[0]);
+	calib.getEstimates(gains, offsets, noise);
+	CHECK_CLOSE(offsets[0], 200., 1e-6);
+	CHECK_CLOSE(noise[0], 0., 1e-3);
+
+	// without a window, all the lines since the reset
+	calib.reset();
+	calib.setWindow(0);
+	for (int l=0; l<500; l++)
+		calib.addPedestalLine(&low[0]);
+	for (int l=0; l<1500; l++)
+		calib.addPedestalLine(&high[0]);
+	calib.getEstimates(gains, offsets, noise);
+	CHECK_CLOSE(offsets[0], 175., 1e-9);
+}
+
+static void testGain() {
+	Calibration calib(npixels);
+	vector<unsigned short> pedestal(npixels, 100), pulse(npixels);
+	vector<double> gains, offsets, noise;
+	vector<double> amplitude(npixels);
+	double reference = 0;
+
+	// the last pixel gets no pulse
+	for (int p=0; p<npixels; p++) {
+		amplitude[p] = (p == npixels - 1) ? 0 : 1000 + 100 * p;
+		pulse[p] = 100 + amplitude[p];
+		if (amplitude[p] > 0)
+			reference += amplitude[p] / (npixels - 1);
+	}
+	for (int l=0; l<10; l++) {
+		calib.addPedestalLine(&pedestal[0]);
+		calib.addCalibrationLine(&pulse[0]);
+	}
+	calib.getEstimates(gains, offsets, noise);
+	for (int p=0; p<npixels - 1; p++)
+		CHECK_CLOSE(gains[p], amplitude[p] / reference, 1e-6);
+	CHECK(gains[npixels - 1] == 1.);
+
+	CHECK_THROW(calib.setReference(-1));
+	calib.setReference(500);
+	calib.getReference(reference);
+	CHECK(reference == 500);
+	calib.getEstimates(gains, offsets, noise);
+	for (int p=0; p<npixels - 1; p++)
+		CHECK_CLOSE(gains[p], amplitude[p] / 500, 1e-6);
+
+	// a pulse line becomes the reference amplitude, below the offset 0
+	vector<unsigned short> line = pulse;
+	calib.correct(&line[0]);
+	for (int p=0; p<npixels - 1; p++)
+		CHECK(line[p] == 500);
+	CHECK(line[npixels - 1] == 0);
+	line.assign(npixels, 50);
+	calib.correct(&line[0]);
+	CHECK(line[0] == 0);
+
+	unsigned long long calibration, nb_pedestal;
+	calib.getNbLines(calibration, nb_pedestal);
+	CHECK(calibration == 10 && nb_pedestal == 10);
+
+	// a new number of pixels starts over
+	calib.setNbPixels(2 * npixels);
+	calib.getNbLines(calibration, nb_pedestal);
+	CHECK(calibration == 0 && nb_pedestal == 0);
+	calib.getEstimates(gains, offsets, noise);
+	CHECK(gains.size() == (size_t) (2 * npixels) && gains[0] == 1. && offsets[0] == 0.);
+	line.assign(2 * npixels, 1234);
+	calib.correct(&line[0]);
+	CHECK(line[2 * npixels - 1] == 1234);
+}
+
+int main() {
+	testPedestal(100, 1000);
+	testPedestal(60000, 4);
+	testWindow();
+	testGain();
+	return testResult();
+}
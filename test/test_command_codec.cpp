@@ -0,0 +1,131 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_command_codec.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include "UltraCommandCodec.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+
+static void testFormat() {
+	char buf[CommandCodec::maxLength];
+
+	CHECK(CommandCodec::formatRead(buf, CommandCodec::HeadVref) == 13);
+	CHECK(strcmp(buf, "read headvref") == 0);
+	CommandCodec::formatRead(buf, CommandCodec::AdcGain, 2, 13);
+	CHECK(strcmp(buf, "read adc2ref13") == 0);
+	CommandCodec::formatSetVolts(buf, CommandCodec::HeadVref, 1.25f);
+	CHECK(strcmp(buf, "set headvref 1.25V") == 0);
+	CommandCodec::formatSetVolts(buf, CommandCodec::AdcOffset, -0.5f, 1, 3);
+	CHECK(strcmp(buf, "set adc1off3 -0.5V") == 0);
+	CommandCodec::formatSetHex(buf, CommandCodec::FpgaSync, 0x1f3a);
+	CHECK(strcmp(buf, "set fpgasync 1f3a") == 0);
+	CommandCodec::formatSetPair(buf, CommandCodec::FpgaS1, 120, 0);
+	CHECK(strcmp(buf, "set fpgas1 120 0") == 0);
+	CHECK(CommandCodec::formatSet(buf, CommandCodec::State) > 0);
+	CHECK(strcmp(buf, "set state") == 0);
+
+	// wrong format or read only
+	CHECK(CommandCodec::formatSetHex(buf, CommandCodec::HeadVref, 1) == -1);
+	CHECK(CommandCodec::formatSetVolts(buf, CommandCodec::ColdTemp, 1) == -1);
+	CHECK(CommandCodec::formatSetHex(buf, CommandCodec::FpgaFrame, 1) == -1);
+	CHECK(CommandCodec::formatSet(buf, CommandCodec::HeadVref) == -1);
+}
+
+static void testSetting() {
+	char buf[CommandCodec::maxLength];
+
+	CHECK(CommandCodec::formatSetting(buf, "headvref 1.2") > 0);
+	CHECK(strcmp(buf, "set headvref 1.2V") == 0);
+	CHECK(CommandCodec::formatSetting(buf, " fpgaaux1 10 20 ") > 0);
+	CHECK(strcmp(buf, "set fpgaaux1 10 20") == 0);
+	CHECK(CommandCodec::formatSetting(buf, "adc1off3 0.1") > 0);
+	CHECK(strcmp(buf, "set adc1off3 0.1V") == 0);
+	CHECK(CommandCodec::formatSetting(buf, "fpgapwr 0x10") > 0);
+	CHECK(strcmp(buf, "set fpgapwr 10") == 0);
+	CHECK(CommandCodec::formatSetting(buf, "fpgapwr 16") > 0);
+	CHECK(strcmp(buf, "set fpgapwr 10") == 0);
+	CHECK(CommandCodec::formatSetting(buf, "state") > 0);
+
+	CHECK(CommandCodec::formatSetting(buf, "unknown 1") == -1);
+	CHECK(CommandCodec::formatSetting(buf, "coldtemp 1") == -1);
+	CHECK(CommandCodec::formatSetting(buf, "headvref") == -1);
+	CHECK(CommandCodec::formatSetting(buf, "headvref 1.2 3") == -1);
+	CHECK(CommandCodec::formatSetting(buf, "fpgaaux1 10") == -1);
+	CHECK(CommandCodec::formatSetting(buf, "state 1") == -1);
+}
+
+static void testLookup() {
+	CommandCodec::Id id;
+	int board, channel;
+
+	CHECK(CommandCodec::lookup("fpgaxclk", id, board, channel));
+	CHECK(id == CommandCodec::FpgaXclk);
+	CHECK(CommandCodec::lookup("adc12ref7", id, board, channel));
+	CHECK(id == CommandCodec::AdcGain && board == 12 && channel == 7);
+	CHECK(!CommandCodec::lookup("adc", id, board, channel));
+	CHECK(!CommandCodec::lookup("adc1off", id, board, channel));
+	CHECK(!CommandCodec::lookup("headvrefx", id, board, channel));
+
+	// every command finds itself back
+	for (int i=0; i<CommandCodec::NbCommands; i++) {
+		const CommandCodec::Descriptor& desc = CommandCodec::describe(CommandCodec::Id(i));
+		char buf[CommandCodec::maxLength];
+		CommandCodec::formatRead(buf, CommandCodec::Id(i), 1, 2);
+		CHECK(CommandCodec::lookup(buf + 5, id, board, channel));
+		CHECK(id == i);
+		CHECK(!desc.suffix || (board == 1 && channel == 2));
+	}
+}
+
+static void testParse() {
+	float value;
+	unsigned int reg, value1, value2;
+
+	CHECK(CommandCodec::parseVolts("<1.234", value));
+	CHECK_CLOSE(value, 1.234f, 1e-6);
+	CHECK(CommandCodec::parseVolts(">-0.5", value));
+	CHECK_CLOSE(value, -0.5f, 1e-6);
+	CHECK(!CommandCodec::parseVolts("<", value));
+	CHECK(CommandCodec::parseHex("0x1F3a", reg));
+	CHECK(reg == 0x1f3a);
+	CHECK(CommandCodec::parseHex(" ff", reg));
+	CHECK(reg == 0xff);
+	CHECK(!CommandCodec::parseHex("zz", reg));
+	CHECK(CommandCodec::parsePair("120 40", value1, value2));
+	CHECK(value1 == 120 && value2 == 40);
+	CHECK(!CommandCodec::parsePair("120", value1, value2));
+	CHECK(CommandCodec::isAck("ACK\r\n"));
+	CHECK(!CommandCodec::isAck("ACK"));
+	CHECK(!CommandCodec::isAck("NAK\r\n"));
+}
+
+int main() {
+	testFormat();
+	testSetting();
+	testLookup();
+	testParse();
+	return testResult();
+}
@@ -0,0 +1,251 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_events.cpp
+// Created on: Oct 19, 2026
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "UltraEvents.h"
+#include "UltraNet.h"
+#include "FakeHead.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+class Recorder : public EventCallback {
+public:
+	virtual void telemetryChanged(const string& name, double value) {
+		lock_guard<mutex> lock(m_mutex);
+		m_names.push_back(name);
+		m_values.push_back(value);
+	}
+	virtual void dataReady(long long nb_frames) {
+		lock_guard<mutex> lock(m_mutex);
+		m_frames.push_back(nb_frames);
+	}
+	virtual void acqFailed(const string& message) {
+		lock_guard<mutex> lock(m_mutex);
+		m_failures.push_back(message);
+	}
+
+	// number of telemetry events for name, and the last value
+	int getTelemetry(const string& name, double& value) {
+		lock_guard<mutex> lock(m_mutex);
+		int nb = 0;
+		for (size_t i=0; i<m_names.size(); i++) {
+			if (m_names[i] == name) {
+				nb++;
+				value = m_values[i];
+			}
+		}
+		return nb;
+	}
+
+	vector<string> m_names;
+	vector<double> m_values;
+	vector<long long> m_frames;
+	vector<string> m_failures;
+	mutex m_mutex;
+};
+
+// wait up to 2 s for name to get nb events
+static bool waitTelemetry(Recorder& recorder, const string& name, int nb, double& value) {
+	for (int i=0; i<200; i++) {
+		if (recorder.getTelemetry(name, value) >= nb)
+			return true;
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	return false;
+}
+
+static void testDataReady() {
+	EventPublisher publisher;
+	Recorder recorder;
+
+	publisher.registerCallback(recorder);
+	CHECK_THROW(publisher.setDataReadyPeriod(-1));
+	publisher.setDataReadyPeriod(10);
+	CHECK(publisher.getDataReadyPeriod() == 10);
+	for (long long i=1; i<=35; i++)
+		publisher.frameReady(i);
+	publisher.endAcq(35);
+	CHECK(recorder.m_frames.size() == 4);
+	if (recorder.m_frames.size() == 4) {
+		CHECK(recorder.m_frames[0] == 10);
+		CHECK(recorder.m_frames[2] == 30);
+		CHECK(recorder.m_frames[3] == 35);
+	}
+
+	// the last line already gave the event
+	recorder.m_frames.clear();
+	publisher.frameReady(40);
+	publisher.endAcq(40);
+	CHECK(recorder.m_frames.size() == 1);
+
+	// past 2^31 lines
+	recorder.m_frames.clear();
+	publisher.frameReady(10000000000LL);
+	CHECK(recorder.m_frames.size() == 1 && recorder.m_frames[0] == 10000000000LL);
+
+	recorder.m_frames.clear();
+	publisher.setDataReadyPeriod(0);
+	publisher.frameReady(50);
+	publisher.endAcq(51);
+	CHECK(recorder.m_frames.empty());
+
+	unsigned long long telemetry, data_ready, errors;
+	publisher.getCounts(telemetry, data_ready, errors);
+	CHECK(telemetry == 0 && data_ready == 6 && errors == 0);
+}
+
+static void testCallback() {
+	EventPublisher publisher;
+	Recorder recorder, other;
+
+	// nobody listens
+	publisher.setDataReadyPeriod(1);
+	publisher.frameReady(1);
+	publisher.acqFailed("lost");
+
+	publisher.registerCallback(recorder);
+	publisher.registerCallback(recorder);
+	CHECK_THROW(publisher.registerCallback(other));
+	CHECK_THROW(publisher.unregisterCallback(other));
+	publisher.acqFailed("scan point 3 could not be set");
+	CHECK(recorder.m_failures.size() == 1 && recorder.m_failures[0] == "scan point 3 could not be set");
+
+	publisher.unregisterCallback(recorder);
+	publisher.frameReady(2);
+	publisher.acqFailed("lost");
+	CHECK(recorder.m_frames.empty());
+	CHECK(recorder.m_failures.size() == 1);
+	publisher.registerCallback(other);
+	publisher.frameReady(3);
+	CHECK(other.m_frames.size() == 1);
+
+	unsigned long long telemetry, data_ready, errors;
+	publisher.getCounts(telemetry, data_ready, errors);
+	CHECK(data_ready == 1);
+}
+
+static void testTelemetrySettings() {
+	EventPublisher publisher;
+	vector<string> names, got_names;
+	vector<double> deadbands, got_deadbands;
+	double period, heartbeat;
+
+	names.push_back("coldtemp");
+	names.push_back("fpgaerror");
+	names.push_back("adc1off3");
+	deadbands.push_back(0.1);
+	deadbands.push_back(0.2);
+	CHECK_THROW(publisher.setTelemetry(0, names, deadbands, 1, 0));
+	deadbands.push_back(0.3);
+	CHECK_THROW(publisher.setTelemetry(0, names, deadbands, -1, 0));
+	CHECK_THROW(publisher.setTelemetry(0, names, deadbands, 1, -1));
+
+	// no head: the settings are kept, nothing is sampled
+	publisher.setTelemetry(0, names, deadbands, 1, 5);
+	publisher.getTelemetry(got_names, got_deadbands, period, heartbeat);
+	CHECK(got_names == names);
+	CHECK(got_deadbands == deadbands);
+	CHECK(period == 1 && heartbeat == 5);
+
+	// one deadband for all
+	deadbands.assign(1, 0.5);
+	publisher.setTelemetry(0, names, deadbands, 1, 0);
+	publisher.getTelemetry(got_names, got_deadbands, period, heartbeat);
+	CHECK(got_deadbands.size() == 3 && got_deadbands[2] == 0.5);
+
+	names.push_back("state");
+	CHECK_THROW(publisher.setTelemetry(0, names, deadbands, 1, 0));
+	names.back() = "unknown";
+	CHECK_THROW(publisher.setTelemetry(0, names, deadbands, 1, 0));
+}
+
+static void testTelemetry() {
+	FakeHead head;
+	UltraNet net;
+	EventPublisher publisher;
+	Recorder recorder;
+	vector<string> names;
+	vector<double> deadbands;
+	double value = 0;
+
+	head.setReply("coldtemp", "<20.0");
+	head.setReply("fpgaerror", "0x10");
+	head.setReply("hottemp", "garbage");
+	net.connectToServer("127.0.0.1", head.getPort());
+	publisher.registerCallback(recorder);
+	names.push_back("coldtemp");
+	names.push_back("fpgaerror");
+	deadbands.push_back(0.5);
+	publisher.setTelemetry(&net, names, deadbands, 0.01, 0);
+	CHECK(waitTelemetry(recorder, "coldtemp", 1, value));
+	CHECK_CLOSE(value, 20.0, 1e-6);
+	CHECK(waitTelemetry(recorder, "fpgaerror", 1, value));
+	CHECK(value == 16);
+
+	// within the deadband, then past it
+	head.setReply("coldtemp", "<20.3");
+	this_thread::sleep_for(chrono::milliseconds(100));
+	CHECK(recorder.getTelemetry("coldtemp", value) == 1);
+	head.setReply("coldtemp", "<21.0");
+	CHECK(waitTelemetry(recorder, "coldtemp", 2, value));
+	CHECK_CLOSE(value, 21.0, 1e-6);
+	CHECK(recorder.getTelemetry("fpgaerror", value) == 1);
+
+	// the heartbeat pushes unchanged values
+	publisher.setTelemetry(&net, names, deadbands, 0.01, 0.05);
+	int nb = recorder.getTelemetry("coldtemp", value);
+	CHECK(waitTelemetry(recorder, "coldtemp", nb + 3, value));
+	publisher.stopTelemetry();
+
+	// a reply that does not parse is counted
+	unsigned long long telemetry, data_ready, errors;
+	publisher.getCounts(telemetry, data_ready, errors);
+	CHECK(errors == 0);
+	names.assign(1, "hottemp");
+	publisher.setTelemetry(&net, names, deadbands, 0.01, 0);
+	for (int i=0; i<200 && !errors; i++) {
+		this_thread::sleep_for(chrono::milliseconds(10));
+		publisher.getCounts(telemetry, data_ready, errors);
+	}
+	CHECK(errors > 0);
+	CHECK(recorder.getTelemetry("hottemp", value) == 0);
+	publisher.stopTelemetry();
+	publisher.unregisterCallback(recorder);
+	net.disconnectFromServer();
+}
+
+int main() {
+	testDataReady();
+	testCallback();
+	testTelemetrySettings();
+	testTelemetry();
+	return testResult();
+}
@@ -0,0 +1,180 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_histogram.cpp
+// Created on: Oct 19, 2026
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "UltraCamera.h"
+#include "UltraHistogram.h"
+#include "TestUtils.h"
+
+using namespace lima;
+using namespace lima::Ultra;
+using namespace std;
+
+/*
+ * The per channel histograms against the dark channel means: a camera
+ * without a head replays lines where each pixel block has its own level,
+ * and row r of the histograms must average to getDarkChannelMeans()[r].
+ */
+
+static const int npixels = 64;
+static const int nbLines = 2000;
+
+class FrameSink : public HwFrameCallback {
+protected:
+	virtual bool newFrameReady(const HwFrameInfoType&) {
+		return true;
+	}
+};
+
+static unsigned short pixelValue(int pixel) {
+	int block = pixel / (npixels / maxNumChannels);
+	return 100 + 10 * block + pixel % 3;
+}
+
+static string writeCapture() {
+	stringstream filename;
+	filename << "/tmp/test_histogram_" << getpid() << ".raw";
+	vector<unsigned char> buf(6 + npixels * 2, 0);
+	unsigned short* pixels = (unsigned short*) &buf[6];
+	for (int p=0; p<npixels; p++)
+		pixels[p] = pixelValue(p);
+	RawCapture capture;
+	capture.open(filename.str(), (long long) nbLines * (buf.size() + 32) + (1 << 20));
+	for (unsigned int i=0; i<(unsigned int) nbLines; i++) {
+		buf[0] = i >> 24;
+		buf[1] = i >> 16;
+		buf[2] = i >> 8;
+		buf[3] = i;
+		capture.append(&buf[0], buf.size());
+	}
+	capture.close();
+	return filename.str();
+}
+
+static double rowMean(const vector<unsigned int>& counts) {
+	double sum = 0, nb = 0;
+	for (size_t bin=0; bin<counts.size(); bin++) {
+		sum += (double) bin * counts[bin];
+		nb += counts[bin];
+	}
+	return (nb) ? sum / nb : -1;
+}
+
+static void testChannelRows() {
+	string filename = writeCapture();
+	Camera cam("", "", 7, 5005, npixels);
+	// the camera turns all the debug output on
+	DebParams::setTypeFlags(0);
+	HwBufferCtrlObj* buffer = cam.getBufferCtrlObj();
+	buffer->setFrameDim(FrameDim(npixels, 1, Bpp16));
+	buffer->setNbBuffers(nbLines);
+	FrameSink sink;
+	buffer->registerFrameCallback(sink);
+	cam.init();
+	cam.setReplay(filename, false);
+	cam.setTrigMode(IntTrig);
+	cam.setNbFrames(0);
+
+	vector<double> means;
+	cam.getDarkChannelMeans(100, means);
+	CHECK(means.size() == (size_t) maxNumChannels);
+
+	cam.setHistogramEnabled(true);
+	cam.setHistogramPerChannel(true);
+	cam.setHistogramBinning(4096, 0, 1);
+	cam.setHistogramThreads(3);
+	cam.prepareAcq();
+	cam.startAcq();
+	for (int i=0; i<10000 && cam.isAcqRunning(); i++)
+		this_thread::sleep_for(chrono::milliseconds(1));
+	CHECK(!cam.isAcqRunning());
+
+	int nb_rows, nb_bins;
+	cam.getHistogramSize(nb_rows, nb_bins);
+	CHECK(nb_rows == maxNumChannels);
+	long long nb_lines;
+	cam.getHistogramNbLines(nb_lines);
+	CHECK(nb_lines == nbLines);
+	for (int r=0; r<nb_rows && r<(int) means.size(); r++) {
+		vector<unsigned int> counts;
+		cam.getHistogram(r, counts);
+		CHECK_CLOSE(rowMean(counts), means[r], 1e-9);
+	}
+	buffer->unregisterFrameCallback(sink);
+	cam.setReplay("", false);
+	unlink(filename.c_str());
+}
+
+/*
+ * The rows follow the channel blocks, also when the blocks are sharded
+ * over threads
+ */
+static void testChannelPixels() {
+	const int nb_channels = 4;
+	const int block = 8;
+	vector<unsigned short> line(nb_channels * block);
+	for (size_t p=0; p<line.size(); p++)
+		line[p] = p / block;
+	int order[nb_channels] = { 2, 0, 3, 1 };
+	vector<int> first_pixels;
+	for (int c=0; c<nb_channels; c++)
+		first_pixels.push_back(order[c] * block);
+
+	for (int nb_threads=0; nb_threads<4; nb_threads++) {
+		Histogram hist(line.size(), nb_channels);
+		hist.setBinning(nb_channels, 0, 1);
+		hist.setPerChannel(true);
+		hist.setChannelPixels(first_pixels);
+		hist.setNbThreads(nb_threads);
+		for (int i=0; i<100; i++)
+			hist.addLine(&line[0]);
+		hist.flush();
+		for (int c=0; c<nb_channels; c++) {
+			vector<unsigned int> counts;
+			hist.getRow(c, counts);
+			CHECK(counts.size() == (size_t) nb_channels);
+			for (int bin=0; bin<(int) counts.size(); bin++)
+				CHECK(counts[bin] == (unsigned int) ((bin == order[c]) ? 100 * block : 0));
+		}
+	}
+
+	Histogram hist(line.size(), nb_channels);
+	first_pixels[1] = first_pixels[0];
+	CHECK_THROW(hist.setChannelPixels(first_pixels));
+	first_pixels[1] = 3;
+	CHECK_THROW(hist.setChannelPixels(first_pixels));
+	first_pixels.pop_back();
+	CHECK_THROW(hist.setChannelPixels(first_pixels));
+}
+
+int main() {
+	testChannelRows();
+	testChannelPixels();
+	return testResult();
+}
@@ -0,0 +1,204 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_multi_head.cpp
+// Created on: Oct 19, 2026
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "UltraMultiHead.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+/*
+ * Two heads replayed from capture files: the lines are aligned on their
+ * frame number, stop() ends a getLine() waiting for a head and a
+ * receive error is thrown by getLine().
+ */
+
+static const int npixels = 16;
+
+static string tempName(const char* name, int head) {
+	stringstream filename;
+	filename << "/tmp/" << name << "_" << getpid() << "_" << head << ".raw";
+	return filename.str();
+}
+
+static void writeCapture(const string& filename, const vector<unsigned int>& frames, int head) {
+	vector<unsigned char> buf(6 + npixels * 2);
+	RawCapture capture;
+	capture.open(filename, 1 << 20);
+	for (size_t i=0; i<frames.size(); i++) {
+		unsigned int frameNo = frames[i];
+		buf[0] = frameNo >> 24;
+		buf[1] = frameNo >> 16;
+		buf[2] = frameNo >> 8;
+		buf[3] = frameNo;
+		buf[4] = 0;
+		buf[5] = head;
+		unsigned short* pixels = (unsigned short*) &buf[6];
+		for (int p=0; p<npixels; p++)
+			pixels[p] = frameNo * 10 + head;
+		capture.append(&buf[0], buf.size());
+	}
+	capture.close();
+}
+
+struct Heads {
+	Heads(const char* name, const vector<unsigned int>& frames0, const vector<unsigned int>& frames1) :
+			multi(npixels) {
+		const vector<unsigned int>* frames[2] = { &frames0, &frames1 };
+		for (int h=0; h<2; h++) {
+			filenames[h] = tempName(name, h);
+			writeCapture(filenames[h], *frames[h], h);
+			replays[h].open(filenames[h], false);
+			nets[h].setReplay(&replays[h]);
+			multi.addHead(&nets[h]);
+		}
+	}
+	~Heads() {
+		multi.stop();
+		for (int h=0; h<2; h++) {
+			nets[h].setReplay(0);
+			replays[h].close();
+			unlink(filenames[h].c_str());
+		}
+	}
+	string filenames[2];
+	RawReplay replays[2];
+	UltraNet nets[2];
+	MultiHead multi;
+};
+
+static void testAlign() {
+	vector<unsigned int> frames0, frames1;
+	for (unsigned int f=10; f<20; f++) {
+		frames0.push_back(f);
+		if (f >= 12)
+			frames1.push_back(f);
+	}
+	Heads heads("test_multi_align", frames0, frames1);
+	vector<unsigned short> line(2 * npixels);
+	int frame_type;
+	unsigned int nb = 0;
+
+	heads.multi.start();
+	while (heads.multi.getLine(&line[0], frame_type)) {
+		CHECK(line[0] == (12 + nb) * 10);
+		CHECK(line[npixels] == (12 + nb) * 10 + 1);
+		CHECK(frame_type == 0);
+		nb++;
+	}
+	CHECK(nb == 8);
+	unsigned long long unmatched;
+	heads.multi.getUnmatched(0, unmatched);
+	CHECK(unmatched == 2);
+	heads.multi.getUnmatched(1, unmatched);
+	CHECK(unmatched == 0);
+	CHECK_THROW(heads.multi.getUnmatched(2, unmatched));
+}
+
+/*
+ * The first head receives frame 10 on its data port and then nothing:
+ * dropping it empties its ring, stop() must end the wait for the next
+ */
+static void testStop() {
+	vector<unsigned int> frames0, frames1(1, 11);
+	Heads heads("test_multi_stop", frames0, frames1);
+	vector<unsigned short> line(2 * npixels);
+	int frame_type;
+
+	int port = 0;
+	heads.nets[0].setReplay(0);
+	for (int i=0; i<100 && !port; i++) {
+		try {
+			port = 20000 + (getpid() + i * 7) % 20000;
+			heads.nets[0].initServerDataPort("127.0.0.1", port);
+		} catch (...) {
+			port = 0;
+		}
+	}
+	CHECK(port != 0);
+	if (!port)
+		return;
+	int skt = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(port);
+	vector<unsigned char> buf(6 + npixels * 2, 0);
+	buf[3] = 10;
+	sendto(skt, &buf[0], buf.size(), 0, (struct sockaddr*) &addr, sizeof(addr));
+	close(skt);
+
+	heads.multi.start();
+	thread stopper([&heads]() {
+		this_thread::sleep_for(chrono::milliseconds(300));
+		heads.multi.stop();
+	});
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	CHECK(!heads.multi.getLine(&line[0], frame_type));
+	CHECK(chrono::steady_clock::now() - start < chrono::seconds(2));
+	stopper.join();
+	unsigned long long unmatched;
+	heads.multi.getUnmatched(0, unmatched);
+	CHECK(unmatched == 1);
+}
+
+static void testError() {
+	vector<unsigned int> frames;
+	for (unsigned int f=0; f<10; f++)
+		frames.push_back(f);
+	Heads heads("test_multi_error", frames, frames);
+	vector<unsigned short> line(2 * npixels);
+	int frame_type;
+
+	// a record length past the end of the file
+	FILE* f = fopen(heads.filenames[1].c_str(), "r+");
+	unsigned int length = 1 << 30;
+	fseek(f, 4096, SEEK_SET);
+	fwrite(&length, sizeof(length), 1, f);
+	fclose(f);
+	heads.replays[1].close();
+	heads.replays[1].open(heads.filenames[1], false);
+	heads.nets[1].setReplay(&heads.replays[1]);
+
+	heads.multi.start();
+	CHECK_THROW(while (heads.multi.getLine(&line[0], frame_type)));
+}
+
+int main() {
+	testAlign();
+	testStop();
+	testError();
+	return testResult();
+}
@@ -0,0 +1,187 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_net_commands.cpp
+// Created on: Oct 19, 2026
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "UltraNet.h"
+#include "FakeHead.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+/*
+ * The command engine of UltraNet against a fake head on the loopback
+ */
+
+static void testReplies() {
+	FakeHead head;
+	UltraNet net;
+	string value;
+
+	net.connectToServer("127.0.0.1", head.getPort());
+	net.sendWait("read coldtemp", value);
+	CHECK(value == "<coldtemp\r\n");
+	net.sendWait("set headvref 1V", value);
+	CHECK(value == "ACK\r\n");
+
+	// the batch replies come back in order
+	vector<string> cmds, values;
+	for (int i=0; i<200; i++) {
+		stringstream cmd;
+		cmd << "read " << i;
+		cmds.push_back(cmd.str());
+	}
+	net.sendWaitBatch(cmds, values);
+	CHECK(values.size() == cmds.size());
+	for (size_t i=0; i<values.size(); i++)
+		CHECK(values[i] == "<" + cmds[i].substr(5) + "\r\n");
+
+	// pipelined from several threads
+	vector<thread> threads;
+	vector<int> failures(4, 0);
+	for (int t=0; t<4; t++) {
+		threads.push_back(thread([&net, &failures, t]() {
+			for (int i=0; i<100; i++) {
+				stringstream cmd;
+				cmd << "read " << t << "-" << i;
+				if (net.sendAsync(cmd.str()).get() != "<" + cmd.str().substr(5) + "\r\n")
+					failures[t]++;
+			}
+		}));
+	}
+	for (size_t t=0; t<threads.size(); t++)
+		threads[t].join();
+	for (size_t t=0; t<failures.size(); t++)
+		CHECK(failures[t] == 0);
+	net.disconnectFromServer();
+}
+
+/*
+ * A missing reply fails its command after the timeout, the connection
+ * is then opened again
+ */
+static void testTimeout() {
+	FakeHead head;
+	UltraNet net;
+	string value;
+
+	net.setCommandTimeout(0.2);
+	CHECK_CLOSE(net.getCommandTimeout(), 0.2, 1e-9);
+	net.setReconnect(true, 0.01, 0.05);
+	net.connectToServer("127.0.0.1", head.getPort());
+	CHECK_THROW(net.sendWait("mute", value));
+	net.sendWait("read 1", value);
+	CHECK(value == "<1\r\n");
+	CHECK(head.getNbConnections() == 2);
+
+	int count;
+	double total, last;
+	net.getOutages(count, total, last);
+	CHECK(count == 1);
+	CHECK(total >= 0 && last >= 0);
+	net.disconnectFromServer();
+}
+
+/*
+ * After an outage the last acknowledged value of each setting is sent
+ * again, in first set order, before the new commands
+ */
+static void testReconnect() {
+	FakeHead head;
+	UltraNet net;
+	string value;
+
+	net.setReconnect(true, 0.01, 0.05);
+	CHECK(net.getReconnect());
+	net.connectToServer("127.0.0.1", head.getPort());
+	net.sendWait("set headvref 1V", value);
+	net.sendWait("set fpgapwr 3", value);
+	net.sendWait("set headvref 2V", value);
+	net.sendWait("read coldtemp", value);
+	CHECK_THROW(net.sendWait("drop", value));
+	head.clearReceived();
+	net.sendWait("read hottemp", value);
+	CHECK(value == "<hottemp\r\n");
+
+	vector<string> received;
+	head.getReceived(received);
+	CHECK(received.size() == 3);
+	if (received.size() == 3) {
+		CHECK(received[0] == "set headvref 2V");
+		CHECK(received[1] == "set fpgapwr 3");
+		CHECK(received[2] == "read hottemp");
+	}
+	net.disconnectFromServer();
+}
+
+/*
+ * While the head is gone the commands still fail at their own deadline,
+ * not at the next connection attempt
+ */
+static void testDeadHead() {
+	FakeHead* head = new FakeHead;
+	UltraNet net;
+	string value;
+
+	net.setCommandTimeout(0.3);
+	net.setReconnect(true, 2, 8);
+	net.connectToServer("127.0.0.1", head->getPort());
+	delete head;
+	for (int i=0; i<3; i++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		CHECK_THROW(net.sendWait("read coldtemp", value));
+		double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		CHECK(elapsed < 1);
+	}
+	net.disconnectFromServer();
+}
+
+static void testNotConnected() {
+	UltraNet net;
+	string value;
+
+	CHECK_THROW(net.sendWait("read coldtemp", value));
+	CHECK_THROW(net.setCommandTimeout(0));
+	CHECK_THROW(net.setReconnect(true, 1, 0.5));
+
+	// no head and no reconnection: the connection is refused
+	FakeHead* head = new FakeHead;
+	int port = head->getPort();
+	delete head;
+	CHECK_THROW(net.connectToServer("127.0.0.1", port));
+}
+
+int main() {
+	testReplies();
+	testTimeout();
+	testReconnect();
+	testDeadHead();
+	testNotConnected();
+	return testResult();
+}
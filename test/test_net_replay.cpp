@@ -0,0 +1,269 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_net_replay.cpp
+// Created on: Oct 19, 2026
+
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "UltraNet.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+/*
+ * The capture and replay paths of UltraNet: the lines received on the
+ * data socket are captured, then read back through a replay source.
+ */
+
+static const int npixels = 64;
+static const int lineSize = npixels * 2;
+
+static string tempName(const char* name) {
+	stringstream filename;
+	filename << "/tmp/" << name << "_" << getpid() << ".raw";
+	return filename.str();
+}
+
+// the datagram header: frame number and frame type, big endian
+static void makeDatagram(vector<unsigned char>& buf, unsigned int frameNo, int frameType) {
+	buf.resize(6 + lineSize);
+	buf[0] = frameNo >> 24;
+	buf[1] = frameNo >> 16;
+	buf[2] = frameNo >> 8;
+	buf[3] = frameNo;
+	buf[4] = frameType >> 8;
+	buf[5] = frameType;
+	unsigned short* pixels = (unsigned short*) &buf[6];
+	for (int i=0; i<npixels; i++)
+		pixels[i] = frameNo * npixels + i;
+}
+
+static bool checkLine(const vector<unsigned short>& line, unsigned int frameNo) {
+	for (int i=0; i<npixels; i++)
+		if (line[i] != (unsigned short) (frameNo * npixels + i))
+			return false;
+	return true;
+}
+
+static void writeCapture(const string& filename, unsigned int first, unsigned int nb, unsigned int skip) {
+	vector<unsigned char> buf;
+	RawCapture capture;
+	capture.open(filename, 1 << 20);
+	for (unsigned int i=first; i<first+nb; i++) {
+		if (i == skip)
+			continue;
+		makeDatagram(buf, i, i % 4);
+		capture.append(&buf[0], buf.size());
+	}
+	capture.close();
+}
+
+static void testReplay() {
+	string filename = tempName("test_net_replay");
+	writeCapture(filename, 100, 50, 0);
+
+	RawReplay replay;
+	replay.open(filename, false);
+	UltraNet net;
+	net.setReplay(&replay);
+	vector<unsigned short> line(npixels);
+	unsigned int nb = 0;
+	CHECK(net.waitData(0));
+	while (net.getData(&line[0], lineSize)) {
+		CHECK(checkLine(line, 100 + nb));
+		CHECK(net.getFrameType() == int((100 + nb) % 4));
+		nb++;
+	}
+	CHECK(nb == 50);
+	CHECK(!net.getData(&line[0], lineSize));
+
+	// the sequence starts over with the source
+	replay.rewind();
+	net.setReplay(&replay);
+	CHECK(net.getData(&line[0], lineSize));
+	CHECK(checkLine(line, 100));
+	net.setReplay(0);
+	replay.close();
+	unlink(filename.c_str());
+}
+
+static void testSequenceGap() {
+	string filename = tempName("test_net_gap");
+	writeCapture(filename, 0, 10, 5);
+
+	RawReplay replay;
+	replay.open(filename, false);
+	Metrics metrics;
+	UltraNet net;
+	net.setMetrics(&metrics);
+	net.setReplay(&replay);
+	vector<unsigned short> line(npixels);
+	// the missing line is counted and skipped
+	for (unsigned int i=0; i<10; i++) {
+		if (i == 5)
+			continue;
+		CHECK(net.getData(&line[0], lineSize));
+		CHECK(checkLine(line, i));
+	}
+	CHECK(!net.getData(&line[0], lineSize));
+	CHECK(metrics.get(Metrics::SequenceGaps) == 1);
+	CHECK(metrics.get(Metrics::PacketsReceived) == 9);
+	net.setReplay(0);
+	replay.close();
+	unlink(filename.c_str());
+}
+
+/*
+ * Lines sent to the data port over the loopback are captured as they
+ * are received and replayed identically.
+ */
+static void testCaptureThenReplay() {
+	string filename = tempName("test_net_capture");
+	UltraNet net;
+	int port = 0;
+	for (int i=0; i<100 && !port; i++) {
+		try {
+			port = 20000 + (getpid() + i * 7) % 20000;
+			net.initServerDataPort("127.0.0.1", port);
+		} catch (...) {
+			port = 0;
+		}
+	}
+	CHECK(port != 0);
+	if (!port)
+		return;
+
+	RawCapture capture;
+	capture.open(filename, 1 << 20);
+	net.setRawCapture(&capture);
+	net.resetFrameSequence();
+
+	int skt = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(port);
+	vector<unsigned char> buf;
+	vector<unsigned short> line(npixels);
+	// nothing pending yet
+	CHECK(net.tryGetData(&line[0], lineSize) == 0);
+	for (unsigned int i=0; i<20; i++) {
+		makeDatagram(buf, i, 1);
+		sendto(skt, &buf[0], buf.size(), 0, (struct sockaddr*) &addr, sizeof(addr));
+		CHECK(net.waitData(1000));
+		if (i % 2)
+			CHECK(net.getData(&line[0], lineSize));
+		else
+			CHECK(net.tryGetData(&line[0], lineSize) == 1);
+		CHECK(checkLine(line, i));
+	}
+	close(skt);
+	net.setRawCapture(0);
+	long long nb_records;
+	capture.getNbRecords(nb_records);
+	CHECK(nb_records == 20);
+	capture.close();
+
+	RawReplay replay;
+	replay.open(filename, false);
+	UltraNet replayNet;
+	replayNet.setReplay(&replay);
+	unsigned int nb = 0;
+	while (replayNet.getData(&line[0], lineSize)) {
+		CHECK(checkLine(line, nb));
+		CHECK(replayNet.getFrameType() == 1);
+		nb++;
+	}
+	CHECK(nb == 20);
+	CHECK(replayNet.tryGetData(&line[0], lineSize) == -1);
+	replayNet.setReplay(0);
+	replay.close();
+	unlink(filename.c_str());
+}
+
+/*
+ * Lines received on several sockets come out in frame order, a line
+ * still missing 64 lines later is counted as a gap and skipped.
+ */
+static void testShardedReorder() {
+	Metrics metrics;
+	UltraNet net;
+	int port = 0;
+	for (int i=0; i<100 && !port; i++) {
+		try {
+			port = 20000 + (getpid() + i * 11) % 20000;
+			net.initServerDataPort("127.0.0.1", port);
+		} catch (...) {
+			port = 0;
+		}
+	}
+	CHECK(port != 0);
+	if (!port)
+		return;
+	net.setMetrics(&metrics);
+	net.setReceiveShards(2, -1, 6 + lineSize);
+	CHECK(net.getReceiveShards() == 2);
+
+	int skt = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(port);
+	vector<unsigned char> buf;
+	const unsigned int order[] = {0, 2, 1, 3};
+	for (unsigned int i=0; i<4; i++) {
+		makeDatagram(buf, order[i], 1);
+		sendto(skt, &buf[0], buf.size(), 0, (struct sockaddr*) &addr, sizeof(addr));
+	}
+	for (unsigned int i=5; i<100; i++) {
+		makeDatagram(buf, i, 1);
+		sendto(skt, &buf[0], buf.size(), 0, (struct sockaddr*) &addr, sizeof(addr));
+	}
+	close(skt);
+
+	vector<unsigned short> line(npixels);
+	for (unsigned int i=0; i<100; i++) {
+		if (i == 4)
+			continue;
+		CHECK(net.waitData(1000));
+		CHECK(net.getData(&line[0], lineSize));
+		CHECK(checkLine(line, i));
+	}
+	CHECK(metrics.get(Metrics::SequenceGaps) == 1);
+	net.setReceiveShards(1, -1, 6 + lineSize);
+}
+
+int main() {
+	testReplay();
+	testSequenceGap();
+	testCaptureThenReplay();
+	testShardedReorder();
+	return testResult();
+}
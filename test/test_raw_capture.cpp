@@ -0,0 +1,204 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_raw_capture.cpp
+// Created on: Oct 19, 2026
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include "UltraRawCapture.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+// two data pages after the 4096 bytes header
+static const long long fileSize = 3 * 4096;
+
+static string tempName(const char* name) {
+	stringstream filename;
+	filename << "/tmp/" << name << "_" << getpid() << ".raw";
+	return filename.str();
+}
+
+// datagram i holds i in its first word and i + k in its byte k
+static int fillDatagram(vector<char>& buf, unsigned int i, int len) {
+	buf.resize(len);
+	for (int k=0; k<len; k++)
+		buf[k] = char(i + k);
+	if (len >= 4)
+		memcpy(&buf[0], &i, 4);
+	return len;
+}
+
+static bool checkDatagram(const vector<char>& buf, int n, unsigned int& i) {
+	if (n < 4)
+		return false;
+	memcpy(&i, &buf[0], 4);
+	for (int k=4; k<n; k++)
+		if (buf[k] != char(i + k))
+			return false;
+	return true;
+}
+
+/*
+ * Appends nb datagrams of the lengths given by lenOf, then checks the
+ * replay returns the records left in the ring, oldest first, twice
+ * around a rewind().
+ */
+template <class LenOf>
+static void captureAndReplay(const string& filename, unsigned int nb, LenOf lenOf) {
+	vector<char> buf;
+	RawCapture capture;
+	capture.open(filename, fileSize);
+	CHECK(capture.isOpen());
+	for (unsigned int i=0; i<nb; i++) {
+		int len = fillDatagram(buf, i, lenOf(i));
+		capture.append(&buf[0], len);
+	}
+
+	long long nb_records, nb_dropped;
+	capture.getNbRecords(nb_records);
+	capture.getNbDropped(nb_dropped);
+	CHECK(nb_records == nb);
+	CHECK(nb_dropped < nb_records);
+	capture.close();
+	CHECK(!capture.isOpen());
+
+	RawReplay replay;
+	replay.open(filename, false);
+	for (int pass=0; pass<2; pass++) {
+		unsigned int expected = nb_dropped;
+		int n;
+		buf.assign(4096, 0);
+		while ((n = replay.next(&buf[0], buf.size())) > 0) {
+			unsigned int i;
+			CHECK(n == lenOf(expected));
+			CHECK(checkDatagram(buf, n, i));
+			CHECK(i == expected);
+			expected++;
+		}
+		CHECK(expected == nb);
+		CHECK(replay.next(&buf[0], buf.size()) == 0);
+		replay.rewind();
+	}
+	replay.close();
+	unlink(filename.c_str());
+}
+
+static int fixedLen(unsigned int) {
+	return 1000;
+}
+
+static int varyingLen(unsigned int i) {
+	return 4 + (i * 397) % 2500;
+}
+
+static int smallLen(unsigned int i) {
+	return 4 + i % 8;
+}
+
+static void testNoWrap() {
+	string filename = tempName("test_raw_nowrap");
+	captureAndReplay(filename, 5, fixedLen);
+}
+
+/*
+ * 1016 bytes records, 8 of them fill the ring: the 9th wraps to the
+ * start, dropping the oldest ones
+ */
+static void testWrap() {
+	string filename = tempName("test_raw_wrap");
+	captureAndReplay(filename, 8, fixedLen);
+	captureAndReplay(filename, 9, fixedLen);
+	captureAndReplay(filename, 100, fixedLen);
+	captureAndReplay(filename, 1000, varyingLen);
+	captureAndReplay(filename, 5000, smallLen);
+
+	// the oldest records are dropped
+	vector<char> buf;
+	RawCapture capture;
+	capture.open(filename, fileSize);
+	for (unsigned int i=0; i<9; i++) {
+		fillDatagram(buf, i, 1000);
+		capture.append(&buf[0], 1000);
+	}
+	long long nb_dropped;
+	capture.getNbDropped(nb_dropped);
+	CHECK(nb_dropped == 1);
+	capture.close();
+	unlink(filename.c_str());
+}
+
+static void testTruncated() {
+	string filename = tempName("test_raw_truncated");
+	vector<char> buf;
+	RawCapture capture;
+	capture.open(filename, fileSize);
+	fillDatagram(buf, 7, 100);
+	capture.append(&buf[0], 100);
+	capture.close();
+
+	// a short buffer gets the start of the datagram
+	RawReplay replay;
+	replay.open(filename, false);
+	buf.assign(10, 0);
+	unsigned int i;
+	CHECK(replay.next(&buf[0], 10) == 10);
+	CHECK(checkDatagram(buf, 10, i));
+	CHECK(i == 7);
+	CHECK(replay.next(&buf[0], 10) == 0);
+	replay.close();
+	unlink(filename.c_str());
+}
+
+static void testErrors() {
+	string filename = tempName("test_raw_errors");
+	vector<char> buf(2 * fileSize);
+	RawCapture capture;
+	CHECK_THROW(capture.open(filename, 4096));
+	CHECK(!capture.isOpen());
+	capture.open(filename, fileSize);
+	CHECK_THROW(capture.open(filename, fileSize));
+	CHECK_THROW(capture.append(&buf[0], fileSize));
+	capture.close();
+
+	RawReplay replay;
+	CHECK_THROW(replay.open(filename + ".missing", false));
+	FILE* f = fopen(filename.c_str(), "w");
+	fwrite(&buf[0], 1, fileSize, f);
+	fclose(f);
+	CHECK_THROW(replay.open(filename, false));
+	CHECK(!replay.isOpen());
+	unlink(filename.c_str());
+}
+
+int main() {
+	testNoWrap();
+	testWrap();
+	testTruncated();
+	testErrors();
+	return testResult();
+}
@@ -0,0 +1,176 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+//
+// test_xchip_timing.cpp
+// Created on: Oct 19, 2026
+
+#include "UltraXchipTiming.h"
+#include "UltraCamera.h"
+#include "TestUtils.h"
+
+using namespace lima::Ultra;
+using namespace std;
+
+static XchipTiming makeTiming(unsigned int readoutMode) {
+	XchipTiming timing;
+	timing.delay = 20;
+	timing.width = 100;
+	timing.zeroWidth = 10;
+	timing.sampleWidth = 40;
+	timing.resetWidth = 5;
+	timing.settlingTime = 4;
+	timing.xClkHalfPeriod = 10;
+	timing.readoutMode = readoutMode;
+	timing.shiftDelay = 0;
+	return timing;
+}
+
+static void testRoundTrip(int headType, unsigned int readoutMode) {
+	XchipTimingModel model(headType, 512, 16, 10e-9);
+	XchipTiming timing = makeTiming(readoutMode);
+	XchipRegisters regs;
+	XchipTiming back;
+
+	model.toRegisters(timing, regs);
+	model.fromRegisters(regs, back);
+	CHECK(back.delay == timing.delay);
+	CHECK(back.width == timing.width);
+	CHECK(back.zeroWidth == timing.zeroWidth);
+	CHECK(back.sampleWidth == timing.sampleWidth);
+	CHECK(back.resetWidth == timing.resetWidth);
+	CHECK(back.settlingTime == timing.settlingTime);
+	CHECK(back.xClkHalfPeriod == timing.xClkHalfPeriod);
+	CHECK(back.readoutMode == timing.readoutMode);
+	CHECK(back.shiftDelay == regs.shiftDelay);
+}
+
+static void testWindows() {
+	XchipTiming timing = makeTiming(0);
+	XchipRegisters regs;
+
+	XchipTimingModel silicon(SILICON, 512, 16, 10e-9);
+	silicon.toRegisters(timing, regs);
+	CHECK(regs.rstDelay == timing.delay - timing.zeroWidth);
+	CHECK(regs.s1Delay == regs.rstDelay);
+	CHECK(regs.s1Width == timing.zeroWidth);
+	CHECK(regs.s2Delay + regs.s2Width == regs.rstDelay + timing.zeroWidth + timing.width);
+	CHECK(regs.s2Width == timing.sampleWidth);
+
+	// the INGAAS heads swap S1 and S2
+	XchipRegisters ingaas;
+	XchipTimingModel(INGAAS, 512, 16, 10e-9).toRegisters(timing, ingaas);
+	CHECK(ingaas.s2Delay == regs.s1Delay);
+	CHECK(ingaas.s2Width == regs.s1Width);
+	CHECK(ingaas.s1Delay == regs.s2Delay);
+	CHECK(ingaas.s1Width == regs.s2Width);
+}
+
+static void testValidate() {
+	XchipTimingModel model(SILICON, 512, 16, 10e-9);
+	vector<string> errors, adjustments;
+	XchipTiming timing = makeTiming(0);
+
+	CHECK(model.validate(timing, errors, adjustments));
+	CHECK(errors.empty());
+	CHECK(adjustments.empty());
+
+	timing.width = 0;
+	CHECK(!model.validate(timing, errors, adjustments));
+	CHECK(!errors.empty());
+
+	timing = makeTiming(0);
+	timing.sampleWidth = timing.width + 1;
+	timing.xClkHalfPeriod = 2;
+	timing.readoutMode = 2;
+	CHECK(!model.validate(timing, errors, adjustments));
+	CHECK(errors.size() == 3);
+
+	// adjusted, not rejected
+	timing = makeTiming(0);
+	timing.delay = timing.zeroWidth;
+	timing.settlingTime = timing.xClkHalfPeriod;
+	CHECK(model.validate(timing, errors, adjustments));
+	CHECK(adjustments.size() == 2);
+
+	XchipRegisters regs;
+	model.toRegisters(timing, regs);
+	CHECK(regs.rstDelay == 1);
+	CHECK(regs.xclkSettling == timing.xClkHalfPeriod - 2);
+}
+
+static void testLinePeriod() {
+	XchipTimingModel model(SILICON, 512, 16, 10e-9);
+	XchipTiming timing = makeTiming(0);
+
+	// 32 pixels per channel, one per XCLK cycle of 20 ticks
+	CHECK(model.getLineTicks(timing) == 640);
+	CHECK_CLOSE(model.getLinePeriod(timing), 6.4e-6, 1e-12);
+	CHECK_CLOSE(model.getMaxLineRate(timing), 1 / 6.4e-6, 1e-3);
+
+	// after the integration, the readout starts at the end of the sample window
+	timing.readoutMode = 1;
+	XchipRegisters regs;
+	model.toRegisters(timing, regs);
+	CHECK(model.getLineTicks(timing) == regs.shiftDelay + 640);
+
+	// a long integration sets the period
+	timing.readoutMode = 0;
+	timing.width = 5000;
+	CHECK(model.getLineTicks(timing) == timing.delay + timing.width);
+
+	model.setClockPeriod(20e-9);
+	CHECK_CLOSE(model.getClockPeriod(), 20e-9, 1e-15);
+	CHECK_CLOSE(model.getLinePeriod(timing), 5020 * 20e-9, 1e-12);
+}
+
+static void testFastest() {
+	XchipTimingModel model(SILICON, 512, 16, 10e-9);
+	XchipTiming base = makeTiming(1);
+	XchipTiming fastest;
+	vector<string> errors, adjustments;
+
+	model.getFastest(100, base, fastest);
+	CHECK(model.validate(fastest, errors, adjustments));
+	CHECK(adjustments.empty());
+	CHECK(fastest.width == 100);
+	CHECK(fastest.zeroWidth == base.zeroWidth);
+	CHECK(fastest.sampleWidth == base.sampleWidth);
+	CHECK(fastest.xClkHalfPeriod == base.settlingTime + 2);
+	CHECK(model.getLineTicks(fastest) <= model.getLineTicks(base));
+
+	// a sample window wider than the integration is clipped
+	model.getFastest(20, base, fastest);
+	CHECK(fastest.sampleWidth == 20);
+	CHECK(model.validate(fastest, errors, adjustments));
+}
+
+int main() {
+	testRoundTrip(SILICON, 0);
+	testRoundTrip(SILICON, 1);
+	testRoundTrip(INGAAS, 0);
+	testRoundTrip(INGAAS, 1);
+	testWindows();
+	testValidate();
+	testLinePeriod();
+	testFastest();
+	return testResult();
+}